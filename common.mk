@@ -14,9 +14,9 @@ VERBOSE=0
 CURSES=0
 
 ifeq ($(DEBUG), 0)
-_TMP_CFLAGS=-std=c++17 -O3 -Wall -Wno-unused-function -MMD -MP
+_TMP_CFLAGS=-std=c++17 -O3 -pthread -Wall -Wno-unused-function -MMD -MP
 else
-_TMP_CFLAGS=-std=c++17 -O0 -Wall -Wno-unused-function -MMD -MP -g3 -DDEBUG
+_TMP_CFLAGS=-std=c++17 -O0 -pthread -Wall -Wno-unused-function -MMD -MP -g3 -DDEBUG
 endif
 
 ifeq ($(VERBOSE), 1)
@@ -31,5 +31,5 @@ else
 CFLAGS=$(_TMP_CFLAGS2)
 endif
 
-LDFLAGS=-flto -L$(LIB_DIR) -L$(BASE_DIR)/utils/lib -lutil -lncurses
+LDFLAGS=-flto -pthread -L$(LIB_DIR) -L$(BASE_DIR)/utils/lib -lutil -lncurses
 
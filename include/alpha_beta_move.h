@@ -1,42 +1,242 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <limits>
-#include <unordered_map>
+#include <vector>
 
+#include <bit_go.h>
 #include <game_state.h>
 #include <move_gen.h>
+#include <move_orderer.h>
+#include <transposition_table.h>
 #include <zobrist.h>
 
 
 class AlphaBetaMove : public MoveGen {
-    friend bool _play(Game &, GameMove & m, Game & g,
-            int & alpha, int & beta, int & best_val, int depth,
-            uint32_t res_mask, GameMove * move, uint64_t & cnt);
-private:
+public:
 
     static constexpr int inf_depth = -1;
+
+private:
+
     static constexpr int min_int = std::numeric_limits<int>::min();
     static constexpr int max_int = std::numeric_limits<int>::max();
 
-    std::unordered_map<GameState, int, GameStateHash> cache;
+    // default number of entries in the transposition table (log base 2)
+    static constexpr uint32_t default_tt_log_size = 20;
+
+    // number of leaves between checks of the time budget (a power of 2)
+    static constexpr uint64_t budget_check_interval = 1024;
+
+    // null move pruning is tried with at least this much depth left, and
+    // searches the reply to passing this many moves shallower
+    static constexpr int null_move_min_depth = 3;
+    static constexpr int null_move_reduction = 2;
+
+    // quiet moves after the first lmr_min_moves are searched a move
+    // shallower with at least lmr_min_depth left, and two moves shallower
+    // after the first lmr_late_moves
+    static constexpr uint32_t lmr_min_moves = 3;
+    static constexpr uint32_t lmr_late_moves = 8;
+    static constexpr int lmr_min_depth = 3;
+
+    // half the width of the first aspiration window around the last
+    // iteration's score, in points
+    static constexpr int aspiration_window = 2;
+
+    /*
+     * the state of one thread's search. With more than one thread, the
+     * threads search the same position at once, sharing only the
+     * transposition table (lazy SMP), and the main thread's result is the
+     * one played
+     */
+    struct SearchThread {
+        MoveOrderer orderer;
+
+        // leaves visited by this thread in the current search
+        uint64_t cnt;
+
+        // set when some line searched so far was cut off by the depth limit
+        // rather than by the game ending
+        bool hit_horizon;
+
+        // helper threads give up on an iteration once the main thread has
+        // finished it
+        bool helper;
+
+        SearchThread(uint32_t n_tiles) : orderer(n_tiles), cnt(0),
+                hit_horizon(false), helper(false) {}
+    };
 
     Game & game;
-    // maximum number of moves deep we will search
+    // maximum number of moves deep we will search, searching 1, 2, ... moves
+    // deep until either this depth is reached, the search reaches the end of
+    // every line, or the budget runs out
     int max_depth;
 
+    // the budget for each call to next_move in seconds/leaves visited, or 0
+    // for no limit. The move found by the last iteration to finish is played
+    double time_limit;
+    uint64_t node_limit;
+
+    std::chrono::steady_clock::time_point search_start;
+    // set once the first iteration is done, since there must be some move to
+    // play
+    bool budget_armed;
+    // set when the budget runs out, which abandons the current iteration
+    std::atomic<bool> aborted;
+    // set when the main thread finishes an iteration
+    std::atomic<bool> iteration_done;
+    // leaves visited by all threads, counted in batches of
+    // budget_check_interval
+    std::atomic<uint64_t> shared_cnt;
+
+    // the best line found by the last iteration, as tile indices (or
+    // MoveOrderer::pass_move), which the next iteration searches first
+    std::vector<board_idx_t> pv;
+
     ZobristHash zh;
 
+    TranspositionTable tt;
+
+    // when false, moves are searched in row-major order, then passing
+    bool order_moves;
+
+    // when true, null move pruning and late move reductions are used, which
+    // search far fewer nodes but may miss moves which only look good deeper
+    bool reductions;
 
-    static int move_search(Game & g, int alpha, int beta, int depth,
-            GameMove * move, uint64_t & cnt);
+    // when true, principal variation search is used, with an aspiration
+    // window at the root, rather than searching every move with the full
+    // window
+    bool pvs;
+
+    // the main thread, followed by the helper threads
+    std::vector<SearchThread> threads;
+
+    // the number of leaves visited by the last search
+    uint64_t node_count;
+
+
+    // BitGo boards are only searched as BitGo (rather than through the Game
+    // interface) up to this size
+    static constexpr coord_t max_bit_go_size = 11;
+
+
+    /*
+     * G is either Go or BitGo (both final), which are searched without going
+     * through the Game interface: moves are tile indices played with
+     * play_idx, so expanding a node makes no virtual calls and uses no RTTI.
+     * If move is not null, the tile index of the best move is written to it
+     */
+    template<class G>
+    int move_search(G & g, SearchThread & t, int alpha, int beta, int depth,
+            uint32_t ply, bool on_pv, board_idx_t * move);
+
+    /*
+     * searches g from the root to the given depth, with an aspiration window
+     * around prev_score (the last iteration's score) when using pvs
+     */
+    template<class G>
+    int aspiration_search(G & g, SearchThread & t, int depth, int prev_score,
+            board_idx_t * move);
+
+    /*
+     * called by t every budget_check_interval leaves, which sets aborted if
+     * the budget has run out
+     */
+    void check_budget(SearchThread & t);
+
+    /*
+     * returns true if t should give up on the iteration it is searching
+     */
+    bool stopped(const SearchThread & t) const {
+        return aborted.load(std::memory_order_relaxed) ||
+            (t.helper && iteration_done.load(std::memory_order_relaxed));
+    }
+
+    /*
+     * fills pv with the best line from g stored in the transposition table,
+     * up to depth moves long
+     */
+    template<class G>
+    void extract_pv(G & g, int depth);
+
+    /*
+     * searches for the best move from an undecorated game g
+     */
+    template<class G>
+    void search(const G & g, GameMove & move);
+
+    /*
+     * searches g if it is a square BitGo of size N or larger, returning false
+     * if it isn't
+     */
+    template<coord_t N>
+    bool search_bit_go(Game & g, GameMove & move);
 
 public:
 
-    AlphaBetaMove(Game & game, int max_depth=inf_depth) : game(game),
-            max_depth(max_depth), zh(game.width(), game.height()) {}
+    AlphaBetaMove(Game & game, int max_depth=inf_depth,
+            uint32_t tt_log_size=default_tt_log_size, bool order_moves=true,
+            uint32_t n_threads=1) :
+            game(game), max_depth(max_depth), time_limit(0), node_limit(0),
+            budget_armed(false), aborted(false), iteration_done(false),
+            shared_cnt(0), zh(game.width(), game.height()), tt(tt_log_size),
+            order_moves(order_moves), reductions(true), pvs(true),
+            node_count(0) {
+        set_threads(n_threads);
+    }
 
     virtual ~AlphaBetaMove() = default;
 
     virtual MoveStatus next_move(GameMove &);
+
+    /*
+     * limits each call to next_move to about the given number of seconds
+     * (0 for no limit)
+     */
+    void set_time_limit(double seconds) {
+        time_limit = seconds;
+    }
+
+    /*
+     * limits each call to next_move to about the given number of leaves
+     * visited (0 for no limit)
+     */
+    void set_node_limit(uint64_t nodes) {
+        node_limit = nodes;
+    }
+
+    /*
+     * turns null move pruning and late move reductions on or off (they are
+     * on by default), without which the search finds the exact minimax move
+     * to its depth
+     */
+    void set_reductions(bool on) {
+        reductions = on;
+    }
+
+    /*
+     * chooses between principal variation search with aspiration windows
+     * (the default) and searching every move with the full window
+     */
+    void set_pvs(bool on) {
+        pvs = on;
+    }
+
+    /*
+     * sets the number of threads to search with
+     */
+    void set_threads(uint32_t n_threads);
+
+    /*
+     * the number of leaves visited by the last call to next_move, by all
+     * threads
+     */
+    uint64_t get_node_count() const {
+        return node_count;
+    }
 };
 
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <eval_cache.h>
+#include <go.h>
+#include <mcts_move.h>
+#include <network.h>
+
+
+/*
+ * evaluates Go positions for the search threads of an MctsMove with a value
+ * and policy network, running the positions submitted by every thread through
+ * the network together
+ *
+ * each call to evaluate queues its position and blocks. A worker thread takes
+ * up to batch_size positions off the queue once there are that many, or once
+ * the oldest has waited for the timeout, runs them through the network in one
+ * forward pass, and wakes their threads. Batches can only fill if at least
+ * batch_size threads are searching
+ *
+ * the network's first output is the value of the position to black (one
+ * float, as the tanh head of py/monte_carlo.py), and its second the policy
+ * logits over the tiles of the board in row-major order, optionally followed
+ * by a logit for passing. Without one, passing is given the smallest logit of
+ * the legal moves
+ */
+class BatchEvaluator : public MctsEvaluator {
+public:
+
+    /*
+     * writes the network input for g to input
+     */
+    typedef std::function<void(const Go & g, float * input)> Encoder;
+
+    struct Stats {
+        // positions evaluated and forward passes run
+        uint64_t positions;
+        uint64_t batches;
+        // positions waiting to be batched now, and the most there have been
+        uint32_t queue_depth;
+        uint32_t max_queue_depth;
+        // the fraction of the batch the average forward pass filled
+        double fill_ratio;
+        // percentiles of the time from a position being submitted to its
+        // result being ready, in microseconds, over the last latency_window
+        // positions
+        double latency_p50;
+        double latency_p90;
+        double latency_p99;
+    };
+
+    // the number of latencies kept for the percentiles
+    static constexpr uint32_t latency_window = 4096;
+
+private:
+
+    /*
+     * a position waiting for evaluation, which lives on the stack of the
+     * thread which submitted it
+     */
+    struct Request {
+        const float * input;
+        const Go * g;
+        const board_idx_t * moves;
+        uint32_t n_moves;
+        float * priors;
+        // the cache to add the evaluation to, or null, and the position's
+        // key in it
+        EvalCache * cache;
+        EvalCache::Key key;
+
+        float value;
+        bool done;
+        // set if evaluating the position threw, to be rethrown by the
+        // submitting thread rather than escaping the worker
+        std::exception_ptr error;
+        std::chrono::steady_clock::time_point submitted;
+    };
+
+    Network & net;
+    Encoder encoder;
+    uint32_t batch_size;
+    std::chrono::microseconds timeout;
+
+    // positions are looked up here before being queued, and added once
+    // evaluated, unless this is null
+    EvalCache * cache;
+
+    // guards everything below
+    mutable std::mutex lock;
+    // signals the worker that the queue has grown or that it should stop
+    std::condition_variable work_cv;
+    // signals submitting threads that a batch is done
+    std::condition_variable done_cv;
+
+    std::deque<Request *> queue;
+    bool stopping;
+
+    uint64_t n_positions;
+    uint64_t n_batches;
+    uint32_t max_queue_depth;
+    // a ring of the latest latencies in microseconds, written at
+    // n_positions % latency_window
+    std::vector<uint32_t> latencies;
+
+    // the network input for one batch, only touched by the worker
+    std::vector<float> batch_input;
+
+    std::thread worker;
+
+    void run_worker();
+
+    /*
+     * writes the softmax of logits (a logit for each tile in row-major order
+     * then one for passing, or NaN if there is none) over the given moves
+     * of g to priors
+     */
+    static void softmax_priors(const Go & g, const float * logits,
+            const board_idx_t * moves, uint32_t n_moves, float * priors);
+
+    /*
+     * writes the value and priors of request r from entry b of the network
+     * outputs of the last forward pass, and caches them. logits is scratch
+     * space
+     */
+    void read_outputs(Request & r, uint32_t b,
+            std::vector<float> & logits) const;
+
+public:
+
+    /*
+     * encodes positions with the four planes py/monte_carlo.py gives the
+     * network: the stones of the player to move, the opponent's stones,
+     * empty tiles, and a plane of ones if black is to move
+     */
+    static void encode_stones(const Go & g, float * input);
+
+    /*
+     * net must outlive this evaluator, and is only run by its worker thread
+     */
+    BatchEvaluator(Network & net, uint32_t batch_size,
+            std::chrono::microseconds timeout,
+            Encoder encoder=encode_stones);
+
+    /*
+     * finishes the positions in the queue and stops the worker
+     */
+    virtual ~BatchEvaluator();
+
+    /*
+     * throws if g isn't the size of board the network's policy is for, or if
+     * the network fails to evaluate the batch g is in
+     */
+    virtual float evaluate(const Game & g, const board_idx_t * moves,
+            uint32_t n_moves, float * priors);
+
+    /*
+     * looks positions up in cache before evaluating them, and adds the ones
+     * evaluated to it, or stops caching if cache is null. The cache must be
+     * for the board size evaluated, and must outlive this evaluator. Cache
+     * hits aren't counted in the stats. Positions are hashed once each, and
+     * searches started after this keep the cache's hash up to date in their
+     * games (see MctsEvaluator::get_zobrist)
+     */
+    void set_cache(EvalCache * cache) {
+        this->cache = cache;
+    }
+
+    virtual const ZobristHash * get_zobrist() const {
+        return cache != nullptr ? &cache->get_zobrist() : nullptr;
+    }
+
+    Stats get_stats() const;
+
+    void reset_stats();
+};
+
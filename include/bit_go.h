@@ -0,0 +1,682 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <bitboard.h>
+#include <game.h>
+#include <go.h>
+#include <zobrist.h>
+
+
+/*
+ * Go on a W x H board small enough that the whole board fits in a single
+ * bitboard_t (up to 11x11), storing only the sets of black and white stones.
+ * Captures, liberties, suicide and the set of legal moves are all found with
+ * shifts and masks, so there are no strings to maintain and the whole state
+ * of the game is a few words, which makes undo a copy
+ *
+ * tiles are indexed by y * W + x with no border, which is also the layout of
+ * ZobristHash's table
+ */
+template<coord_t W, coord_t H = W>
+class BitGo final : public Game {
+public:
+
+    static constexpr uint32_t n_tiles = ((uint32_t) W) * ((uint32_t) H);
+
+    static_assert(W > 0 && H > 0 && n_tiles <= bitboard_bits,
+            "board does not fit in a bitboard");
+
+    // the tile index of no tile, which stands for passing in play_idx
+    static constexpr board_idx_t no_position = 0xffffu;
+
+private:
+
+    // when last_move is this, that means the last move was a pass
+    static constexpr board_idx_t one_pass = 0xffffu;
+    // when last_move is this, that means the last two moves were
+    // passes, and thus the game is over
+    static constexpr board_idx_t two_passes = 0xfffeu;
+
+    static constexpr bitboard_t col_mask(coord_t x) {
+        bitboard_t m = 0;
+        for (coord_t y = 0; y < H; y++) {
+            m |= bb_bit(y * W + x);
+        }
+        return m;
+    }
+
+    // every tile on the board
+    static constexpr bitboard_t board_mask = n_tiles == bitboard_bits ?
+        ~((bitboard_t) 0) : bb_bit(n_tiles) - 1;
+    // tiles in the leftmost and rightmost columns, which shifting by one
+    // would otherwise wrap into the neighboring row
+    static constexpr bitboard_t left_col = col_mask(0);
+    static constexpr bitboard_t right_col = col_mask(W - 1);
+
+    /*
+     * everything about the game which changes when a move is made
+     */
+    struct State {
+        // black stones, then white stones (indexed by color - black)
+        bitboard_t stones[2];
+
+        uint32_t black_captures, white_captures;
+
+        uint16_t turn;
+        board_idx_t last_move;
+        board_idx_t ko_move;
+
+        zob_hash_t zob_raw;
+    };
+
+    /*
+     * the state before a move was made, along with the move (no_position for
+     * a pass)
+     */
+    struct Frame {
+        State state;
+        board_idx_t move;
+    };
+
+    State s;
+
+    std::vector<Frame> frames;
+
+    // moves which have been undone and can be replayed with redo, with the
+    // most recently undone move last (no_position for passes)
+    std::vector<board_idx_t> redo_moves;
+
+    /*
+     * when set, the hash function whose raw hash is kept up to date in
+     * s.zob_raw as moves are made (see Go::set_zobrist)
+     */
+    const ZobristHash * zh;
+    const zob_hash_t * zob_tiles;
+    const zob_hash_t * zob_turns;
+
+
+    /*
+     * the set of tiles adjacent to some tile in b
+     */
+    static bitboard_t adjacent(bitboard_t b) {
+        return (((b << 1) & ~left_col) | ((b >> 1) & ~right_col) |
+                (b << W) | (b >> W)) & board_mask;
+    }
+
+    /*
+     * every tile in mask connected to a tile in seed through tiles in mask
+     * (seed must be a subset of mask)
+     */
+    static bitboard_t flood(bitboard_t seed, bitboard_t mask) {
+        bitboard_t prev;
+        do {
+            prev = seed;
+            seed = (seed | adjacent(seed)) & mask;
+        } while (seed != prev);
+        return seed;
+    }
+
+    bitboard_t empty_tiles() const {
+        return board_mask & ~(s.stones[0] | s.stones[1]);
+    }
+
+    bitboard_t ko_mask() const {
+        return s.ko_move == no_position ? 0 : bb_bit(s.ko_move);
+    }
+
+    std::string idx_str(board_idx_t idx) const {
+        return std::string(1, Go::COL_INDICATORS[idx % W]) +
+            std::to_string(H - idx / W);
+    }
+
+    /*
+     * checks whether the move is suicidal, assuming idx is empty
+     */
+    bool move_is_suicide(board_idx_t idx, Color color) const {
+        bitboard_t p = bb_bit(idx);
+        bitboard_t adj = adjacent(p);
+        bitboard_t own = s.stones[color - Color::black];
+        bitboard_t opp = s.stones[other_color(color) - Color::black];
+        bitboard_t libs = empty_tiles() & ~p;
+
+        if (adj & libs) {
+            return false;
+        }
+
+        // all friendly strings around idx join into one, which keeps any
+        // liberty other than idx
+        bitboard_t own_adj = adj & own;
+        if (own_adj != 0 && (adjacent(flood(own_adj, own)) & libs) != 0) {
+            return false;
+        }
+
+        // the move captures any enemy string whose only liberty is idx
+        bitboard_t opp_adj = adj & opp;
+        while (opp_adj != 0) {
+            bitboard_t str = flood(bb_lsb(opp_adj), opp);
+            if ((adjacent(str) & libs) == 0) {
+                return false;
+            }
+            opp_adj &= ~str;
+        }
+        return true;
+    }
+
+    void zob_tile(board_idx_t idx, uint8_t from, uint8_t to) {
+        if (zh != nullptr) {
+            s.zob_raw ^= zob_tiles[ZobristHash::num_states * idx + from] ^
+                zob_tiles[ZobristHash::num_states * idx + to];
+        }
+    }
+
+    uint8_t zob_turn_idx() const {
+        return (get_player() == Color::white) + (has_passed() << 1);
+    }
+
+    /*
+     * unsafe version of play, does not check the legality of the move,
+     * instead assuming it
+     */
+    void _do_play(board_idx_t idx, Color color) {
+        bitboard_t p = bb_bit(idx);
+        bitboard_t adj = adjacent(p);
+        bitboard_t & own = s.stones[color - Color::black];
+        bitboard_t & opp = s.stones[other_color(color) - Color::black];
+
+        // a lone stone with no liberties of its own that captures exactly one
+        // single stone may be retaken right away, unless that is forbidden
+        bool may_ko = (adj & (own | empty_tiles())) == 0;
+
+        own |= p;
+        zob_tile(idx, Color::empty, color);
+
+        bitboard_t libs = empty_tiles();
+        bitboard_t captured = 0;
+        uint32_t n_single = 0;
+        board_idx_t new_ko_pos = no_position;
+
+        bitboard_t opp_adj = adj & opp;
+        while (opp_adj != 0) {
+            bitboard_t str = flood(bb_lsb(opp_adj), opp);
+            opp_adj &= ~str;
+            if ((adjacent(str) & libs) == 0) {
+                captured |= str;
+                if (bb_popcount(str) == 1) {
+                    n_single++;
+                    new_ko_pos = bb_ctz(str);
+                }
+            }
+        }
+
+        opp &= ~captured;
+        uint32_t n_captures = bb_popcount(captured);
+        if (zh != nullptr) {
+            for (bitboard_t c = captured; c != 0; c &= c - 1) {
+                zob_tile(bb_ctz(c), other_color(color), Color::empty);
+            }
+        }
+
+        if (!may_ko || n_single != 1) {
+            new_ko_pos = no_position;
+        }
+        if (s.ko_move != no_position) {
+            zob_tile(s.ko_move, ZobristHash::ko, ZobristHash::empty);
+        }
+        if (new_ko_pos != no_position) {
+            zob_tile(new_ko_pos, ZobristHash::empty, ZobristHash::ko);
+        }
+        s.ko_move = new_ko_pos;
+
+        if (color == Color::black) {
+            s.black_captures += n_captures;
+        }
+        else {
+            s.white_captures += n_captures;
+        }
+    }
+
+    /*
+     * plays the move at idx (or a pass if idx is no_position), saving the
+     * current state so it can be undone, and assuming the move is legal
+     */
+    void push_move(board_idx_t idx, Color color) {
+        frames.push_back({ s, idx });
+
+        uint8_t prev_turn_idx = zob_turn_idx();
+
+        if (color == Color::pass) {
+            s.last_move = s.last_move == one_pass ? two_passes : one_pass;
+        }
+        else {
+            _do_play(idx, color);
+            s.last_move = idx;
+        }
+        s.turn++;
+
+        if (zh != nullptr) {
+            s.zob_raw ^= zob_turns[prev_turn_idx] ^ zob_turns[zob_turn_idx()];
+        }
+    }
+
+public:
+
+    BitGo() : s{ { 0, 0 }, 0, 0, 0, 0, no_position, 0 }, zh(nullptr),
+            zob_tiles(nullptr), zob_turns(nullptr) {
+        // a game can't last longer than this without a lot of captures, so
+        // searches rarely have to grow the undo stack
+        frames.reserve(2 * n_tiles);
+    }
+
+    BitGo(const BitGo & g) : s(g.s), frames(g.frames),
+            redo_moves(g.redo_moves), zh(g.zh), zob_tiles(g.zob_tiles),
+            zob_turns(g.zob_turns) {
+        frames.reserve(2 * n_tiles);
+    }
+
+    BitGo(BitGo && g) : s(g.s), frames(std::move(g.frames)),
+            redo_moves(std::move(g.redo_moves)), zh(g.zh),
+            zob_tiles(g.zob_tiles), zob_turns(g.zob_turns) {
+    }
+
+    BitGo & operator=(const BitGo & g) {
+        s = g.s;
+        frames = g.frames;
+        redo_moves = g.redo_moves;
+        zh = g.zh;
+        zob_tiles = g.zob_tiles;
+        zob_turns = g.zob_turns;
+        return *this;
+    }
+
+    BitGo & operator=(BitGo && g) {
+        s = g.s;
+        frames = std::move(g.frames);
+        redo_moves = std::move(g.redo_moves);
+        zh = g.zh;
+        zob_tiles = g.zob_tiles;
+        zob_turns = g.zob_turns;
+        return *this;
+    }
+
+    virtual Game & operator=(const Game & game) {
+        const BitGo & g = dynamic_cast<const BitGo &>(game.strip());
+        return (*this) = g;
+    }
+
+    virtual Game & operator=(Game && game) {
+        BitGo && g = dynamic_cast<BitGo &&>(game);
+        return (*this) = std::move(g);
+    }
+
+    virtual ~BitGo() = default;
+
+
+    virtual Game & strip() const {
+        return const_cast<BitGo &>(*this);
+    }
+
+    virtual coord_t width() const {
+        return W;
+    }
+
+    virtual coord_t height() const {
+        return H;
+    }
+
+    virtual uint16_t get_turn() const {
+        return s.turn;
+    }
+
+    /*
+     * returns tile at given coordinates
+     */
+    Color tile_at(coord_t x, coord_t y) const {
+        board_idx_t idx = to_idx(x, y);
+        return bb_test(s.stones[0], idx) ? Color::black :
+            bb_test(s.stones[1], idx) ? Color::white :
+            idx == s.ko_move ? Color::ko : Color::empty;
+    }
+
+    /*
+     * converts between coordinates and the tile indices legal_moves gives
+     */
+    board_idx_t to_idx(coord_t x, coord_t y) const {
+        return y * W + x;
+    }
+
+    coord_t idx_x(board_idx_t idx) const {
+        return idx % W;
+    }
+
+    coord_t idx_y(board_idx_t idx) const {
+        return idx / W;
+    }
+
+    /*
+     * see Go::is_capture
+     */
+    bool is_capture(board_idx_t idx, Color color) const {
+        bitboard_t p = bb_bit(idx);
+        bitboard_t opp = s.stones[other_color(color) - Color::black];
+        bitboard_t libs = empty_tiles() & ~p;
+        for (bitboard_t adj = adjacent(p) & opp; adj != 0;) {
+            bitboard_t str = flood(bb_lsb(adj), opp);
+            if ((adjacent(str) & libs) == 0) {
+                return true;
+            }
+            adj &= ~str;
+        }
+        return false;
+    }
+
+    /*
+     * see Go::is_atari_escape
+     */
+    bool is_atari_escape(board_idx_t idx, Color color) const {
+        bitboard_t p = bb_bit(idx);
+        bitboard_t own = s.stones[color - Color::black];
+        bitboard_t libs = empty_tiles() & ~p;
+        for (bitboard_t adj = adjacent(p) & own; adj != 0;) {
+            bitboard_t str = flood(bb_lsb(adj), own);
+            if ((adjacent(str) & libs) == 0) {
+                return true;
+            }
+            adj &= ~str;
+        }
+        return false;
+    }
+
+    virtual std::shared_ptr<Game> clone() const {
+        return std::make_shared<BitGo>(*this);
+    }
+
+    virtual bool game_over() const {
+        return s.last_move == two_passes;
+    }
+
+    /*
+     * area score, with the same meaning as Go::get_score
+     */
+    virtual int get_score() const {
+        bitboard_t empty = empty_tiles();
+        bitboard_t b_reach = flood(adjacent(s.stones[0]) & empty, empty);
+        bitboard_t w_reach = flood(adjacent(s.stones[1]) & empty, empty);
+
+        int score = ((int) bb_popcount(b_reach & ~w_reach)) -
+            ((int) bb_popcount(w_reach & ~b_reach));
+        return score + s.black_captures - s.white_captures;
+    }
+
+    virtual bool max_player() const {
+        // black (first player) is maximizing player
+        return (s.turn & 1) == 0;
+    }
+
+    /*
+     * return the color of the current player
+     */
+    Color get_player() const {
+        return (s.turn & 1) == 0 ? Color::black : Color::white;
+    }
+
+    /*
+     * returns true if the last player passed
+     */
+    bool has_passed() const {
+        return s.last_move == one_pass;
+    }
+
+    /*
+     * returns the number of stones the given player has captured
+     */
+    uint32_t get_captures(Color color) const {
+        return color == Color::black ? s.black_captures : s.white_captures;
+    }
+
+    /*
+     * see Go::set_zobrist
+     */
+    void set_zobrist(const ZobristHash * zh) {
+        this->zh = zh;
+        if (zh != nullptr) {
+            GO_ASSERT(W == zh->width() && H == zh->height(),
+                    "Zobrist hash is for a different board size");
+            this->zob_tiles = zh->get_table();
+            this->zob_turns = zh->get_turn_hashes();
+            s.zob_raw = zh->compute_raw_hash(*this);
+        }
+        else {
+            this->zob_tiles = nullptr;
+            this->zob_turns = nullptr;
+            s.zob_raw = 0;
+        }
+    }
+
+    const ZobristHash * get_zobrist() const {
+        return zh;
+    }
+
+    zob_hash_t get_raw_hash() const {
+        return s.zob_raw;
+    }
+
+    /*
+     * the set of tiles the current player may play on (a pass is always
+     * legal as well, until the game is over)
+     */
+    bitboard_t legal_move_mask() const {
+        if (game_over()) {
+            return 0;
+        }
+
+        Color color = get_player();
+        bitboard_t empty = empty_tiles();
+        bitboard_t cand = empty & ~ko_mask();
+
+        // any empty tile next to another empty tile always has a liberty, so
+        // only the rest have to be checked one by one
+        bitboard_t legal = cand & adjacent(empty);
+        for (bitboard_t rest = cand & ~legal; rest != 0; rest &= rest - 1) {
+            board_idx_t idx = bb_ctz(rest);
+            if (!move_is_suicide(idx, color)) {
+                legal |= bb_bit(idx);
+            }
+        }
+        return legal;
+    }
+
+    /*
+     * see Go::legal_moves
+     */
+    uint32_t legal_moves(board_idx_t * moves) const {
+        uint32_t n_moves = 0;
+        for (bitboard_t legal = legal_move_mask(); legal != 0;
+                legal &= legal - 1) {
+            moves[n_moves++] = bb_ctz(legal);
+        }
+        return n_moves;
+    }
+
+    virtual bool is_current() const {
+        return redo_moves.empty();
+    }
+
+    virtual void play(GameMove & m) {
+        GoMove & gm = dynamic_cast<GoMove &>(m);
+
+        GO_ASSERT(!game_over(), "the game is already over, cannot play "
+                "another move");
+        board_idx_t idx = no_position;
+        if (gm.color != Color::pass) {
+            GO_ASSERT(gm.x < W && gm.y < H, "move is out of bounds");
+            idx = to_idx(gm.x, gm.y);
+            GO_ASSERT(bb_test(empty_tiles(), idx), "%s is already occupied",
+                    idx_str(idx).c_str());
+            GO_ASSERT(!move_is_suicide(idx, gm.color), "move %s is suicidal",
+                    idx_str(idx).c_str());
+            GO_ASSERT(gm.color == get_player(), "tried playing %s on turn %u",
+                    (gm.color == Color::white ? "white" :
+                     gm.color == Color::black ? "black" : "no color"),
+                    s.turn);
+            GO_ASSERT(idx != s.ko_move, "illegal ko move at %s",
+                    idx_str(idx).c_str());
+        }
+
+        // playing a new move discards the moves that could have been redone
+        redo_moves.clear();
+        push_move(idx, gm.color);
+    }
+
+    virtual void undo() {
+        GO_ASSERT(!frames.empty(), "no moves to undo");
+
+        const Frame & f = frames.back();
+        s = f.state;
+        redo_moves.push_back(f.move);
+        frames.pop_back();
+    }
+
+    /*
+     * plays the current player's move at tile index idx, or passes if idx is
+     * no_position, for searches which know they are playing BitGo. Unlike
+     * play, the move is assumed to be legal (e.g. from legal_moves)
+     */
+    void play_idx(board_idx_t idx) {
+        push_move(idx, idx == no_position ? Color::pass : get_player());
+    }
+
+    /*
+     * BitGo only enforces simple ko, so no move recreates a position it
+     * forbids (see Go::superko_violation)
+     */
+    bool superko_violation() const {
+        return false;
+    }
+
+    bool get_superko() const {
+        return false;
+    }
+
+    /*
+     * undoes a move made by play_idx, which can't be redone
+     */
+    void undo_idx() {
+        s = frames.back().state;
+        frames.pop_back();
+    }
+
+    virtual void redo() {
+        GO_ASSERT(!redo_moves.empty(), "no moves to redo");
+
+        board_idx_t idx = redo_moves.back();
+        redo_moves.pop_back();
+        push_move(idx, idx == no_position ? Color::pass : get_player());
+    }
+
+    virtual void for_each_legal_move(
+            std::function<bool(Game &, GameMove &)> f) {
+        for_each_legal_move_inline(f);
+    }
+
+    template<typename Fn, typename... Args>
+    inline void for_each_legal_move_inline(const Fn &fn, Args &...args) {
+        GoMove m;
+
+        if (game_over()) {
+            // cannot play once the game has ended
+            return;
+        }
+
+        m.color = get_player();
+
+        // in the same order as Go, by row and then by column
+        for (bitboard_t legal = legal_move_mask(); legal != 0;
+                legal &= legal - 1) {
+            board_idx_t idx = bb_ctz(legal);
+            m.x = idx_x(idx);
+            m.y = idx_y(idx);
+            if (!fn(*this, m, std::forward<Args>(args)...)) {
+                return;
+            }
+        }
+
+        // pass
+        m.color = Color::pass;
+        fn(*this, m, std::forward<Args>(args)...);
+    }
+
+
+    /*
+     * builds a Go with the same moves played as this game, which is used for
+     * printing and to check this game against
+     */
+    Go to_go() const {
+        Go g(W, H);
+        GoMove m;
+        for (size_t i = 0; i < frames.size(); i++) {
+            board_idx_t idx = frames[i].move;
+            m.color = idx == no_position ? Color::pass :
+                (i & 1) == 0 ? Color::black : Color::white;
+            m.x = idx % W;
+            m.y = idx / W;
+            g.play(m);
+        }
+        return g;
+    }
+
+    virtual void print_named(std::ostream & o,
+            const std::string & p1_name,
+            const std::string & p2_name) const {
+        to_go().print_named(o, p1_name, p2_name);
+    }
+
+    virtual void print(std::ostream & o) const {
+        to_go().print(o);
+    }
+
+    virtual void consistency_check() const {
+        GO_ASSERT((s.stones[0] & s.stones[1]) == 0, "tile is both black and "
+                "white");
+        GO_ASSERT(((s.stones[0] | s.stones[1]) & ~board_mask) == 0,
+                "stone off the board");
+        GO_ASSERT(frames.size() == s.turn, "%zu moves recorded on turn %u",
+                frames.size(), s.turn);
+
+        // every string on the board must have a liberty
+        for (bitboard_t st = s.stones[0] | s.stones[1]; st != 0;) {
+            bitboard_t col = bb_test(s.stones[0], bb_ctz(st)) ?
+                s.stones[0] : s.stones[1];
+            bitboard_t str = flood(bb_lsb(st), col);
+            GO_ASSERT((adjacent(str) & empty_tiles()) != 0, "string at %s "
+                    "has no liberties", idx_str(bb_ctz(str)).c_str());
+            st &= ~str;
+        }
+
+        // replaying the game in Go must give the same position
+        Go g = to_go();
+        for (coord_t y = 0; y < H; y++) {
+            for (coord_t x = 0; x < W; x++) {
+                GO_ASSERT(g.tile_at(x, y) == tile_at(x, y), "tile at %s is "
+                        "%d, but is %d in Go", idx_str(to_idx(x, y)).c_str(),
+                        tile_at(x, y), g.tile_at(x, y));
+            }
+        }
+        GO_ASSERT(g.get_score() == get_score() &&
+                g.get_captures(Color::black) == s.black_captures &&
+                g.get_captures(Color::white) == s.white_captures &&
+                g.game_over() == game_over() &&
+                g.has_passed() == has_passed(),
+                "game state does not match Go");
+
+        GO_ASSERT(zh == nullptr || s.zob_raw == zh->compute_raw_hash(*this),
+                "incremental Zobrist hash %016llx does not match the board "
+                "%016llx", (unsigned long long) s.zob_raw,
+                (unsigned long long) zh->compute_raw_hash(*this));
+    }
+
+};
+
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+
+
+/*
+ * 128-bit set of board positions, with bit i representing the tile at
+ * index i
+ */
+typedef unsigned __int128 bitboard_t;
+
+static constexpr uint32_t bitboard_bits = 8 * sizeof(bitboard_t);
+
+
+static constexpr bitboard_t bb_bit(uint32_t idx) {
+    return ((bitboard_t) 1) << idx;
+}
+
+static inline bool bb_test(bitboard_t b, uint32_t idx) {
+    return ((b >> idx) & 1) != 0;
+}
+
+static inline uint32_t bb_popcount(bitboard_t b) {
+    return __builtin_popcountll((uint64_t) b) +
+        __builtin_popcountll((uint64_t) (b >> 64));
+}
+
+/*
+ * returns the lowest set bit of b as a bitboard (or 0 if b is 0)
+ */
+static inline bitboard_t bb_lsb(bitboard_t b) {
+    return b & -b;
+}
+
+/*
+ * returns the index of the lowest set bit in b, which must be nonzero
+ */
+static inline uint32_t bb_ctz(bitboard_t b) {
+    uint64_t lo = (uint64_t) b;
+    return lo != 0 ? __builtin_ctzll(lo) :
+        64 + __builtin_ctzll((uint64_t) (b >> 64));
+}
+
+/*
+ * the set of tiles adjacent to a tile in b (but not b itself), on a board
+ * whose rows are row_width bits apart. Tiles on the left and right edges are
+ * only kept separate if the board is padded with a column of tiles that are
+ * never in the masks this is combined with
+ */
+static inline bitboard_t bb_adjacent(bitboard_t b, uint32_t row_width) {
+    return (b << 1) | (b >> 1) | (b << row_width) | (b >> row_width);
+}
+
+/*
+ * the set of tiles in b along with every tile adjacent to one (see
+ * bb_adjacent)
+ */
+static inline bitboard_t bb_dilate(bitboard_t b, uint32_t row_width) {
+    return b | bb_adjacent(b, row_width);
+}
+
+/*
+ * grows seed through the tiles in mask until it can't grow any more, giving
+ * every tile in mask connected to a tile in seed (seed must be a subset of
+ * mask)
+ */
+static inline bitboard_t bb_flood(bitboard_t seed, bitboard_t mask,
+        uint32_t row_width) {
+    bitboard_t prev;
+    do {
+        prev = seed;
+        seed = bb_dilate(seed, row_width) & mask;
+    } while (seed != prev);
+    return seed;
+}
+
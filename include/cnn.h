@@ -1,11 +0,0 @@
-#ifndef _CNN_H
-#define _CNN_H
-
-#define PY_SSIZE_T_CLEAN
-#include <Python/Python.h>
-
-int go();
-
-static PyObject * spam_system(PyObject *self, PyObject *args);
-
-#endif /* _CNN_H */
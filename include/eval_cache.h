@@ -0,0 +1,192 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <go.h>
+#include <zobrist.h>
+
+
+/*
+ * a bounded cache of network evaluations, shared by every search thread
+ *
+ * positions are keyed by ZobristHash::symm_key, which is the same for all 16
+ * symmetries of a position (the 8 rotations and reflections of the board,
+ * each with or without the colors and the side to move exchanged), so a
+ * position is found if any of its symmetries was evaluated. Each entry keeps
+ * the raw hash of the position it holds, from which lookup works out which
+ * symmetry may relate the two, and the position itself, which confirms that
+ * the symmetry does before the value and policy are given back mapped
+ * through it
+ *
+ * the cache is split into shards, each a direct-mapped table with its own
+ * lock, and a new entry replaces whatever was in its slot
+ */
+class EvalCache {
+public:
+
+    struct Stats {
+        uint64_t lookups;
+        uint64_t hits;
+        // hits on a different symmetry of the position than was stored
+        uint64_t symmetric_hits;
+        uint64_t inserts;
+        double hit_rate;
+        // entries filled, and the number there is room for
+        uint64_t size;
+        uint64_t capacity;
+    };
+
+    static constexpr uint32_t default_log_entries = 16;
+    static constexpr uint32_t default_shards = 16;
+
+private:
+
+    /*
+     * a symmetry of the board: mirror (x -> w - x - 1) if mirror is set,
+     * then rotate by 90 degrees (x -> w - y - 1, y -> x) rotations times,
+     * then exchange the colors if swap_colors is set
+     */
+    struct Symmetry {
+        bool mirror;
+        uint32_t rotations;
+        bool swap_colors;
+    };
+
+    static constexpr uint32_t n_symmetries = 16;
+
+    struct Entry {
+        // the symmetric key, 0 for empty entries
+        zob_hash_t key;
+        zob_hash_t raw;
+        float value;
+        // as the turn hashes of ZobristHash: 1 if white is to move, plus 2 if
+        // the last player passed
+        uint8_t turn;
+    };
+
+    struct Shard {
+        std::mutex lock;
+        std::vector<Entry> entries;
+        // policy_size logits for each entry
+        std::vector<float> policies;
+        // board_words words for each entry, holding the state of each tile
+        // (as ZobristHash's tile states) in 2 bits, in row-major order
+        std::vector<uint64_t> boards;
+
+        uint64_t lookups, hits, symmetric_hits, inserts, size;
+    };
+
+    coord_t w, h;
+    uint32_t policy_size;
+    uint32_t board_words;
+
+    ZobristHash zh;
+
+    uint32_t log_entries_per_shard;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    // for each of the 8 symmetries of the board (without exchanging colors),
+    // the row-major index each tile is moved to
+    std::vector<uint16_t> tile_maps;
+
+    static Symmetry symmetry(uint32_t s) {
+        return { (s & 4) != 0, s & 3, (s & 8) != 0 };
+    }
+
+    Shard & shard_of(zob_hash_t key) const {
+        return *shards[key % shards.size()];
+    }
+
+    size_t slot_of(zob_hash_t key) const {
+        return (key / shards.size()) &
+            ((((size_t) 1) << log_entries_per_shard) - 1);
+    }
+
+    static uint8_t turn_of(const Go & g) {
+        return (g.get_player() == Color::white) + (g.has_passed() << 1);
+    }
+
+    /*
+     * whether the position packed in board, with turn turn, becomes g under
+     * symmetry s
+     */
+    bool matches(const Go & g, const uint64_t * board, uint8_t turn,
+            uint32_t s) const;
+
+public:
+
+    /*
+     * a cache of about 2^log_entries evaluations of w x h positions (which
+     * must be square), split into n_shards shards
+     */
+    EvalCache(coord_t w, coord_t h,
+            uint32_t log_entries=default_log_entries,
+            uint32_t n_shards=default_shards);
+
+    /*
+     * the number of policy logits stored for each position: one for each
+     * tile in row-major order, then one for passing, which may be NaN if the
+     * network doesn't give one
+     */
+    uint32_t get_policy_size() const {
+        return policy_size;
+    }
+
+    /*
+     * the hashes a position is cached under
+     */
+    struct Key {
+        zob_hash_t raw;
+        // the symmetric key, never 0
+        zob_hash_t symm;
+    };
+
+    /*
+     * the hash function positions are keyed by. Games given it with
+     * Go::set_zobrist keep their raw hash up to date as they are played,
+     * which saves key one of its walks over the board
+     */
+    const ZobristHash & get_zobrist() const {
+        return zh;
+    }
+
+    /*
+     * the key of g, which lookup and insert take so a position can be looked
+     * up and then inserted hashing it only once
+     */
+    Key key(const Go & g) const {
+        zob_hash_t raw = zh.raw_hash(g);
+        return { raw, zh.symm_key(g, raw) | 1 };
+    }
+
+    /*
+     * looks up g, whose key is k, returning true and writing its value (to
+     * black) and policy logits (oriented as g is) if any symmetry of it is
+     * cached
+     */
+    bool lookup(const Go & g, const Key & k, float & value, float * policy);
+
+    bool lookup(const Go & g, float & value, float * policy) {
+        return lookup(g, key(g), value, policy);
+    }
+
+    void insert(const Go & g, const Key & k, float value,
+            const float * policy);
+
+    void insert(const Go & g, float value, const float * policy) {
+        insert(g, key(g), value, policy);
+    }
+
+    Stats get_stats() const;
+
+    void reset_stats();
+
+    /*
+     * empties the cache
+     */
+    void clear();
+};
+
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+
+#include <go.h>
+
+
+/*
+ * encodes Go positions as the input planes of a network, written straight
+ * into a caller's buffer of floats or int8s, channels last (the planes of a
+ * tile are consecutive, and tiles are in row-major order) as Network takes
+ * them. The planes are, in order:
+ *
+ *   black stones
+ *   white stones
+ *   side to move (all ones if black is to move)
+ *   the ko point, which may not be played next
+ *   stones whose string has 1, 2, and 3 or more liberties (three planes)
+ *   the last history moves, most recent first (one plane each)
+ *
+ * every entry is 0 or 1
+ */
+class FeatureEncoder {
+public:
+
+    static constexpr uint32_t default_history = 4;
+
+    enum Plane : uint32_t {
+        black_stones = 0,
+        white_stones = 1,
+        side_to_move = 2,
+        ko_point = 3,
+        liberties_1 = 4,
+        liberties_2 = 5,
+        liberties_3_plus = 6,
+        // followed by one plane for each of the last moves
+        last_moves = 7,
+    };
+
+private:
+
+    coord_t w, h;
+    uint32_t history;
+
+public:
+
+    /*
+     * an encoder for w x h boards which marks the last history moves
+     */
+    FeatureEncoder(coord_t w, coord_t h, uint32_t history=default_history);
+
+    uint32_t n_planes() const {
+        return last_moves + history;
+    }
+
+    /*
+     * the number of entries encode writes for one position
+     */
+    uint32_t position_size() const {
+        return w * h * n_planes();
+    }
+
+    /*
+     * writes the planes of g to position_size() entries of out, where T is
+     * float or int8_t
+     */
+    template<class T>
+    void encode(const Go & g, T * out) const;
+
+    /*
+     * encodes n games one after another into out, as a batch for
+     * Network::forward
+     */
+    template<class T>
+    void encode_batch(const Go * const * games, uint32_t n, T * out) const {
+        for (uint32_t i = 0; i < n; i++) {
+            encode(*games[i], out + (size_t) i * position_size());
+        }
+    }
+};
+
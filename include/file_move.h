@@ -1,10 +1,10 @@
 #pragma once
 
-#include <fstream>
-#include <regex>
 #include <string>
+#include <vector>
 
 #include <move_gen.h>
+#include <sgf.h>
 
 
 class FileMove : public MoveGen {
@@ -17,6 +17,10 @@ private:
 
 public:
 
+    /*
+     * replays the first game of the SGF file file_name, which must be for
+     * the board size of game and must not place setup stones
+     */
     FileMove(const std::string & file_name, Game & game);
 
     virtual ~FileMove() = default;
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <game.h>
+
+
+/*
+ * a finished game of self-play: each move played, the number of visits the
+ * search gave each move it considered before playing it, and the score at
+ * the end
+ */
+struct GameRecord {
+    // the tile index of passing
+    static constexpr uint16_t pass = 0xffffu;
+
+    coord_t w, h;
+    // Go::get_score of the final position, in black's favor
+    int32_t score;
+
+    // the moves played as row-major tile indices (y * w + x), or pass
+    std::vector<uint16_t> moves;
+
+    // the visits of the search before move i are entries visit_start[i] to
+    // visit_start[i + 1] of visit_moves and visit_counts, which hold the
+    // moves as in moves and their visits. Moves which weren't visited are
+    // left out
+    std::vector<uint32_t> visit_start;
+    std::vector<uint16_t> visit_moves;
+    std::vector<uint32_t> visit_counts;
+
+    void clear(coord_t w, coord_t h) {
+        this->w = w;
+        this->h = h;
+        score = 0;
+        moves.clear();
+        visit_start.assign(1, 0);
+        visit_moves.clear();
+        visit_counts.clear();
+    }
+
+    /*
+     * appends a move, with the n moves the search visited before it
+     */
+    void add_move(uint16_t move, const uint16_t * visited,
+            const uint32_t * counts, uint32_t n) {
+        moves.push_back(move);
+        visit_moves.insert(visit_moves.end(), visited, visited + n);
+        visit_counts.insert(visit_counts.end(), counts, counts + n);
+        visit_start.push_back(visit_moves.size());
+    }
+};
+
+
+/*
+ * streams GameRecords to a file, which holds a header and then each record
+ * in turn:
+ *
+ *   uint8 w, uint8 h, uint16 n_moves, int32 score, uint32 n_visits,
+ *   n_moves x uint16 move,
+ *   n_moves x uint16 number of visit entries of the move,
+ *   n_visits x uint16 visited move,
+ *   n_visits x uint32 visit count
+ *
+ * in the byte order of the machine. Records may be written from many threads
+ * at once, and each is written whole
+ */
+class GameRecordWriter {
+public:
+
+    static constexpr uint32_t file_magic = 0x50534f47; // "GOSP"
+    static constexpr uint32_t file_version = 1;
+
+private:
+
+    std::string path;
+
+    std::mutex lock;
+    std::ofstream f;
+
+    // the record being written, only touched under lock
+    std::vector<char> buf;
+
+public:
+
+    GameRecordWriter(const std::string & path);
+
+    void write(const GameRecord & r);
+
+    /*
+     * writes out every record written so far
+     */
+    void flush();
+};
+
+
+class GameRecordReader {
+private:
+
+    std::string path;
+    std::ifstream f;
+
+public:
+
+    GameRecordReader(const std::string & path);
+
+    /*
+     * reads the next record into r, returning false at the end of the file
+     */
+    bool next(GameRecord & r);
+};
+
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstdlib>
+#include <stdexcept>
+
 #include <go.h>
 #include <zobrist.h>
 
@@ -14,7 +17,23 @@ public:
 
 private:
 
-    void gen_data(Go & g);
+    template<class G>
+    void gen_data(const G & g) {
+        size_t n_els = ((w * h) + els_per_bitv - 1) / els_per_bitv;
+        data = (state_bitv_t *) malloc(n_els * sizeof(state_bitv_t));
+
+        if (!data) {
+            throw std::runtime_error("Unable to allocate memory for GameState");
+        }
+
+        for (coord_t r = 0; r < h; r++) {
+            for (coord_t c = 0; c < w; c++) {
+                Color tile = g.tile_at(c, r);
+                uint8_t color = tile == Color::ko ? ko : (uint8_t) tile;
+                set_idx(c, r, color);
+            }
+        }
+    }
 
 public:
 
@@ -32,7 +51,16 @@ public:
     state_bitv_t * data;
     ZobristHash zh;
 
-    GameState(Go & g);
+    /*
+     * G is any game with Go's tile_at, get_player and has_passed (i.e. Go or
+     * BitGo)
+     */
+    template<class G>
+    GameState(const G & g) : w(g.width()), h(g.height()),
+            turn_idx((g.get_player() == white) + (g.has_passed() << 1)),
+            zh(w, h) {
+        gen_data(g);
+    }
 
     ~GameState();
 
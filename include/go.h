@@ -1,15 +1,23 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include <util/util.h>
 
+#include <bitboard.h>
 #include <game.h>
+#include <position_set.h>
+#include <xorshift.h>
 
 
 typedef uint16_t go_turn_t;
 typedef uint8_t player_t;
 
+typedef uint64_t zob_hash_t;
+
+class ZobristHash;
+
 
 enum Color {
     empty = 0,
@@ -55,7 +63,7 @@ public:
 
 
 
-class Go : public Game {
+class Go final : public Game {
 public:
 
     static constexpr uint32_t tile_width = util::fls_unsafe(num_states - 1);
@@ -66,22 +74,32 @@ public:
 
     static constexpr char COL_INDICATORS[] = "ABCDEFGHJKLMNOPQRSTUVWXYZ";
 
+    // the largest width/height of a board that can be printed
+    static constexpr coord_t max_size = sizeof(COL_INDICATORS) - 1;
+    // the most moves (other than passing) that can be legal on any board
+    static constexpr uint32_t max_legal_moves = max_size * max_size;
+
     // the width of a single tile when the board is printed as unicode text
     static constexpr uint32_t max_piece_print_width = 3;
 
     static constexpr char default_p1_name[] = "black";
     static constexpr char default_p2_name[] = "white";
 
-private:
-
+    // the tile index of no tile, which stands for passing in play_idx
     static constexpr board_idx_t no_position = 0xffffu;
 
+private:
+
     // when last_move is this, that means the last move was a pass
     static constexpr board_idx_t one_pass = 0xffffu;
     // when last_move is this, that means the last two moves were
     // passes, and thus the game is over
     static constexpr board_idx_t two_passes = 0xfffeu;
 
+    // playouts which last this many moves per tile are stopped and scored as
+    // they stand, since without superko they may never end
+    static constexpr uint32_t playout_moves_per_tile = 3;
+
     coord_t w, h;
 
     uint16_t turn;
@@ -117,11 +135,59 @@ private:
      */
     struct TileString * strings;
 
+    /*
+     * undo journal: before a move modifies any tiles or strings, copies of
+     * them are pushed onto tile_journal and string_journal, and the scalar
+     * state of the game is saved in an UndoFrame along with where that move's
+     * records begin in each journal
+     */
+    std::vector<struct UndoFrame> frames;
+    std::vector<struct TileRecord> tile_journal;
+    std::vector<struct StringRecord> string_journal;
 
-protected:
+    // moves which have been undone and can be replayed with redo, with the
+    // most recently undone move last (no_position for passes)
+    std::vector<board_idx_t> redo_moves;
 
-    board_idx_t to_idx(coord_t x, coord_t y) const;
+    /*
+     * when set, the hash function whose raw hash (see
+     * ZobristHash::compute_raw_hash) is kept up to date in zob_raw as moves
+     * are made, along with its tables indexed by tile index and turn
+     */
+    const ZobristHash * zh;
+    const zob_hash_t * zob_tiles;
+    const zob_hash_t * zob_turns;
+    zob_hash_t zob_raw;
 
+    /*
+     * a Zobrist hash of the stones on the board alone, kept up to date
+     * alongside zob_raw. It doesn't use ZobristHash's tables, whose built-in
+     * symmetries make distinct positions collide too often to forbid moves by
+     */
+    zob_hash_t position_key;
+
+    /*
+     * when superko is set, positions holds the position_key of every board
+     * position on the current line of play (from the start of the game),
+     * inserted as stones are played and erased as they are undone, so a
+     * repeated position can be found without rehashing the board
+     */
+    bool superko;
+    PositionSet positions;
+
+    /*
+     * when the board (including its border) fits in a bitboard_t, the sets of
+     * black and white stones (at stones[color - 1]) are kept up to date as
+     * moves are made, which lets get_score count territory with a handful of
+     * word operations instead of visiting each tile. board_mask is the set of
+     * tiles on the board, excluding the border
+     */
+    bool use_bitboards;
+    bitboard_t stones[2];
+    bitboard_t board_mask;
+
+
+protected:
 
     board_idx_t idx_up(board_idx_t idx) const;
     board_idx_t idx_down(board_idx_t idx) const;
@@ -157,6 +223,14 @@ private:
      */
     bool is_stone(board_idx_t idx) const;
 
+    /*
+     * returns true if every tile next to idx is either a stone of the given
+     * color or the border, and the opponent doesn't hold enough of its
+     * diagonals to make it a false eye, so playing there would fill in one
+     * of color's eyes
+     */
+    bool is_eye(board_idx_t idx, Color color) const;
+
     /*
      * mark a free tile as "seen", must later be undone to return the board
      * to the correct state
@@ -319,6 +393,102 @@ private:
     void _do_play(board_idx_t idx, Color color);
 
 
+    /*
+     * reserves space in the undo journal, so that searches which make and
+     * unmake moves do not have to grow it
+     */
+    void reserve_journal();
+
+    /*
+     * pushes a copy of the tile at idx to the undo journal
+     */
+    void journal_tile(board_idx_t idx);
+
+    /*
+     * pushes a copy of the string to the undo journal
+     */
+    void journal_string(uint32_t string_idx);
+
+    /*
+     * pushes a copy of every tile in the string to the undo journal
+     */
+    void journal_string_tiles(uint32_t string_idx);
+
+    /*
+     * pushes copies of every tile in the string, which is about to be captured
+     * by "color", and every string of color "color" which will gain a liberty
+     * from the capture
+     */
+    void journal_capture(uint32_t string_idx, Color color);
+
+    /*
+     * pushes copies of every tile and string _do_play(idx, color) will
+     * modify to the undo journal
+     */
+    void journal_play(board_idx_t idx, Color color);
+
+    /*
+     * plays the move at idx (or a pass if idx is no_position), saving an
+     * UndoFrame for it, and assuming the move is legal
+     */
+    void push_move(board_idx_t idx, Color color);
+
+    /*
+     * undoes the last move, returning its tile index (or no_position for a
+     * pass), without recording it to be redone
+     */
+    board_idx_t pop_move();
+
+
+    /*
+     * updates the incremental hash for the tile at idx changing state from
+     * "from" to "to" (where ko is a state, as in ZobristHash)
+     */
+    void zob_tile(board_idx_t idx, uint8_t from, uint8_t to);
+
+    /*
+     * returns the index of the current turn in ZobristHash's turn hashes
+     */
+    uint8_t zob_turn_idx() const;
+
+    /*
+     * returns true if the current player playing at idx would recreate an
+     * earlier position, by playing the move and taking it back
+     */
+    bool repeats_position(board_idx_t idx);
+
+    /*
+     * fills positions with every position on the current line of play, by
+     * undoing every move and replaying them
+     */
+    void rebuild_positions();
+
+
+    /*
+     * sets use_bitboards and board_mask and builds stones from the tiles, to
+     * be called on initialization
+     */
+    void init_bitboards();
+
+    /*
+     * adds/removes a stone of the given color at idx to/from the stone
+     * bitboards
+     */
+    void bb_toggle(board_idx_t idx, Color color);
+
+    /*
+     * area score (as in get_score) computed by flood filling the empty tiles
+     * reachable from each color's stones, only valid when use_bitboards is set
+     */
+    int bitboard_score() const;
+
+    /*
+     * area score (as in get_score) computed by finding each connected region
+     * of empty tiles with union find, which works on any board size
+     */
+    int uf_score() const;
+
+
     /*
      * returns true if the tile at (x, y) is a star tile (only applicable to
      * the standard board sizes, 9x9, 13x13, and 19x19)
@@ -374,6 +544,44 @@ public:
      */
     Color tile_at(coord_t x, coord_t y) const;
 
+    /*
+     * returns the number of liberties of the string with a stone at the
+     * given coordinates, or 0 if there is no stone there
+     */
+    uint32_t liberties_at(coord_t x, coord_t y) const;
+
+    /*
+     * returns the tile index of the move made n moves ago (0 for the last
+     * move), or no_position if that move was a pass or is not in the undo
+     * history (which playout forgets)
+     */
+    board_idx_t recent_move(uint32_t n) const;
+
+    /*
+     * converts between coordinates and the tile indices legal_moves gives
+     */
+    board_idx_t to_idx(coord_t x, coord_t y) const;
+
+    coord_t idx_x(board_idx_t idx) const {
+        return (idx % (this->w + 2)) - 1;
+    }
+
+    coord_t idx_y(board_idx_t idx) const {
+        return (idx / (this->w + 2)) - 1;
+    }
+
+    /*
+     * returns true if a stone of the given color played on the empty tile at
+     * idx would capture some of the other player's stones
+     */
+    bool is_capture(board_idx_t idx, Color color) const;
+
+    /*
+     * returns true if the empty tile at idx is the only liberty of one of
+     * color's strings, so playing there may save it
+     */
+    bool is_atari_escape(board_idx_t idx, Color color) const;
+
 
     virtual Game & strip() const {
         return const_cast<Go &>(*this);
@@ -397,6 +605,51 @@ public:
      */
     bool has_passed() const;
 
+    /*
+     * has this game maintain the raw hash of its state under the given hash
+     * function as moves are made and undone, or stop maintaining a hash if
+     * zh is nullptr. zh must outlive this game (and any copies of it)
+     */
+    void set_zobrist(const ZobristHash * zh);
+
+    const ZobristHash * get_zobrist() const {
+        return zh;
+    }
+
+    /*
+     * the raw hash of the game under the hash function given to set_zobrist
+     */
+    zob_hash_t get_raw_hash() const {
+        return zob_raw;
+    }
+
+    /*
+     * turns on positional superko, under which no move may recreate an
+     * arrangement of stones seen earlier in the game, or turns it off, which
+     * leaves only simple ko. It is off by default
+     */
+    void set_superko(bool on);
+
+    bool get_superko() const {
+        return superko;
+    }
+
+    /*
+     * returns true if superko is on and the last move recreated an earlier
+     * position. legal_moves only excludes simple ko, so searches play each
+     * move with play_idx and undo it again if this returns true
+     */
+    bool superko_violation() const {
+        return superko && positions.count(position_key) > 1;
+    }
+
+    /*
+     * returns the number of stones the given player has captured
+     */
+    uint32_t get_captures(Color color) const {
+        return color == Color::black ? black_captures : white_captures;
+    }
+
     virtual bool is_current() const;
 
     virtual void play(GameMove & m);
@@ -407,9 +660,68 @@ public:
 
     virtual void for_each_legal_move(std::function<bool(Game &, GameMove &)> f);
 
+    /*
+     * plays the current player's move at tile index idx, or passes if idx is
+     * no_position, for searches which know they are playing Go. Unlike play,
+     * the move is assumed to be legal (e.g. from legal_moves)
+     */
+    void play_idx(board_idx_t idx) {
+        push_move(idx, idx == no_position ? Color::pass : get_player());
+    }
+
+    /*
+     * undoes a move made by play_idx, which can't be redone
+     */
+    void undo_idx() {
+        pop_move();
+    }
+
+    /*
+     * the set of tiles the current player may play on, only valid on boards
+     * small enough to keep bitboards (see use_bitboards)
+     */
+    bitboard_t legal_move_mask() const;
+
+    /*
+     * writes the tile index of every move the current player may make other
+     * than passing to moves (which must have room for width() * height()
+     * moves), in row-major order, and returns the number written. A pass is
+     * legal as well unless the game is over, in which case there are no
+     * legal moves
+     */
+    uint32_t legal_moves(board_idx_t * moves) const;
+
+    /*
+     * plays random moves to the end of the game, choosing uniformly among
+     * the current player's legal moves which don't fill in one of its own
+     * eyes, and passing when there are none, then returns
+     * tromp_taylor_score(). The moves aren't journaled, so the game forgets
+     * its history and can't be undone afterwards, and it stops keeping its
+     * hash and superko positions. Playouts are meant to be run on a scratch
+     * copy of a game, which operator= refills without reallocating
+     */
+    int playout(Xorshift & rng);
+
+    /*
+     * makes this game a copy of g's position alone, leaving out its history,
+     * hash and superko positions, which playout would drop anyway. Copying
+     * them is most of the cost of operator=, so a scratch game for playouts
+     * should be refilled with this instead
+     */
+    void refill(const Go & g);
+
+    /*
+     * black's area minus white's, counting each player's stones and the
+     * empty tiles next to only that player's stones. Captures and larger
+     * empty regions are not counted, so this is only a Tromp-Taylor score
+     * once every empty region is a single tile, as at the end of a playout
+     */
+    int tromp_taylor_score() const;
+
     template<typename Fn, typename... Args>
     inline void for_each_legal_move_inline(const Fn &fn, Args &...args) {
         GoMove m;
+        board_idx_t moves[max_legal_moves];
 
         if (game_over()) {
             // cannot play once the game has ended
@@ -418,19 +730,15 @@ public:
 
         m.color = max_player() ? Color::black : Color::white;
 
-        coord_t w = this->w;
-        coord_t h = this->h;
-        for (coord_t y = 0; y < h; y++) {
-            for (coord_t x = 0; x < w; x++) {
-                board_idx_t idx = to_idx(x, y);
-                if (is_liberty(idx) && !move_is_suicide(idx, m.color) &&
-                        idx != this->ko_move) {
-                    m.x = x;
-                    m.y = y;
-                    if (!fn(*this, m, std::forward<Args>(args)...)) {
-                        return;
-                    }
-                }
+        uint32_t n_moves = legal_moves(moves);
+        for (uint32_t i = 0; i < n_moves; i++) {
+            if (superko && repeats_position(moves[i])) {
+                continue;
+            }
+            m.x = idx_x(moves[i]);
+            m.y = idx_y(moves[i]);
+            if (!fn(*this, m, std::forward<Args>(args)...)) {
+                return;
             }
         }
 
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <bit_go.h>
+#include <game.h>
+#include <go.h>
+#include <move_gen.h>
+#include <xorshift.h>
+
+
+/*
+ * evaluates the leaves of a Monte Carlo tree search in place of random
+ * playouts, e.g. with a value network. With more than one search thread,
+ * evaluate is called from every thread at once
+ */
+class MctsEvaluator {
+public:
+
+    virtual ~MctsEvaluator() = default;
+
+    /*
+     * returns the value of g to black, from -1 (a certain loss) to 1 (a
+     * certain win). moves holds the n_moves moves which may be played from g
+     * as tile indices (the game's no_position for passing), and the
+     * evaluator may write the prior probability of playing each to the
+     * matching entry of priors, which are uniform otherwise
+     */
+    virtual float evaluate(const Game & g, const board_idx_t * moves,
+            uint32_t n_moves, float * priors) = 0;
+
+    /*
+     * a hash function for the Go games evaluated to maintain with
+     * Go::set_zobrist as they are played, if the evaluator hashes them, or
+     * null
+     */
+    virtual const ZobristHash * get_zobrist() const {
+        return nullptr;
+    }
+};
+
+
+class MctsMove : public MoveGen {
+public:
+
+    static constexpr uint32_t default_playouts = 10000;
+
+    // the constant multiplying the exploration term of PUCT
+    static constexpr float default_exploration = 1.5f;
+
+    // default number of nodes in the arena (log base 2)
+    static constexpr uint32_t default_arena_log_size = 22;
+
+private:
+
+    // the index of no node, which is the first child of unexpanded nodes
+    static constexpr uint32_t no_node = 0xffffffffu;
+    // the first child of a node while some thread is expanding it
+    static constexpr uint32_t expanding = 0xfffffffeu;
+    // marks a node as part of the subtree being kept in reuse_marks
+    static constexpr uint32_t kept = 0xfffffffdu;
+
+    // a tree is reused if the game has moved on by at most this many moves
+    // since it was searched (our move and the opponent's reply)
+    static constexpr uint16_t max_reuse_depth = 2;
+
+    // random playouts which last this many moves per tile are stopped and
+    // scored as they stand, since without superko they may never end
+    static constexpr uint32_t playout_moves_per_tile = 3;
+
+    /*
+     * a node of the search tree. Every node lives in the arena, and the
+     * children of a node are contiguous, so a node only needs the index of
+     * its first child and the number of children
+     *
+     * threads share the tree without locks: a thread descending through a
+     * node counts a visit and a loss (a virtual loss) at once, which steers
+     * the other threads to other branches until the playout's real value
+     * replaces the loss, and a node is expanded by the one thread which
+     * moves first_child from no_node to expanding
+     */
+    struct Node {
+        // index of the first child in the arena, no_node if unexpanded, or
+        // expanding. n_children is written before first_child is published
+        std::atomic<uint32_t> first_child;
+        // the number of children, 0 for unexpanded nodes and the end of the
+        // game
+        uint16_t n_children;
+        // the tile index of the move leading to this node (no_position for
+        // passes)
+        board_idx_t move;
+
+        // the prior probability of the move leading here
+        float prior;
+
+        std::atomic<uint32_t> visits;
+        // the sum of the values of every playout through this node, to the
+        // player who made the move leading here
+        std::atomic<float> value_sum;
+
+        void init(board_idx_t move, float prior) {
+            this->n_children = 0;
+            this->move = move;
+            this->prior = prior;
+            visits.store(0, std::memory_order_relaxed);
+            value_sum.store(0.f, std::memory_order_relaxed);
+            first_child.store(no_node, std::memory_order_relaxed);
+        }
+
+        float q() const {
+            uint32_t n = visits.load(std::memory_order_relaxed);
+            return n == 0 ? 0.f :
+                value_sum.load(std::memory_order_relaxed) / n;
+        }
+    };
+
+    /*
+     * the state of one search thread, each of which searches its own copy of
+     * the game
+     */
+    struct SearchThread {
+        Xorshift rng;
+
+        // the game Go playouts are run on, which is refilled from the
+        // thread's game for each playout
+        std::unique_ptr<Go> playout_game;
+
+        // the nodes on the path from the root to the leaf of the current
+        // playout
+        std::vector<uint32_t> path;
+
+        SearchThread(uint64_t seed) : rng(seed), playout_game(nullptr) {}
+    };
+
+    Game & game;
+
+    uint32_t playouts;
+    float exploration;
+
+    // leaves are evaluated with random playouts when null
+    MctsEvaluator * evaluator;
+
+    // every node of the tree, with the root first. The arena is allocated
+    // once, and nodes are handed out from the front of it, so a search makes
+    // no allocations. Once it is full, leaves are evaluated without being
+    // expanded
+    std::vector<Node> arena;
+    std::atomic<uint32_t> n_nodes;
+
+    // playouts started by all threads in the current search
+    std::atomic<uint32_t> playouts_started;
+
+    std::vector<SearchThread> threads;
+
+    // when set, the subtree under the position reached since the last search
+    // is kept for the next one
+    bool reuse;
+    // a copy of the position at the root of the tree, or null if there is no
+    // tree to reuse
+    std::shared_ptr<Game> tree_game;
+    // for each node, while moving a kept subtree to the front of the arena,
+    // no_node if the node isn't kept, kept if it is, or the new index of its
+    // parent if it is the first of its parent's children. Allocated the first
+    // time a tree is reused
+    std::vector<uint32_t> reuse_marks;
+
+    // the number of playouts made by the last search, and the number of
+    // playouts in the subtree it started from
+    uint64_t playout_count;
+    uint64_t reused_count;
+
+    // when set, each search prints the board and its statistics
+    bool verbose;
+
+
+    // BitGo boards are only searched as BitGo (rather than through the Game
+    // interface) up to this size
+    static constexpr coord_t max_bit_go_size = 11;
+
+
+    /*
+     * the child of node n maximizing
+     *   Q + exploration * P * sqrt(N) / (1 + n)
+     * where N is the number of visits to n, and first is n's first child
+     */
+    uint32_t select_child(const Node & n, uint32_t first) const;
+
+    /*
+     * adds n_moves nodes to the arena for the given moves, returning the
+     * index of the first, or no_node if the arena is full
+     */
+    uint32_t alloc_children(const board_idx_t * moves, const float * priors,
+            uint32_t n_moves);
+
+    /*
+     * returns the value of g to black, adding the children of node n for
+     * every legal move from g if expand is set (and the arena has room)
+     */
+    template<class G>
+    float evaluate(G & g, SearchThread & t, uint32_t n, bool expand);
+
+    /*
+     * plays random moves from g to the end of the game (or until
+     * playout_moves_per_tile moves per tile are made), never filling in a
+     * player's own eyes, and returns the result to black. g is left as it
+     * was found
+     */
+    template<class G>
+    float random_playout(G & g, SearchThread & t);
+
+    /*
+     * Go's random playouts are run by Go::playout on a copy of g, refilled
+     * with Go::refill
+     */
+    float random_playout(Go & g, SearchThread & t);
+
+    /*
+     * descends the tree from the root to a leaf by PUCT, expands and
+     * evaluates the leaf, and adds its value to every node on the way
+     */
+    template<class G>
+    void playout(G & g, SearchThread & t);
+
+    /*
+     * returns the node of the tree from the last search whose position is g,
+     * looking at most max_reuse_depth moves below the root, or no_node if
+     * there is none
+     */
+    template<class G>
+    uint32_t find_reused_root(const G & g) const;
+
+    /*
+     * moves the subtree under node root to the front of the arena, with root
+     * first, reclaiming the rest of the arena. Every node lives after its
+     * parent, so the subtree is moved in one pass over the arena in order
+     */
+    void keep_subtree(uint32_t root);
+
+    /*
+     * searches for the best move from an undecorated game g
+     */
+    template<class G>
+    void search(const G & g, GameMove & move);
+
+    /*
+     * searches g if it is a square BitGo of size N or larger, returning false
+     * if it isn't
+     */
+    template<coord_t N>
+    bool search_bit_go(Game & g, GameMove & move);
+
+public:
+
+    MctsMove(Game & game, uint32_t playouts=default_playouts,
+            float exploration=default_exploration,
+            uint32_t arena_log_size=default_arena_log_size,
+            uint32_t n_threads=1);
+
+    virtual ~MctsMove() = default;
+
+    virtual MoveStatus next_move(GameMove &);
+
+    void set_playouts(uint32_t n) {
+        playouts = n;
+    }
+
+    void set_exploration(float c) {
+        exploration = c;
+    }
+
+    /*
+     * evaluates leaves with e rather than random playouts, or with random
+     * playouts again if e is null. e must outlive this MctsMove. The tree
+     * built with the old evaluator is not reused
+     */
+    void set_evaluator(MctsEvaluator * e) {
+        evaluator = e;
+        tree_game = nullptr;
+    }
+
+    /*
+     * sets the number of threads to search the tree with
+     */
+    void set_threads(uint32_t n_threads);
+
+    /*
+     * turns reusing the subtree under the current position from the last
+     * search on or off (it is on by default)
+     */
+    void set_reuse(bool on) {
+        reuse = on;
+        if (!on) {
+            tree_game = nullptr;
+        }
+    }
+
+    /*
+     * turns printing the board and the statistics of each search on or off
+     * (it is on by default)
+     */
+    void set_verbose(bool on) {
+        verbose = on;
+    }
+
+    /*
+     * reseeds the random playouts, giving each thread its own seed
+     */
+    void seed(uint64_t s);
+
+    /*
+     * the number of playouts made by the last call to next_move, not
+     * counting those reused from the search before
+     */
+    uint64_t get_playout_count() const {
+        return playout_count;
+    }
+
+    /*
+     * the number of playouts the last call to next_move reused from the
+     * search before
+     */
+    uint64_t get_reused_count() const {
+        return reused_count;
+    }
+
+    /*
+     * the number of nodes in the tree built by the last call to next_move
+     */
+    uint32_t get_node_count() const {
+        return n_nodes.load(std::memory_order_relaxed);
+    }
+
+    /*
+     * writes each move from the position searched by the last call to
+     * next_move (as tile indices of the game, with its no_position for
+     * passing) to moves, and the number of visits to it to visits, returning
+     * the number of moves. Both must have room for every legal move and a
+     * pass
+     */
+    uint32_t get_root_visits(board_idx_t * moves, uint32_t * visits) const;
+
+    /*
+     * black's area minus white's by Tromp-Taylor rules: each player's stones
+     * and the empty regions bordered only by that player's stones, without
+     * captures. Finished games and playouts are scored by this, so the
+     * search values positions the same in every game G (Go or BitGo). At the
+     * end of a playout every empty region is a single tile, where this is
+     * Go::tromp_taylor_score
+     */
+    template<class G>
+    static int area_score(const G & g) {
+        coord_t w = g.width();
+        coord_t h = g.height();
+        bool seen[Go::max_legal_moves] = {};
+        uint16_t region[Go::max_legal_moves];
+
+        int score = 0;
+        for (uint32_t t = 0; t < (uint32_t) w * h; t++) {
+            Color c = g.tile_at(t % w, t / w);
+            if (c == Color::black || c == Color::white) {
+                score += c == Color::black ? 1 : -1;
+                continue;
+            }
+            if (seen[t]) {
+                continue;
+            }
+
+            // flood the empty region, noting the colors around it
+            uint32_t n = 0;
+            uint8_t adj = 0;
+            region[n++] = t;
+            seen[t] = true;
+            for (uint32_t i = 0; i < n; i++) {
+                coord_t x = region[i] % w;
+                coord_t y = region[i] / w;
+                uint32_t nbrs[4];
+                uint32_t n_nbrs = 0;
+                if (x > 0) {
+                    nbrs[n_nbrs++] = region[i] - 1;
+                }
+                if (x < w - 1) {
+                    nbrs[n_nbrs++] = region[i] + 1;
+                }
+                if (y > 0) {
+                    nbrs[n_nbrs++] = region[i] - w;
+                }
+                if (y < h - 1) {
+                    nbrs[n_nbrs++] = region[i] + w;
+                }
+                for (uint32_t j = 0; j < n_nbrs; j++) {
+                    Color nc = g.tile_at(nbrs[j] % w, nbrs[j] / w);
+                    if (nc == Color::black || nc == Color::white) {
+                        adj |= nc;
+                    }
+                    else if (!seen[nbrs[j]]) {
+                        seen[nbrs[j]] = true;
+                        region[n++] = nbrs[j];
+                    }
+                }
+            }
+            score += adj == Color::black ? (int) n :
+                adj == Color::white ? -(int) n : 0;
+        }
+        return score;
+    }
+};
+
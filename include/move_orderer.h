@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <go.h>
+
+
+/*
+ * orders the moves searched by AlphaBetaMove so the ones most likely to cause
+ * a cutoff come first:
+ *
+ *  1. the best move stored in the transposition table
+ *  2. captures, then moves which save a string in atari
+ *  3. the killer moves of this ply (the last moves to cause a cutoff at the
+ *     same depth in another branch)
+ *  4. everything else, by the history heuristic (how much each tile has
+ *     caused cutoffs anywhere in the tree), with passing last
+ *
+ * moves are tile indices of the game being searched (see Go::legal_moves),
+ * with pass_move for passing
+ */
+class MoveOrderer {
+public:
+
+    // the same as the games' no_position, so moves can be played with
+    // play_idx as they are
+    static constexpr board_idx_t pass_move = Go::no_position;
+    static constexpr board_idx_t no_move = 0xfffeu;
+
+    static constexpr uint32_t killers_per_ply = 2;
+    // killer moves are only kept for this many plies from the root
+    static constexpr uint32_t max_ply = 128;
+
+    // the most moves order will ever be asked to sort, including passing
+    static constexpr uint32_t max_moves = Go::max_legal_moves + 1;
+
+private:
+
+    // priorities of each category of move, in the top 16 bits of a sort key
+    // whose bottom 16 bits are the move
+    static constexpr uint32_t tt_priority      = 0xffff;
+    static constexpr uint32_t capture_priority = 0xfffe;
+    static constexpr uint32_t escape_priority  = 0xfffd;
+    static constexpr uint32_t killer_priority  = 0xfffb;
+    // history scores saturate below the killers
+    static constexpr uint32_t max_history      = 0xfff0;
+
+    board_idx_t killers[max_ply][killers_per_ply];
+
+    // indexed by tile index
+    std::vector<uint32_t> history;
+
+    /*
+     * halves every history score, so moves which caused cutoffs long ago
+     * stop outranking recent ones
+     */
+    void age_history();
+
+public:
+
+    /*
+     * n_tiles is one more than the largest tile index a move can have
+     */
+    MoveOrderer(uint32_t n_tiles);
+
+    /*
+     * forgets the killers and ages the history, to be called before each new
+     * search
+     */
+    void new_search();
+
+    /*
+     * writes every legal move of g to moves (which must have room for
+     * max_moves), best first, returning the number of moves. tt_move is the
+     * move the transposition table suggests for this position, or no_move.
+     * n_tactical is set to the number of moves at the front of moves which
+     * are the tt move, captures, atari escapes or killers, the rest being
+     * quiet moves ordered only by history
+     */
+    template<class G>
+    uint32_t order(const G & g, board_idx_t tt_move, uint32_t ply,
+            board_idx_t * moves, uint32_t & n_tactical) const {
+        uint32_t keys[max_moves];
+        Color color = g.get_player();
+        n_tactical = 0;
+
+        uint32_t n_moves = g.legal_moves(moves);
+        moves[n_moves++] = pass_move;
+
+        const board_idx_t * k = ply < max_ply ? killers[ply] : nullptr;
+        for (uint32_t i = 0; i < n_moves; i++) {
+            board_idx_t m = moves[i];
+            uint32_t priority;
+            if (m == tt_move) {
+                priority = tt_priority;
+            }
+            else if (m == pass_move) {
+                priority = 0;
+            }
+            else if (g.is_capture(m, color)) {
+                priority = capture_priority;
+            }
+            else if (g.is_atari_escape(m, color)) {
+                priority = escape_priority;
+            }
+            else if (k != nullptr && m == k[0]) {
+                priority = killer_priority + 1;
+            }
+            else if (k != nullptr && m == k[1]) {
+                priority = killer_priority;
+            }
+            else {
+                // + 1 so no move ties with passing
+                priority = history[m] + 1;
+            }
+            n_tactical += priority >= killer_priority;
+            keys[i] = (priority << 16) | m;
+        }
+
+        // insertion sort, since there are few moves and they are mostly in
+        // order already once most of them have the same priority
+        for (uint32_t i = 1; i < n_moves; i++) {
+            uint32_t key = keys[i];
+            uint32_t j = i;
+            for (; j > 0 && keys[j - 1] < key; j--) {
+                keys[j] = keys[j - 1];
+            }
+            keys[j] = key;
+        }
+
+        for (uint32_t i = 0; i < n_moves; i++) {
+            moves[i] = (board_idx_t) keys[i];
+        }
+        return n_moves;
+    }
+
+    /*
+     * records that move caused a beta cutoff at the given ply in a search of
+     * the given remaining depth
+     */
+    void cutoff(board_idx_t move, uint32_t ply, int depth);
+};
+
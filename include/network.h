@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/*
+ * a convolutional value/policy network run on the CPU, as trained in py/ (a
+ * stack of same-padded convolutions with batch normalization, ReLU and
+ * residual connections, followed by dense heads)
+ *
+ * the network is a list of layers, each of which reads one tensor and writes
+ * another. Tensors are numbered, with tensor 0 the input, and every tensor
+ * holds a batch of height x width x channels floats (channels last, as in
+ * Keras), so a dense layer reads a tensor flattened in the same order as
+ * Keras' Flatten. Networks are built layer by layer, or loaded from the
+ * flat weight file written by save (see py/convert_model.py, which converts
+ * the Keras models in saved_models/)
+ *
+ * the inner loops are vectorized with AVX-512 or AVX2 when the CPU supports
+ * them, falling back to scalar code otherwise
+ */
+class Network {
+public:
+
+    enum LayerType : uint32_t {
+        // same-padded 2d convolution with bias, kernel in Keras' layout
+        // (kernel height, kernel width, input channels, output channels)
+        conv = 0,
+        // per-channel scale and shift, i.e. inference-time batch
+        // normalization
+        scale_shift = 1,
+        relu = 2,
+        // adds src to dst
+        add = 3,
+        // fully connected layer with bias, kernel laid out as (inputs,
+        // outputs)
+        dense = 4,
+        tanh = 5,
+    };
+
+    static constexpr uint32_t file_magic = 0x4e4e4f47;  // "GONN"
+    static constexpr uint32_t file_version = 1;
+
+private:
+
+    struct Shape {
+        uint32_t h, w, c;
+
+        uint32_t size() const {
+            return h * w * c;
+        }
+    };
+
+    struct Layer {
+        LayerType type;
+        // the tensor read and the tensor written, which are the same for
+        // the element-wise layers
+        uint32_t src, dst;
+        // conv: kernel size and output channels, dense: outputs
+        uint32_t k, n_out;
+        // conv/dense: kernel then bias, scale_shift: scales then shifts
+        std::vector<float> weights;
+    };
+
+    std::vector<Shape> shapes;
+    std::vector<Layer> layers;
+    std::vector<uint32_t> outputs;
+
+    // the contents of every tensor for the last batch, grown to fit the
+    // largest batch seen
+    std::vector<std::vector<float>> tensors;
+    uint32_t batch_capacity;
+
+    /*
+     * the tensor written by a new layer, which must either be new (the next
+     * tensor number) or already have the given shape
+     */
+    void set_dst(uint32_t dst, Shape s);
+
+    void run_conv(const Layer & l, uint32_t batch);
+    void run_dense(const Layer & l, uint32_t batch);
+
+public:
+
+    /*
+     * a network taking inputs of the given shape, with no layers
+     */
+    Network(uint32_t h, uint32_t w, uint32_t c);
+
+    /*
+     * loads a network from a flat weight file written by save, throwing
+     * std::runtime_error if it is malformed
+     */
+    explicit Network(const std::string & path);
+
+    void save(const std::string & path) const;
+
+    /*
+     * add a layer reading tensor src and writing tensor dst (a new tensor or
+     * one of the same shape). weights are as described in LayerType
+     */
+    void add_conv(uint32_t src, uint32_t dst, uint32_t k, uint32_t n_out,
+            const std::vector<float> & kernel,
+            const std::vector<float> & bias);
+    void add_scale_shift(uint32_t t, const std::vector<float> & scale,
+            const std::vector<float> & shift);
+    void add_relu(uint32_t t);
+    void add_add(uint32_t src, uint32_t dst);
+    void add_dense(uint32_t src, uint32_t dst, uint32_t n_out,
+            const std::vector<float> & kernel,
+            const std::vector<float> & bias);
+    void add_tanh(uint32_t t);
+
+    /*
+     * marks tensor t as the next output of the network
+     */
+    void add_output(uint32_t t);
+
+    uint32_t input_size() const {
+        return shapes[0].size();
+    }
+
+    uint32_t n_outputs() const {
+        return outputs.size();
+    }
+
+    uint32_t output_size(uint32_t i) const {
+        return shapes[outputs[i]].size();
+    }
+
+    /*
+     * runs the network on batch inputs, laid out one after another in input.
+     * Only one forward pass may run on a network at a time
+     */
+    void forward(const float * input, uint32_t batch);
+
+    /*
+     * output i of the last forward pass, with output_size(i) floats for each
+     * input of the batch one after another
+     */
+    const float * output(uint32_t i) const {
+        return tensors[outputs[i]].data();
+    }
+
+    /*
+     * the name of the instruction set the kernels use on this CPU
+     */
+    static const char * simd_name();
+};
+
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+
+/*
+ * a multiset of 64-bit position hashes, open addressed with linear probing,
+ * which Go uses to remember every position on the current line of play for
+ * positional superko. Hashes are inserted as moves are played and erased as
+ * they are undone, and erasing shifts later entries of the probe sequence
+ * back, so the table never fills with tombstones
+ */
+class PositionSet {
+private:
+
+    struct Entry {
+        uint64_t key;
+        // the number of times key is in the set, 0 for an empty entry
+        uint32_t count;
+    };
+
+    // the table is grown once more than 1 / max_load_inv of it is used
+    static constexpr uint32_t max_load_inv = 2;
+
+    static constexpr uint32_t default_log_size = 6;
+
+    // always a power of 2 in size
+    std::vector<Entry> table;
+    // the number of distinct keys in the set
+    uint32_t n_keys;
+
+    uint32_t mask() const {
+        return table.size() - 1;
+    }
+
+    /*
+     * the index of the entry holding key, or of the empty entry where it
+     * would go
+     */
+    uint32_t find(uint64_t key) const {
+        uint32_t i = ((uint32_t) (key >> 32)) & mask();
+        while (table[i].count != 0 && table[i].key != key) {
+            i = (i + 1) & mask();
+        }
+        return i;
+    }
+
+    void grow();
+
+public:
+
+    PositionSet();
+
+    /*
+     * empties the set
+     */
+    void clear();
+
+    void insert(uint64_t key);
+
+    /*
+     * removes one copy of key, which must be in the set
+     */
+    void erase(uint64_t key);
+
+    /*
+     * the number of copies of key in the set
+     */
+    uint32_t count(uint64_t key) const {
+        return table[find(key)].count;
+    }
+};
+
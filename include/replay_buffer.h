@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <game_record.h>
+#include <training_data.h>
+#include <xorshift.h>
+
+
+/*
+ * a fixed-capacity ring of the latest training positions in POSIX shared
+ * memory, which self-play processes append games to and a trainer process
+ * samples minibatches from, without any of them copying positions through
+ * pipes
+ *
+ * positions are stored as the records of TrainingCodec. Appending never
+ * takes a lock: a writer claims the next slots with one atomic add, and
+ * stamps each slot odd while it writes the record and even once the record
+ * is complete, so readers can tell that the record they copied wasn't torn
+ * by a writer (as a seqlock). Once capacity positions have been appended,
+ * each overwrites the oldest
+ *
+ * the one wait in appending is for a slot whose previous position, capacity
+ * positions earlier, is still being written. That only lasts as long as a
+ * record copy unless the writer of that position died mid-record, in which
+ * case the slot stays odd forever and appends to it block for
+ * max_write_wait, then fail
+ */
+class ReplayBuffer {
+public:
+
+    static constexpr uint32_t magic = 0x42524f47; // "GORB"
+    static constexpr uint32_t version = 1;
+
+    // sample gives up if no position could be read for this long
+    static constexpr std::chrono::seconds max_read_wait{ 1 };
+    // add_game gives up if a slot is still being written for this long
+    static constexpr std::chrono::seconds max_write_wait{ 1 };
+
+private:
+
+    struct Header {
+        // set last by the process creating the buffer, once the rest of the
+        // header is written
+        std::atomic<uint32_t> magic;
+        uint32_t version;
+        uint32_t w, h;
+        uint32_t record_size;
+        uint64_t capacity;
+
+        // positions claimed by writers, the newest being head - 1, and games
+        // appended, on their own cache line
+        alignas(64) std::atomic<uint64_t> head;
+        std::atomic<uint64_t> games;
+    };
+
+    std::string name;
+
+    uint8_t * data;
+    size_t mapped_size;
+
+    Header * header;
+    // the stamp of each slot: 2n + 1 while position n is being written to
+    // it, 2n + 2 once it is, and 0 if it never was
+    std::atomic<uint64_t> * stamps;
+    uint8_t * slots;
+
+    TrainingCodec codec;
+
+    static size_t map_size(uint32_t record_size, uint64_t capacity);
+
+    void map(int fd, size_t n_bytes);
+
+    /*
+     * copies position n into slot n % capacity, unless a later position
+     * already took the slot, waiting up to max_write_wait for an earlier
+     * position being written there
+     */
+    void write_slot(uint64_t n, const uint8_t * rec);
+
+public:
+
+    /*
+     * creates a buffer for capacity w x h positions in the shared memory
+     * object name (which must start with '/', and not exist yet)
+     */
+    ReplayBuffer(const std::string & name, coord_t w, coord_t h,
+            uint64_t capacity);
+
+    /*
+     * attaches to the buffer another process created
+     */
+    ReplayBuffer(const std::string & name);
+
+    /*
+     * detaches from the buffer, which lives on until removed
+     */
+    ~ReplayBuffer();
+
+    ReplayBuffer(const ReplayBuffer &) = delete;
+    ReplayBuffer & operator=(const ReplayBuffer &) = delete;
+
+    /*
+     * removes the shared memory object name, which is freed once every
+     * process has detached from it
+     */
+    static void remove(const std::string & name);
+
+    coord_t width() const {
+        return header->w;
+    }
+
+    coord_t height() const {
+        return header->h;
+    }
+
+    uint64_t capacity() const {
+        return header->capacity;
+    }
+
+    /*
+     * the number of positions ever appended, including ones being written
+     */
+    uint64_t n_positions() const {
+        return header->head.load(std::memory_order_acquire);
+    }
+
+    /*
+     * the number of positions held, which is at most the capacity
+     */
+    uint64_t size() const {
+        return std::min(n_positions(), header->capacity);
+    }
+
+    /*
+     * appends every position of a game of self-play, as
+     * TrainingWriter::add_game. Safe to call from any number of threads and
+     * processes at once. Throws if a writer died mid-record in a slot this
+     * game needs, leaving the game's later positions unwritten
+     */
+    void add_game(const GameRecord & r);
+
+    /*
+     * copies the record of position n (counting from the first position ever
+     * appended) to rec, which must have room for TrainingCodec::record_size
+     * bytes, returning false if it has been overwritten or isn't written yet
+     */
+    bool read(uint64_t n, uint8_t * rec) const;
+
+    /*
+     * fills b with n positions held by the buffer, each moved by a random
+     * symmetry. If half_life is 0 they are drawn uniformly, otherwise the
+     * chance of drawing a position halves with every half_life positions
+     * appended after it
+     */
+    void sample(uint32_t n, Xorshift & rng, TrainingBatch & b,
+            double half_life=0) const;
+};
+
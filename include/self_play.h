@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <game_record.h>
+#include <go.h>
+#include <mcts_move.h>
+
+
+/*
+ * plays games of Go against itself with MctsMove on a pool of threads,
+ * streaming each finished game to a GameRecordWriter as training data
+ *
+ * every thread plays one game at a time, searching each move on its own
+ * thread, so n_threads games are played at once. With a BatchEvaluator, whose
+ * batches fill from the searches of every thread, the threads spend most of
+ * their time waiting on the network, so there should be at least as many as
+ * the batch size (hundreds are fine)
+ */
+class SelfPlay {
+public:
+
+    static constexpr uint32_t default_playouts = 800;
+
+    // the first moves of each game are drawn in proportion to the visits of
+    // the search rather than being its best move, so games differ
+    static constexpr uint32_t default_sample_moves = 8;
+
+    // games lasting this many moves per tile are stopped and scored as they
+    // stand, since without superko they may never end
+    static constexpr uint32_t max_moves_per_tile = 3;
+
+    struct Stats {
+        uint64_t games;
+        // moves recorded, each a training position
+        uint64_t positions;
+        double seconds;
+        double games_per_hour;
+        double positions_per_second;
+    };
+
+private:
+
+    coord_t w, h;
+    uint32_t playouts;
+    uint32_t n_threads;
+    uint32_t sample_moves;
+    float exploration;
+    uint64_t seed;
+
+    // leaves are evaluated with random playouts when null
+    MctsEvaluator * evaluator;
+
+    // games handed out to threads, and games and moves finished, in the
+    // current call to play
+    std::atomic<uint64_t> games_started;
+    std::atomic<uint64_t> games_done;
+    std::atomic<uint64_t> positions_done;
+    // the times play was called and returned, the second only meaningful
+    // once playing is cleared
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+    std::atomic<bool> playing;
+
+    /*
+     * plays game number i, writing it to out
+     */
+    void play_game(uint64_t i, GameRecord & r, GameRecordWriter & out);
+
+public:
+
+    SelfPlay(coord_t w, coord_t h, uint32_t playouts=default_playouts,
+            uint32_t n_threads=1);
+
+    /*
+     * evaluates leaves with e rather than random playouts, or with random
+     * playouts again if e is null. e must be safe to call from every thread
+     * at once, and outlive this SelfPlay
+     */
+    void set_evaluator(MctsEvaluator * e) {
+        evaluator = e;
+    }
+
+    void set_sample_moves(uint32_t n) {
+        sample_moves = n;
+    }
+
+    void set_exploration(float c) {
+        exploration = c;
+    }
+
+    /*
+     * seeds the searches and the moves drawn. Game i of a call to play is
+     * seeded from s and i, so it is the same whichever thread plays it
+     * (unless the evaluator depends on timing)
+     */
+    void set_seed(uint64_t s) {
+        seed = s;
+    }
+
+    /*
+     * plays n_games games, writing each to out as it finishes, and returns
+     * once all are written. If playing or writing a game throws, no more
+     * games are started, and the first error is rethrown once every thread
+     * has stopped and the games already finished are flushed
+     */
+    void play(uint64_t n_games, GameRecordWriter & out);
+
+    /*
+     * the progress of the current call to play, or the totals of the last
+     * one, which may be read from another thread while playing
+     */
+    Stats get_stats() const;
+};
+
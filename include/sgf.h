@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <go.h>
+
+
+/*
+ * a stone placed by a game of an SGF file, either a move (B/W) or a setup
+ * stone (AB/AW)
+ */
+struct SgfMove {
+    // the coordinate of both x and y of passing
+    static constexpr uint8_t pass = 0xff;
+
+    // Color::black or Color::white
+    uint8_t color;
+    // from the top left corner, as the letters a-z and then A-Z of the file
+    uint8_t x, y;
+};
+
+/*
+ * the main line of one game of an SGF file, following the first variation
+ * wherever the game branches
+ */
+struct SgfGame {
+    // SZ, 19 if not given
+    coord_t w, h;
+    // KM, 0 if not given
+    float komi;
+    // PB, PW and RE as written in the file, with any escapes left in (see
+    // SgfCollection::text), empty if not given
+    std::string_view black, white, result;
+
+    // the setup stones placed before the first move are entries setup_start
+    // to move_start of SgfCollection::moves, and the moves are entries
+    // move_start to end
+    uint32_t setup_start, move_start, end;
+};
+
+
+/*
+ * reads every game of an SGF collection in one pass over the file, which is
+ * mmapped and never copied: the few text properties kept are views into the
+ * mapping, and the stones of all the games go into one array
+ *
+ * only the properties describing the game (SZ, KM, PB, PW, RE) and its
+ * stones (B, W, AB, AW) are kept, the rest are skipped. Setup stones placed
+ * after the first move aren't kept either
+ */
+class SgfCollection {
+private:
+
+    std::string path;
+    const char * data;
+    size_t size;
+    // whether data is mapped by this collection
+    bool mapped;
+
+    std::vector<SgfGame> games;
+    std::vector<SgfMove> moves;
+
+    void parse();
+
+public:
+
+    /*
+     * maps and reads the SGF file path
+     */
+    SgfCollection(const std::string & path);
+
+    /*
+     * reads the SGF collection in the size bytes at data, which must outlive
+     * this collection
+     */
+    SgfCollection(const char * data, size_t size);
+
+    ~SgfCollection();
+
+    SgfCollection(const SgfCollection &) = delete;
+    SgfCollection & operator=(const SgfCollection &) = delete;
+
+    size_t n_games() const {
+        return games.size();
+    }
+
+    const SgfGame & game(size_t i) const {
+        return games[i];
+    }
+
+    const SgfMove * setup_begin(const SgfGame & g) const {
+        return moves.data() + g.setup_start;
+    }
+
+    const SgfMove * setup_end(const SgfGame & g) const {
+        return moves.data() + g.move_start;
+    }
+
+    const SgfMove * moves_begin(const SgfGame & g) const {
+        return moves.data() + g.move_start;
+    }
+
+    const SgfMove * moves_end(const SgfGame & g) const {
+        return moves.data() + g.end;
+    }
+
+    /*
+     * the number of stones (setup stones and moves) of every game
+     */
+    size_t n_stones() const {
+        return moves.size();
+    }
+
+    /*
+     * the text of a property value, with its escapes removed
+     */
+    static std::string text(std::string_view value);
+};
+
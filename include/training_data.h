@@ -0,0 +1,277 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <game_record.h>
+#include <go.h>
+#include <xorshift.h>
+
+
+/*
+ * training positions are stored in files of fixed-width records, so any
+ * position can be found from its index without reading the rest of the file,
+ * which is meant to be mmapped:
+ *
+ *   TrainingFileHeader
+ *   chunks of up to chunk_positions consecutive records
+ *   n_chunks x TrainingChunk, the index of the chunks
+ *
+ * each record is a TrainingRecord followed by the board, packed 2 bits to a
+ * tile in row-major order as in GameState (empty 0, black 1, white 2, ko 3)
+ * into uint64 words, and then the policy, the fraction of the search's
+ * visits given to each tile in row-major order and then to passing, scaled
+ * to 0xffff, padded to a multiple of 8 bytes. Everything is in the byte
+ * order of the machine
+ */
+struct TrainingFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t w, h;
+    // the size of each record in bytes
+    uint32_t record_size;
+    uint32_t chunk_positions;
+    uint64_t n_chunks;
+    uint64_t n_positions;
+    // the file offset of the chunk index
+    uint64_t index_offset;
+};
+
+struct TrainingChunk {
+    // the file offset of the first record of the chunk
+    uint64_t offset;
+    // the index of that record among all the positions of the file
+    uint64_t first_position;
+};
+
+struct TrainingRecord {
+    // the result of the game to black: 1 for a win, -1 for a loss, 0 for a
+    // tie
+    float value;
+    // Go::get_score of the final position of the game
+    int32_t score;
+    // the index of the game in the file, and of the move in the game
+    uint32_t game;
+    uint16_t move_number;
+    // the move played from this position as a row-major tile index, or
+    // GameRecord::pass
+    uint16_t move;
+    // as GameState::turn_idx: bit 0 set if white is to move, bit 1 if the
+    // last move was a pass
+    uint8_t turn;
+    uint8_t pad[7];
+};
+
+
+/*
+ * a minibatch of n training positions, laid out for a network like the one
+ * in py/monte_carlo.py
+ */
+struct TrainingBatch {
+    // the number of network input planes of each tile
+    static constexpr uint32_t n_planes = 4;
+
+    uint32_t n;
+    // the planes of BatchEvaluator::encode_stones for each position, in HWC
+    // order
+    std::vector<float> inputs;
+    // the policy of each position over the tiles in row-major order and then
+    // passing, summing to 1
+    std::vector<float> policies;
+    // the value of each position to black
+    std::vector<float> values;
+    // the symmetry each position was read with (see TrainingCodec::read)
+    std::vector<uint8_t> symmetries;
+    // the index of each position where it was read from
+    std::vector<uint64_t> positions;
+};
+
+
+/*
+ * packs the positions of games into training records, and unpacks records
+ * through the symmetries of the board (the 8 of a square board, or the 4
+ * which keep the shape of one that isn't)
+ */
+class TrainingCodec {
+private:
+
+    coord_t w, h;
+    uint32_t n_words;
+
+    // for each of the 8 symmetries, the row-major index of the tile of the
+    // stored position moved to each tile
+    std::vector<uint16_t> sources;
+
+    // the 4 tiles packed in each byte of a board, one per byte
+    static const std::array<uint32_t, 256> unpack_table;
+
+public:
+
+    /*
+     * the size in bytes of a record of a w x h position
+     */
+    static uint32_t record_size(coord_t w, coord_t h);
+
+    TrainingCodec(coord_t w, coord_t h);
+
+    uint32_t record_size() const {
+        return record_size(w, h);
+    }
+
+    /*
+     * a random symmetry of the board
+     */
+    uint32_t random_symmetry(Xorshift & rng) const {
+        uint32_t s = rng.below(8);
+        // odd rotations turn a board which isn't square on its side
+        return w == h ? s : s & ~1u;
+    }
+
+    /*
+     * writes a record for each position of r, which is game number game,
+     * one after another to out
+     */
+    void pack_game(const GameRecord & r, uint32_t game, uint8_t * out) const;
+
+    /*
+     * unpacks the record rec moved by symmetry s, which mirrors the board
+     * (x -> w - x - 1) if bit 2 is set and then rotates it by 90 degrees
+     * (x -> w - y - 1, y -> x) s & 3 times, writing the color of each tile
+     * to board (w * h bytes, in the encoding of the packed board) and its
+     * policy to policy (w * h + 1 floats) if it isn't null
+     */
+    void read(const uint8_t * rec, uint32_t s, uint8_t * board,
+            float * policy) const;
+
+    /*
+     * unpacks rec moved by symmetry s into entry k of b, which must have
+     * room for it
+     */
+    void decode(const uint8_t * rec, uint32_t s, TrainingBatch & b,
+            uint32_t k) const;
+
+    /*
+     * sizes b for n positions
+     */
+    void resize(TrainingBatch & b, uint32_t n) const;
+};
+
+
+/*
+ * writes training positions to a file, a chunk at a time
+ */
+class TrainingWriter {
+public:
+
+    static constexpr uint32_t file_magic = 0x44544f47; // "GOTD"
+    static constexpr uint32_t file_version = 1;
+
+    static constexpr uint32_t default_chunk_positions = 4096;
+
+private:
+
+    std::string path;
+    std::ofstream f;
+    bool closed;
+
+    TrainingCodec codec;
+    TrainingFileHeader header;
+    std::vector<TrainingChunk> chunks;
+
+    // the records of the chunk being filled
+    std::vector<uint8_t> chunk;
+    uint32_t chunk_fill;
+    uint32_t n_games;
+
+    // the records of the game being added
+    std::vector<uint8_t> game_records;
+
+    void write_chunk();
+
+public:
+
+    TrainingWriter(const std::string & path, coord_t w, coord_t h,
+            uint32_t chunk_positions=default_chunk_positions);
+
+    /*
+     * closes the file, if close wasn't called
+     */
+    ~TrainingWriter();
+
+    /*
+     * adds every position of a game of self-play, with the visits of the
+     * search before each move as its policy, and the result as its value
+     */
+    void add_game(const GameRecord & r);
+
+    /*
+     * writes out the last chunk and the index, after which the file is
+     * complete and no more positions may be added
+     */
+    void close();
+};
+
+
+/*
+ * reads random minibatches of training positions from an mmapped file,
+ * unpacking each with a random symmetry of the board
+ *
+ * the reader only reads the file, so any number of threads may sample from
+ * one at once, each with its own Xorshift
+ */
+class TrainingReader {
+private:
+
+    std::string path;
+    const uint8_t * data;
+    size_t size;
+
+    const TrainingFileHeader * header;
+    const TrainingChunk * chunks;
+
+    TrainingCodec codec;
+
+    const uint8_t * record_at(uint64_t i) const;
+
+public:
+
+    TrainingReader(const std::string & path);
+
+    ~TrainingReader();
+
+    TrainingReader(const TrainingReader &) = delete;
+    TrainingReader & operator=(const TrainingReader &) = delete;
+
+    coord_t width() const {
+        return header->w;
+    }
+
+    coord_t height() const {
+        return header->h;
+    }
+
+    uint64_t n_positions() const {
+        return header->n_positions;
+    }
+
+    const TrainingRecord & record(uint64_t i) const {
+        return *reinterpret_cast<const TrainingRecord *>(record_at(i));
+    }
+
+    /*
+     * unpacks position i moved by symmetry s, as TrainingCodec::read
+     */
+    void read(uint64_t i, uint32_t s, uint8_t * board, float * policy) const {
+        codec.read(record_at(i), s, board, policy);
+    }
+
+    /*
+     * fills b with n positions drawn uniformly from the file, each moved by
+     * a random symmetry
+     */
+    void sample(uint32_t n, Xorshift & rng, TrainingBatch & b) const;
+};
+
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include <zobrist.h>
+
+
+/*
+ * a single entry in the transposition table, as returned by probe
+ *
+ * scores are stored relative to the player whose turn it is, and exclude
+ * the captures made before the position was reached (which are not part of
+ * the Zobrist hash), so that a single entry can serve every position which
+ * hashes the same, i.e. every rotation, reflection and color swap of the
+ * position
+ */
+struct TTEntry {
+    zob_hash_t key;
+
+    int16_t score;
+    uint8_t depth;
+    // one of TranspositionTable::{exact, lower, upper}
+    uint8_t bound;
+
+    // the tile index of the best move found in this position in the game
+    // being searched (TranspositionTable::pass_move for passing), which is
+    // only meaningful in the orientation the position was searched in, i.e.
+    // when raw_check matches the low bits of the raw hash of the position
+    // being probed
+    uint16_t move;
+    uint16_t raw_check;
+};
+
+
+class TranspositionTable {
+public:
+
+    // the type of bound the score of an entry is on the true score of the
+    // position
+    static constexpr uint8_t exact = 0;
+    static constexpr uint8_t lower = 1;
+    static constexpr uint8_t upper = 2;
+
+    // depth of entries whose search reached the end of the game on every
+    // line, which hold for a search of any depth
+    static constexpr uint8_t complete_depth = 0xff;
+
+    static constexpr uint16_t no_move   = 0xfffeu;
+    static constexpr uint16_t pass_move = 0xffffu;
+
+    // number of consecutive entries a key may be stored in, which together
+    // fill one cache line
+    static constexpr uint32_t bucket_size = 4;
+
+    static constexpr uint64_t alignment = 64;
+
+private:
+
+    /*
+     * an entry as it is stored in the table, which may be read and written by
+     * many threads at once without locking. data holds everything but the key
+     * and check holds the key xor'ed with data, so an entry which was torn by
+     * two threads writing it at the same time doesn't match any key
+     */
+    struct Slot {
+        std::atomic<uint64_t> check;
+        std::atomic<uint64_t> data;
+    };
+
+    // number of entries in the table, always a power of 2
+    uint64_t n_entries;
+
+    /*
+     * pointer to allocated memory region for slots (in place of
+     * aligned_alloc)
+     */
+    void * mem;
+    Slot * slots;
+
+    Slot * bucket(zob_hash_t key) const {
+        return &slots[key & (n_entries - bucket_size)];
+    }
+
+    static uint64_t pack(int score, uint8_t depth, uint8_t bound,
+            uint16_t move, uint16_t raw_check) {
+        return ((uint64_t) (uint16_t) score) |
+            (((uint64_t) depth) << 16) |
+            (((uint64_t) bound) << 24) |
+            (((uint64_t) move) << 32) |
+            (((uint64_t) raw_check) << 48);
+    }
+
+    static TTEntry unpack(zob_hash_t key, uint64_t data) {
+        TTEntry e;
+        e.key = key;
+        e.score = (int16_t) (data & 0xffff);
+        e.depth = (uint8_t) (data >> 16);
+        e.bound = (uint8_t) (data >> 24);
+        e.move = (uint16_t) (data >> 32);
+        e.raw_check = (uint16_t) (data >> 48);
+        return e;
+    }
+
+public:
+
+    /*
+     * allocates a table with 2^log_size entries
+     */
+    TranspositionTable(uint32_t log_size);
+
+    TranspositionTable(const TranspositionTable &) = delete;
+
+    ~TranspositionTable();
+
+
+    /*
+     * empties the table
+     */
+    void clear();
+
+    /*
+     * copies the entry stored for key into e, returning false if there isn't
+     * one
+     */
+    bool probe(zob_hash_t key, TTEntry & e) const;
+
+    /*
+     * stores the result of a search of the given depth, replacing the
+     * shallowest entry in the key's bucket if the key is not already present
+     */
+    void store(zob_hash_t key, uint16_t raw_check, int depth, uint8_t bound,
+            int score, uint16_t move);
+};
+
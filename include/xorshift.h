@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+
+/*
+ * xorshift64* pseudorandom number generator, which costs a few instructions
+ * per number, for drawing every move of random playouts
+ */
+class Xorshift {
+private:
+
+    uint64_t state;
+
+public:
+
+    Xorshift(uint64_t s = 1) {
+        seed(s);
+    }
+
+    void seed(uint64_t s) {
+        // the state must never be 0, which xorshift maps to itself
+        state = s != 0 ? s : 0x9e3779b97f4a7c15llu;
+    }
+
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545f4914f6cdd1dllu;
+    }
+
+    /*
+     * returns a number from 0 to n - 1, by scaling the high bits rather than
+     * dividing
+     */
+    uint32_t below(uint32_t n) {
+        return (uint32_t) (((next() >> 32) * n) >> 32);
+    }
+};
+
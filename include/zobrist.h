@@ -1,12 +1,11 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
+#include <vector>
 #include <go.h>
 
 
-typedef uint64_t zob_hash_t;
-
-
 struct ZobTable {
     zob_hash_t * table;
 
@@ -70,9 +69,29 @@ private:
      */
     std::shared_ptr<ZobTable> zt;
 
+    /*
+     * the same bitstrings as zt, but indexed by the tile indices of Go's
+     * padded board, so Go can update its hash incrementally without having
+     * to convert tile indices to coordinates (border entries are 0)
+     */
+    std::shared_ptr<ZobTable> padded_zt;
+
     // possible values (black, white, black 1-pass, white 1-pass)
     zob_hash_t turn_hashes[4];
 
+    /*
+     * unstructured keys for each state of each tile (0 for empty tiles) and
+     * each turn, which symm_key is built from
+     */
+    std::vector<zob_hash_t> symm_keys;
+    zob_hash_t symm_turn_keys[4];
+
+    /*
+     * for each of the 8 symmetries of the board in symm_key, the row-major
+     * index each tile is moved to
+     */
+    std::vector<uint16_t> symm_dest;
+
     /*
      * "rotate" the hash by 90 degrees
      */
@@ -120,10 +139,22 @@ public:
      */
     board_idx_t to_idx(coord_t x, coord_t y, uint8_t color) const;
 
+    coord_t width() const {
+        return w;
+    }
+
+    coord_t height() const {
+        return h;
+    }
+
     zob_hash_t * get_table() const {
         return zt->table;
     }
 
+    const zob_hash_t * get_padded_table() const {
+        return padded_zt->table;
+    }
+
     const zob_hash_t * get_turn_hashes() const {
         return turn_hashes;
     }
@@ -131,6 +162,16 @@ public:
 
     ZobristHash(coord_t w, coord_t h);
 
+    /*
+     * the raw hash of the board with raw hash h after mirroring it (x ->
+     * width - x - 1) if mirror is set, then rotating it by 90 degrees
+     * rotations times, then exchanging the colors (and the player to move)
+     * if swap_colors is set. Ko tiles aren't hashed symmetrically, so this
+     * only holds for boards without a ko
+     */
+    static zob_hash_t transform(zob_hash_t h, bool mirror, uint32_t rotations,
+            bool swap_colors);
+
     static inline zob_hash_t make_symm(zob_hash_t h) {
         // combine h with other 15 symmetries
         zob_hash_t res = (gold_r + (h << 1));
@@ -169,19 +210,103 @@ public:
         return res >> 1;
     }
 
-    inline zob_hash_t hash(const Go & g) const {
+    /*
+     * a hash of g which, like make_symm, is the same for every symmetry of
+     * g, but which two boards that aren't symmetric only share by chance.
+     * make_symm can't be trusted that far: its tables repeat bytes to be
+     * symmetric, so the raw hashes of different boards collide often. raw
+     * must be the raw hash of g
+     *
+     * g is turned into the symmetry with the least raw hash, and hashed in
+     * that orientation with unstructured keys, as Go's position keys are.
+     * Ko tiles aren't hashed symmetrically, so symmetries of a board with a
+     * ko may have different keys
+     */
+    template<class G>
+    inline zob_hash_t symm_key(const G & g, zob_hash_t raw) const {
+        // the raw hash of each symmetry (mirrored if bit 2 is set, then
+        // rotated s & 3 times, then with colors swapped if bit 3 is set), as
+        // in transform
+        zob_hash_t hs[16];
+        zob_hash_t least = raw;
+        zob_hash_t mh = raw;
+        for (uint32_t m = 0; m < 2; m++) {
+            zob_hash_t rh = mh;
+            for (uint32_t r = 0; r < 4; r++) {
+                hs[4 * m + r] = rh;
+                hs[8 + 4 * m + r] = col_x(rh);
+                least = std::min(least, std::min(rh, hs[8 + 4 * m + r]));
+                rh = rot(rh);
+            }
+            mh = vmir(raw);
+        }
+
+        // raw hashes of different symmetries may collide, so of those with
+        // the least raw hash, the one with the least key is taken
+        zob_hash_t res = ~0llu;
+        for (uint32_t s = 0; s < 16; s++) {
+            if (hs[s] != least) {
+                continue;
+            }
+            const uint16_t * dest = &symm_dest[(s & 7) * w * this->h];
+            uint8_t swap = (s & 8) ? 3 : 0;
+            zob_hash_t key = 0;
+            for (coord_t y = 0; y < this->h; y++) {
+                for (coord_t x = 0; x < this->w; x++) {
+                    Color c = g.tile_at(x, y);
+                    uint8_t tile = c == Color::ko ? ko : c == Color::empty ?
+                        empty : (uint8_t) c ^ swap;
+                    key ^= symm_keys[num_states * dest[y * w + x] + tile];
+                }
+            }
+            uint8_t turn_idx = ((g.get_player() == white) ^ (swap & 1)) +
+                (g.has_passed() << 1);
+            res = std::min(res, key ^ symm_turn_keys[turn_idx]);
+        }
+        return res;
+    }
+
+    /*
+     * computes the hash of the game in its current orientation, before it has
+     * been combined with its symmetries by make_symm, by walking every tile
+     *
+     * G is any game with Go's tile_at, get_player and has_passed (i.e. Go or
+     * BitGo)
+     */
+    template<class G>
+    inline zob_hash_t compute_raw_hash(const G & g) const {
         const zob_hash_t * table = zt->table;
         zob_hash_t h = 0;
         for (coord_t y = 0; y < this->h; y++) {
             for (coord_t x = 0; x < this->w; x++) {
-                uint8_t tile = (uint8_t) g.tile_at(x, y);
+                Color c = g.tile_at(x, y);
+                // tile_at reports ko tiles as Color::ko, which is not a valid
+                // state index
+                uint8_t tile = c == Color::ko ? ko : (uint8_t) c;
                 h ^= table[to_idx(x, y, tile)];
             }
         }
         uint8_t turn_idx = (g.get_player() == white) + (g.has_passed() << 1);
         h ^= turn_hashes[turn_idx];
 
-        return make_symm(h);
+        return h;
+    }
+
+    /*
+     * hash of the game in its current orientation, which is maintained by the
+     * game itself if it was given this hash function with set_zobrist
+     */
+    template<class G>
+    inline zob_hash_t raw_hash(const G & g) const {
+        if (g.get_zobrist() == this) {
+            return g.get_raw_hash();
+        }
+        return compute_raw_hash(g);
+    }
+
+    template<class G>
+    inline zob_hash_t hash(const G & g) const {
+        return make_symm(raw_hash(g));
     }
 
     void consistency_check() const;
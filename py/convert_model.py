@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+"""
+converts a saved Keras model (e.g. saved_models/gomoku) to the flat weight
+file read by Network (include/network.h)
+
+    python3 py/convert_model.py saved_models/gomoku gomoku.gonn
+
+supports the layers of the networks built in monte_carlo.py: same-padded
+(or 1x1) Conv2D, BatchNormalization (folded into a per-channel scale and
+shift), ReLU, Add, Flatten, Dense, and relu/tanh/linear activations
+"""
+
+import struct
+import sys
+
+import numpy as np
+import tensorflow.keras as keras
+
+
+MAGIC = 0x4e4e4f47
+VERSION = 1
+
+CONV, SCALE_SHIFT, RELU, ADD, DENSE, TANH = range(6)
+
+
+class Writer:
+
+    def __init__(self, model):
+        self.model = model
+        self.layers = []
+        self.n_tensors = 1
+        # the network tensor holding each Keras tensor
+        self.tensors = {id(model.inputs[0]): 0}
+        # the number of layers still to read each Keras tensor, as element-wise
+        # layers overwrite their input
+        self.readers = {}
+        for layer in model.layers:
+            for t in self.inputs(layer):
+                self.readers[id(t)] = self.readers.get(id(t), 0) + 1
+        for t in model.outputs:
+            self.readers[id(t)] = self.readers.get(id(t), 0) + 1
+
+    @staticmethod
+    def inputs(layer):
+        t = layer.input
+        return t if isinstance(t, list) else [t]
+
+    def new_tensor(self):
+        self.n_tensors += 1
+        return self.n_tensors - 1
+
+    def emit(self, kind, src, dst, k=0, n_out=0, weights=()):
+        w = np.concatenate([np.asarray(x, np.float32).ravel()
+                            for x in weights]) if weights else \
+            np.zeros(0, np.float32)
+        self.layers.append((kind, src, dst, k, n_out, w))
+
+    def in_place(self, t):
+        """ the network tensor of Keras tensor t, which may be overwritten """
+        self.readers[id(t)] -= 1
+        if self.readers[id(t)] != 0 or self.tensors[id(t)] == 0:
+            raise ValueError("%s is read after being overwritten" % t.name)
+        return self.tensors[id(t)]
+
+    def activation(self, fn, dst):
+        name = keras.activations.serialize(fn)
+        if name == "relu":
+            self.emit(RELU, dst, dst)
+        elif name == "tanh":
+            self.emit(TANH, dst, dst)
+        elif name != "linear":
+            raise ValueError("unsupported activation " + name)
+
+    def convert(self):
+        for layer in self.model.layers:
+            ins = self.inputs(layer)
+            if isinstance(layer, keras.layers.InputLayer):
+                continue
+            elif isinstance(layer, keras.layers.Conv2D):
+                # 1x1 convolutions pad the same either way
+                same = layer.padding == "same" or layer.kernel_size == (1, 1)
+                if not same or layer.strides != (1, 1) or \
+                        layer.kernel_size[0] != layer.kernel_size[1] or \
+                        layer.data_format != "channels_last":
+                    raise ValueError("unsupported convolution " + layer.name)
+                kernel = layer.kernel.numpy()
+                bias = layer.bias.numpy() if layer.use_bias else \
+                    np.zeros(kernel.shape[3], np.float32)
+                src = self.tensors[id(ins[0])]
+                self.readers[id(ins[0])] -= 1
+                dst = self.new_tensor()
+                self.emit(CONV, src, dst, kernel.shape[0], kernel.shape[3],
+                          (kernel, bias))
+                self.activation(layer.activation, dst)
+            elif isinstance(layer, keras.layers.Dense):
+                kernel = layer.kernel.numpy()
+                bias = layer.bias.numpy() if layer.use_bias else \
+                    np.zeros(kernel.shape[1], np.float32)
+                src = self.tensors[id(ins[0])]
+                self.readers[id(ins[0])] -= 1
+                dst = self.new_tensor()
+                self.emit(DENSE, src, dst, 0, kernel.shape[1], (kernel, bias))
+                self.activation(layer.activation, dst)
+            elif isinstance(layer, keras.layers.BatchNormalization):
+                dst = self.in_place(ins[0])
+                scale = layer.gamma.numpy() / np.sqrt(
+                    layer.moving_variance.numpy() + layer.epsilon)
+                shift = layer.beta.numpy() - layer.moving_mean.numpy() * scale
+                self.emit(SCALE_SHIFT, dst, dst, 0, len(scale),
+                          (scale, shift))
+            elif isinstance(layer, keras.layers.ReLU):
+                dst = self.in_place(ins[0])
+                self.emit(RELU, dst, dst)
+            elif isinstance(layer, keras.layers.Activation):
+                dst = self.in_place(ins[0])
+                self.activation(layer.activation, dst)
+            elif isinstance(layer, keras.layers.Add):
+                # add the input which is read elsewhere to the one which isn't
+                a, b = ins
+                if self.readers[id(a)] == 1 and self.tensors[id(a)] != 0:
+                    a, b = b, a
+                self.readers[id(a)] -= 1
+                dst = self.in_place(b)
+                self.emit(ADD, self.tensors[id(a)], dst)
+            elif isinstance(layer, keras.layers.Flatten):
+                # tensors are stored flattened already
+                dst = self.tensors[id(ins[0])]
+                self.readers[id(ins[0])] -= 1
+            else:
+                raise ValueError("unsupported layer " + layer.name)
+
+            out = layer.output
+            self.tensors[id(out)] = dst
+
+    def write(self, path):
+        h, w, c = self.model.inputs[0].shape[1:]
+        with open(path, "wb") as f:
+            f.write(struct.pack("<6I", MAGIC, VERSION, h, w, c,
+                                len(self.layers)))
+            for kind, src, dst, k, n_out, weights in self.layers:
+                f.write(struct.pack("<6I", kind, src, dst, k, n_out,
+                                    len(weights)))
+                f.write(weights.astype("<f4").tobytes())
+            f.write(struct.pack("<I", len(self.model.outputs)))
+            for t in self.model.outputs:
+                f.write(struct.pack("<I", self.tensors[id(t)]))
+
+
+def main():
+    if len(sys.argv) != 3:
+        print("usage: %s <saved model> <out file>" % sys.argv[0])
+        sys.exit(1)
+
+    model = keras.models.load_model(sys.argv[1], compile=False)
+    writer = Writer(model)
+    writer.convert()
+    writer.write(sys.argv[2])
+
+
+if __name__ == "__main__":
+    main()
@@ -1,82 +1,465 @@
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <thread>
 
 #include <alpha_beta_move.h>
 #include <game_with_info.h>
 
 
-inline bool _play(Game &, GameMove & m, Game & g, int & alpha, int & beta,
-        int & best_val, int depth, uint32_t res_mask, GameMove * move,
-        uint64_t & cnt) {
-    g.play(m);
+template<class G>
+int AlphaBetaMove::move_search(G & g, SearchThread & t, int alpha, int beta,
+        int depth, uint32_t ply, bool on_pv, board_idx_t * move) {
+    if (depth == 0 || g.game_over()) {
+        // we have reached the limits of our search
+        t.cnt++;
+        t.hit_horizon |= !g.game_over();
+        if ((t.cnt & (budget_check_interval - 1)) == 0) {
+            check_budget(t);
+        }
+        return g.get_score();
+    }
+
+    bool max_player = g.max_player();
+    // 0xffffffff if min_player, else 0
+    uint32_t res_mask = ((uint32_t) max_player) - 1;
 
-    int res = AlphaBetaMove::move_search(g, ~beta, ~alpha, depth - 1, nullptr, cnt);
+    // scores in the transposition table are relative to the player to move
+    // and exclude the captures made so far, since neither is captured by the
+    // hash
+    int cap_diff = (int) g.get_captures(Color::black) -
+        (int) g.get_captures(Color::white);
+    auto to_tt = [&](int score) -> int {
+        return max_player ? score - cap_diff : cap_diff - score;
+    };
+    auto from_tt = [&](int score) -> int {
+        return max_player ? score + cap_diff : cap_diff - score;
+    };
 
-    // res = ~res if min_player
-    res = res ^ res_mask;
+    zob_hash_t raw = zh.raw_hash(g);
+    // the symmetries of a position share an entry, and a matching key is
+    // enough to trust the stored score, which it wouldn't be with make_symm
+    zob_hash_t key = zh.symm_key(g, raw);
+    uint16_t raw_check = (uint16_t) raw;
 
-    if (res > best_val) {
-        alpha = std::max(alpha, res);
-        best_val = res;
-        if (move != nullptr) {
-            *move = m;
+    // the root must always search for a move, so it can't return early.
+    // Under superko the value of a position depends on the line that
+    // reached it, which the key doesn't hold, so stored scores are only
+    // trusted without it (the stored move still orders the search)
+    TTEntry e;
+    bool found = tt.probe(key, e);
+    if (found && move == nullptr && e.depth >= depth && !g.get_superko()) {
+        int score = from_tt(e.score);
+        int res = score ^ res_mask;
+        if (e.bound == TranspositionTable::exact ||
+                (e.bound == TranspositionTable::lower && res >= beta) ||
+                (e.bound == TranspositionTable::upper && res <= alpha)) {
+            t.hit_horizon |= e.depth != TranspositionTable::complete_depth;
+            return score;
         }
     }
 
-    g.undo();
+    // the stored best move is only meaningful if the position is in the same
+    // orientation it was searched in
+    board_idx_t tt_move = MoveOrderer::no_move;
+    if (found && e.raw_check == raw_check) {
+        tt_move = e.move;
+    }
+    // while following the principal variation of the last iteration, its
+    // moves are searched first
+    on_pv = on_pv && ply < pv.size();
+    if (on_pv) {
+        tt_move = pv[ply];
+    }
 
-    // stop iterating once alpha >= beta
-    return alpha < beta;
-}
+    // whether any line below this node was cut off by the depth limit, to
+    // tell if this node was searched to the end of the game
+    bool parent_hit_horizon = t.hit_horizon;
+    t.hit_horizon = false;
 
+    // null move pruning: passing is always legal, so if passing and searching
+    // the reply to a reduced depth already scores at least beta, this node
+    // will almost certainly fail high. Passing isn't tried after a pass,
+    // where it would end the game, or at the root, which must find a move
+    if (reductions && move == nullptr && !on_pv &&
+            depth >= null_move_min_depth && beta != max_int &&
+            !g.has_passed()) {
+        g.play_idx(MoveOrderer::pass_move);
+        int res = move_search(g, t, ~beta, ~(beta - 1),
+                depth - 1 - null_move_reduction, ply + 1, false, nullptr) ^
+            res_mask;
+        g.undo_idx();
 
-int AlphaBetaMove::move_search(Game & g, int alpha, int beta, int depth, GameMove * move, uint64_t & cnt) {
-    if (depth == 0 || g.game_over()) {
-        // we have reached the limits of our search
-        cnt++;
-        return g.get_score();
+        if (stopped(t)) {
+            return 0;
+        }
+        if (res >= beta) {
+            // passing is a real move, so this is a true lower bound on the
+            // score, if only to a reduced depth
+            tt.store(key, raw_check,
+                    t.hit_horizon ? depth : TranspositionTable::complete_depth,
+                    TranspositionTable::lower, to_tt(res),
+                    TranspositionTable::no_move);
+            t.hit_horizon |= parent_hit_horizon;
+            return res ^ res_mask;
+        }
+        // the result isn't used, so the lines it searched don't count
+        t.hit_horizon = false;
     }
 
-    // 0xffffffff if min_player, else 0
-    uint32_t res_mask = ((uint32_t) g.max_player()) - 1;
+    board_idx_t moves[MoveOrderer::max_moves];
+    uint32_t n_moves;
+    // moves after these are quiet, and may be reduced when searched late
+    uint32_t n_tactical;
+    if (order_moves) {
+        n_moves = t.orderer.order(g, tt_move, ply, moves, n_tactical);
+    }
+    else {
+        // in row-major order, then passing
+        n_moves = g.legal_moves(moves);
+        moves[n_moves++] = MoveOrderer::pass_move;
+        // without ordering, no move is any more likely to be bad than another
+        n_tactical = n_moves;
+    }
 
+    int orig_alpha = alpha;
     int best_val = min_int;
+    uint16_t best_move = TranspositionTable::no_move;
+
+    for (uint32_t i = 0; i < n_moves; i++) {
+        board_idx_t idx = moves[i];
+
+        g.play_idx(idx);
+        if (g.superko_violation()) {
+            // legal_moves only checks simple ko
+            g.undo_idx();
+            continue;
+        }
+
+        bool child_on_pv = on_pv && idx == pv[ply];
+        int res = 0;
+        bool full_depth = true;
+        // late move reductions: quiet moves ordered late rarely beat alpha,
+        // so they are first searched to a reduced depth with a null window,
+        // and only searched fully if that beats alpha. Passes are never
+        // reduced, since they may end the game
+        if (reductions && i >= lmr_min_moves && i >= n_tactical &&
+                depth >= lmr_min_depth && idx != MoveOrderer::pass_move &&
+                !child_on_pv) {
+            int reduction = i >= lmr_late_moves ? 2 : 1;
+            res = move_search(g, t, ~(alpha + 1), ~alpha,
+                    depth - 1 - reduction, ply + 1, false, nullptr) ^
+                res_mask;
+            full_depth = res > alpha && !stopped(t);
+        }
+
+        if (full_depth) {
+            if (pvs && i > 0) {
+                // principal variation search: every move after the first is
+                // expected to be worse, which a null window proves cheaply,
+                // and only moves which turn out better are searched again
+                // with the full window
+                res = move_search(g, t, ~(alpha + 1), ~alpha, depth - 1,
+                        ply + 1, child_on_pv, nullptr) ^ res_mask;
+                if (res > alpha && res < beta && !stopped(t)) {
+                    res = move_search(g, t, ~beta, ~alpha, depth - 1, ply + 1,
+                            child_on_pv, nullptr) ^ res_mask;
+                }
+            }
+            else {
+                res = move_search(g, t, ~beta, ~alpha, depth - 1, ply + 1,
+                        child_on_pv, nullptr);
+
+                // res = ~res if min_player
+                res = res ^ res_mask;
+            }
+        }
 
-    Go & go = dynamic_cast<Go &>(g.strip());
-    go.for_each_legal_move_inline<bool(Game &, GameMove &, Game &, int &,
-            int &, int &, int, uint32_t, GameMove *, uint64_t &), Game &,
-        int &, int &, int &, int, uint32_t, GameMove *, uint64_t &>
-            (_play, g, alpha, beta, best_val, depth, res_mask, move, cnt);
+        g.undo_idx();
+
+        if (stopped(t)) {
+            // the result of this search will be thrown away
+            return 0;
+        }
+
+        if (res > best_val) {
+            alpha = std::max(alpha, res);
+            best_val = res;
+            best_move = idx;
+            if (move != nullptr) {
+                *move = idx;
+            }
+        }
+
+        // stop searching once alpha >= beta
+        if (alpha >= beta) {
+            if (order_moves) {
+                t.orderer.cutoff(idx, ply, depth);
+            }
+            break;
+        }
+    }
+
+    uint8_t bound = best_val <= orig_alpha ? TranspositionTable::upper :
+        best_val >= beta ? TranspositionTable::lower :
+        TranspositionTable::exact;
+    // results of complete searches hold for any depth
+    tt.store(key, raw_check,
+            t.hit_horizon ? depth : TranspositionTable::complete_depth, bound,
+            to_tt(best_val ^ res_mask), best_move);
+    t.hit_horizon |= parent_hit_horizon;
 
     return best_val ^ res_mask;
 }
 
-#include <unistd.h>
+template<class G>
+int AlphaBetaMove::aspiration_search(G & g, SearchThread & t, int depth,
+        int prev_score, board_idx_t * move) {
+    if (!pvs || depth == 1) {
+        t.hit_horizon = false;
+        return move_search(g, t, min_int, max_int, depth, 0, true, move);
+    }
 
-MoveStatus AlphaBetaMove::next_move(GameMove & move) {
+    // the window is relative to the player to move, while scores are black's
+    int res_mask = g.max_player() ? 0 : ~0;
+    int center = prev_score ^ res_mask;
 
-    if (game.game_over()) {
-        getch();
-        return failed;
+    // widen the window on whichever side the score fell outside it, until
+    // it lands inside (or the window is unbounded)
+    int64_t lo_delta = aspiration_window;
+    int64_t hi_delta = aspiration_window;
+    while (true) {
+        int alpha = (int) std::max<int64_t>(min_int, center - lo_delta);
+        int beta = (int) std::min<int64_t>(max_int, center + hi_delta);
+
+        t.hit_horizon = false;
+        int score = move_search(g, t, alpha, beta, depth, 0, true, move);
+        int res = score ^ res_mask;
+
+        if (stopped(t)) {
+            return score;
+        }
+        if (res <= alpha && alpha != min_int) {
+            lo_delta *= 4;
+        }
+        else if (res >= beta && beta != max_int) {
+            hi_delta *= 4;
+        }
+        else {
+            return score;
+        }
     }
+}
+
+void AlphaBetaMove::check_budget(SearchThread & t) {
+    uint64_t cnt = shared_cnt.fetch_add(budget_check_interval,
+            std::memory_order_relaxed) + budget_check_interval;
+    // only the main thread reads the clock, and helpers never abort the
+    // first iteration since they don't know when it's done
+    if (t.helper || !budget_armed) {
+        return;
+    }
+    if (node_limit != 0 && cnt >= node_limit) {
+        aborted = true;
+    }
+    if (time_limit > 0 && std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - search_start).count() >=
+            time_limit) {
+        aborted = true;
+    }
+}
 
-    GameState state(dynamic_cast<Go &>(game.strip()));
+template<class G>
+void AlphaBetaMove::extract_pv(G & g, int depth) {
+    pv.clear();
+
+    // follow the best moves stored in the transposition table, as long as
+    // they are legal in the position they are played in
+    board_idx_t moves[MoveOrderer::max_moves];
+    while (pv.size() < (size_t) depth && !g.game_over()) {
+        zob_hash_t raw = zh.raw_hash(g);
+        TTEntry e;
+        if (!tt.probe(zh.symm_key(g, raw), e) ||
+                e.raw_check != (uint16_t) raw ||
+                e.move == TranspositionTable::no_move) {
+            break;
+        }
+
+        board_idx_t idx = e.move;
+        if (idx != MoveOrderer::pass_move) {
+            uint32_t n_moves = g.legal_moves(moves);
+            if (std::find(moves, moves + n_moves, idx) == moves + n_moves) {
+                break;
+            }
+        }
+        g.play_idx(idx);
+        if (g.superko_violation()) {
+            g.undo_idx();
+            break;
+        }
+        pv.push_back(idx);
+    }
+
+    for (size_t i = 0; i < pv.size(); i++) {
+        g.undo_idx();
+    }
+}
+
+template<class G>
+void AlphaBetaMove::search(const G & g, GameMove & move) {
+    GameState state(g);
     state.print();
 
-    std::shared_ptr<Game> game_clone = game.clone();
+    // each thread searches its own copy of the game, which can make and
+    // unmake moves in place
+    std::vector<G> games(threads.size(), g);
+    for (G & go : games) {
+        // have the copy maintain its own hash as the search makes moves
+        go.set_zobrist(&zh);
+    }
 
-    uint64_t cnt = 0;
-    move_search(*game_clone, min_int, max_int, max_depth, &move, cnt);
+    for (SearchThread & t : threads) {
+        t.orderer.new_search();
+        t.cnt = 0;
+    }
+    pv.clear();
 
-    printf("Explored %llu game states\n", cnt);
+    search_start = std::chrono::steady_clock::now();
+    aborted = false;
+    shared_cnt = 0;
+    // always finish the first iteration, so there is a move to play
+    budget_armed = false;
 
-    GoMove mv = dynamic_cast<GoMove &>(move);
-    /*printf("\r\nMove: %s (%u, %u)\r\n", mv.color == black ? "black" :
-            mv.color == white ? "white" : "pass", mv.x, mv.y);*/
+    board_idx_t best = MoveOrderer::pass_move;
+    // the score of the last iteration, around which the next one's window is
+    // centered
+    int prev_score = 0;
+    uint64_t total_cnt = 0;
+    for (int depth = 1; (max_depth == inf_depth || depth <= max_depth) &&
+            depth < TranspositionTable::complete_depth; depth++) {
+        auto start = std::chrono::steady_clock::now();
+        iteration_done = false;
 
-    //usleep(1000000);
+        // helpers search the same position, half of them one move deeper, so
+        // they fill the transposition table with results the main thread
+        // can use and tend not to search the same lines at the same time
+        std::vector<std::thread> helpers;
+        for (size_t i = 1; i < threads.size(); i++) {
+            int helper_depth = std::min(depth + (int) (i & 1),
+                    TranspositionTable::complete_depth - 1);
+            helpers.emplace_back([this, &games, i, helper_depth]() {
+                board_idx_t m;
+                threads[i].hit_horizon = false;
+                move_search(games[i], threads[i], min_int, max_int,
+                        helper_depth, 0, true, &m);
+            });
+        }
 
-    return ok;
+        SearchThread & t = threads[0];
+        board_idx_t m;
+        int score = aspiration_search(games[0], t, depth, prev_score, &m);
+        prev_score = score;
+
+        iteration_done = true;
+        for (std::thread & helper : helpers) {
+            helper.join();
+        }
+
+        uint64_t cnt = 0;
+        for (const SearchThread & h : threads) {
+            cnt += h.cnt;
+        }
+        uint64_t iter_cnt = cnt - total_cnt;
+        total_cnt = cnt;
+
+        double secs = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+        if (aborted) {
+            printf("depth %2d: out of budget after %llu game states in "
+                    "%.3fs\n", depth, (unsigned long long) iter_cnt, secs);
+            break;
+        }
+
+        best = m;
+        extract_pv(games[0], depth);
+        budget_armed = true;
+
+        printf("depth %2d: %llu game states in %.3fs (%.0f/s), score %d, ",
+                depth, (unsigned long long) iter_cnt, secs, iter_cnt / secs,
+                score);
+        if (best == MoveOrderer::pass_move) {
+            printf("pass\n");
+        }
+        else {
+            printf("%c%d\n", Go::COL_INDICATORS[g.idx_x(best)],
+                    g.height() - g.idx_y(best));
+        }
+
+        if (!t.hit_horizon) {
+            // every line was searched to the end of the game, so searching
+            // deeper would give the same result
+            break;
+        }
+    }
+
+    GoMove m;
+    if (best == MoveOrderer::pass_move) {
+        m.color = Color::pass;
+    }
+    else {
+        m.color = g.get_player();
+        m.x = g.idx_x(best);
+        m.y = g.idx_y(best);
+    }
+    move = m;
+    node_count = total_cnt;
 }
 
+template<coord_t N>
+bool AlphaBetaMove::search_bit_go(Game & g, GameMove & move) {
+    if constexpr (N > max_bit_go_size) {
+        return false;
+    }
+    else {
+        BitGo<N> * bg = dynamic_cast<BitGo<N> *>(&g);
+        if (bg == nullptr) {
+            return search_bit_go<N + 1>(g, move);
+        }
+        search(*bg, move);
+        return true;
+    }
+}
+
+void AlphaBetaMove::set_threads(uint32_t n_threads) {
+    GO_ASSERT(n_threads >= 1, "AlphaBetaMove needs at least one thread");
+
+    threads.clear();
+    for (uint32_t i = 0; i < n_threads; i++) {
+        // tile indices of both Go and BitGo are less than the number of tiles
+        // on Go's padded board
+        threads.emplace_back((game.width() + 2) * (game.height() + 2));
+        threads.back().helper = i != 0;
+    }
+}
 
+MoveStatus AlphaBetaMove::next_move(GameMove & move) {
+
+    if (game.game_over()) {
+        getch();
+        return failed;
+    }
+
+    Game & g = game.strip();
+    Go * go = dynamic_cast<Go *>(&g);
+    if (go != nullptr) {
+        search(*go, move);
+    }
+    else {
+        GO_ASSERT(search_bit_go<1>(g, move), "AlphaBetaMove can only play "
+                "Go or square BitGo up to %ux%u", max_bit_go_size,
+                max_bit_go_size);
+    }
+
+    return ok;
+}
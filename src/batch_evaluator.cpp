@@ -0,0 +1,243 @@
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <batch_evaluator.h>
+#include <eval_cache.h>
+
+
+BatchEvaluator::BatchEvaluator(Network & net, uint32_t batch_size,
+        std::chrono::microseconds timeout, Encoder encoder) : net(net),
+        encoder(encoder), batch_size(batch_size), timeout(timeout),
+        cache(nullptr), stopping(false), n_positions(0), n_batches(0),
+        max_queue_depth(0), latencies(latency_window),
+        batch_input((size_t) batch_size * net.input_size()) {
+    GO_ASSERT(batch_size > 0, "batch size must be positive");
+    GO_ASSERT(net.n_outputs() == 2 && net.output_size(0) == 1, "network "
+            "must output a value and a policy");
+    worker = std::thread(&BatchEvaluator::run_worker, this);
+}
+
+BatchEvaluator::~BatchEvaluator() {
+    {
+        std::lock_guard<std::mutex> l(lock);
+        stopping = true;
+    }
+    work_cv.notify_one();
+    worker.join();
+}
+
+
+void BatchEvaluator::encode_stones(const Go & g, float * input) {
+    Color player = g.get_player();
+    float black_to_move = player == Color::black ? 1.f : 0.f;
+    for (coord_t y = 0; y < g.height(); y++) {
+        for (coord_t x = 0; x < g.width(); x++) {
+            Color tile = g.tile_at(x, y);
+            bool empty = tile != Color::black && tile != Color::white;
+            input[0] = tile == player;
+            input[1] = !empty && tile != player;
+            input[2] = empty;
+            input[3] = black_to_move;
+            input += 4;
+        }
+    }
+}
+
+
+void BatchEvaluator::softmax_priors(const Go & g, const float * logits,
+        const board_idx_t * moves, uint32_t n_moves, float * priors) {
+    if (n_moves == 0) {
+        return;
+    }
+    uint32_t n_tiles = g.width() * g.height();
+
+    float min_logit = INFINITY;
+    for (uint32_t i = 0; i < n_moves; i++) {
+        if (moves[i] != Go::no_position) {
+            board_idx_t idx = moves[i];
+            priors[i] = logits[g.idx_y(idx) * g.width() + g.idx_x(idx)];
+            min_logit = std::min(min_logit, priors[i]);
+        }
+    }
+    float pass_logit = !std::isnan(logits[n_tiles]) ? logits[n_tiles] :
+        min_logit != INFINITY ? min_logit : 0.f;
+
+    float max_logit = -INFINITY;
+    for (uint32_t i = 0; i < n_moves; i++) {
+        if (moves[i] == Go::no_position) {
+            priors[i] = pass_logit;
+        }
+        max_logit = std::max(max_logit, priors[i]);
+    }
+    float sum = 0.f;
+    for (uint32_t i = 0; i < n_moves; i++) {
+        priors[i] = std::exp(priors[i] - max_logit);
+        sum += priors[i];
+    }
+    for (uint32_t i = 0; i < n_moves; i++) {
+        priors[i] /= sum;
+    }
+}
+
+
+void BatchEvaluator::read_outputs(Request & r, uint32_t b,
+        std::vector<float> & logits) const {
+    const Go & g = *r.g;
+    uint32_t n_tiles = g.width() * g.height();
+    uint32_t policy_size = net.output_size(1);
+
+    const float * out = net.output(1) + (size_t) b * policy_size;
+    logits.assign(out, out + policy_size);
+    // NaN stands for the missing pass logit, as in the cache
+    logits.resize(n_tiles + 1, NAN);
+
+    r.value = net.output(0)[b];
+    softmax_priors(g, logits.data(), r.moves, r.n_moves, r.priors);
+    if (r.cache != nullptr) {
+        r.cache->insert(g, r.key, r.value, logits.data());
+    }
+}
+
+
+void BatchEvaluator::run_worker() {
+    uint32_t input_size = net.input_size();
+    std::vector<Request *> batch;
+    batch.reserve(batch_size);
+    std::vector<float> logits;
+
+    std::unique_lock<std::mutex> l(lock);
+    while (true) {
+        work_cv.wait(l, [&]() { return stopping || !queue.empty(); });
+        if (queue.empty()) {
+            break;
+        }
+
+        // wait for a full batch, or for the oldest position to time out
+        auto deadline = queue.front()->submitted + timeout;
+        work_cv.wait_until(l, deadline, [&]() {
+                return stopping || queue.size() >= batch_size;
+            });
+
+        uint32_t n = std::min<size_t>(queue.size(), batch_size);
+        batch.assign(queue.begin(), queue.begin() + n);
+        queue.erase(queue.begin(), queue.begin() + n);
+        l.unlock();
+
+        for (uint32_t b = 0; b < n; b++) {
+            memcpy(&batch_input[(size_t) b * input_size], batch[b]->input,
+                    input_size * sizeof(float));
+        }
+        // anything thrown here would terminate the program from this
+        // thread, so it's handed to the threads waiting on the batch instead
+        std::exception_ptr error;
+        try {
+            net.forward(batch_input.data(), n);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        for (uint32_t b = 0; b < n; b++) {
+            if (error) {
+                batch[b]->error = error;
+                continue;
+            }
+            try {
+                read_outputs(*batch[b], b, logits);
+            } catch (...) {
+                batch[b]->error = std::current_exception();
+            }
+        }
+
+        l.lock();
+        auto now = std::chrono::steady_clock::now();
+        for (Request * r : batch) {
+            latencies[n_positions++ % latency_window] = (uint32_t)
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                        now - r->submitted).count();
+            r->done = true;
+        }
+        n_batches++;
+        done_cv.notify_all();
+    }
+}
+
+
+float BatchEvaluator::evaluate(const Game & g, const board_idx_t * moves,
+        uint32_t n_moves, float * priors) {
+    const Go * go = dynamic_cast<const Go *>(&g);
+    GO_ASSERT(go != nullptr, "BatchEvaluator can only evaluate Go");
+    uint32_t n_tiles = go->width() * go->height();
+    uint32_t policy_size = net.output_size(1);
+    GO_ASSERT(policy_size == n_tiles || policy_size == n_tiles + 1, "policy "
+            "of %u logits for a %ux%u board", policy_size, go->width(),
+            go->height());
+
+    // the cache may be changed while this position is queued
+    EvalCache * c = cache;
+    EvalCache::Key key = { 0, 0 };
+    if (c != nullptr) {
+        key = c->key(*go);
+        thread_local std::vector<float> logits;
+        logits.resize(c->get_policy_size());
+        float value;
+        if (c->lookup(*go, key, value, logits.data())) {
+            softmax_priors(*go, logits.data(), moves, n_moves, priors);
+            return value;
+        }
+    }
+
+    // each thread encodes its positions into its own buffer, outside the
+    // lock
+    thread_local std::vector<float> input;
+    input.resize(net.input_size());
+    encoder(*go, input.data());
+
+    Request r = { input.data(), go, moves, n_moves, priors, c, key, 0.f,
+        false, nullptr, std::chrono::steady_clock::now() };
+
+    std::unique_lock<std::mutex> l(lock);
+    queue.push_back(&r);
+    max_queue_depth = std::max<uint32_t>(max_queue_depth, queue.size());
+    // the worker only needs waking for the first position of a batch (to
+    // start its timeout) and the last
+    if (queue.size() == 1 || queue.size() == batch_size) {
+        work_cv.notify_one();
+    }
+    done_cv.wait(l, [&]() { return r.done; });
+    if (r.error) {
+        std::rethrow_exception(r.error);
+    }
+    return r.value;
+}
+
+
+BatchEvaluator::Stats BatchEvaluator::get_stats() const {
+    std::lock_guard<std::mutex> l(lock);
+    Stats s;
+    s.positions = n_positions;
+    s.batches = n_batches;
+    s.queue_depth = queue.size();
+    s.max_queue_depth = max_queue_depth;
+    s.fill_ratio = n_batches == 0 ? 0. :
+        (double) n_positions / ((double) n_batches * batch_size);
+
+    std::vector<uint32_t> lat(latencies.begin(), latencies.begin() +
+            std::min<uint64_t>(n_positions, latency_window));
+    std::sort(lat.begin(), lat.end());
+    auto percentile = [&](double p) -> double {
+        return lat.empty() ? 0. : lat[(size_t) (p * (lat.size() - 1))];
+    };
+    s.latency_p50 = percentile(.5);
+    s.latency_p90 = percentile(.9);
+    s.latency_p99 = percentile(.99);
+    return s;
+}
+
+void BatchEvaluator::reset_stats() {
+    std::lock_guard<std::mutex> l(lock);
+    n_positions = 0;
+    n_batches = 0;
+    max_queue_depth = queue.size();
+}
+
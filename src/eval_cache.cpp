@@ -0,0 +1,184 @@
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <eval_cache.h>
+
+
+EvalCache::EvalCache(coord_t w, coord_t h, uint32_t log_entries,
+        uint32_t n_shards) : w(w), h(h), policy_size(w * h + 1),
+        board_words((2 * w * h + 63) / 64), zh(w, h) {
+    GO_ASSERT(n_shards > 0 && (n_shards & (n_shards - 1)) == 0, "number of "
+            "shards (%u) must be a power of 2", n_shards);
+    uint32_t log_shards = __builtin_ctz(n_shards);
+    GO_ASSERT(log_entries >= log_shards, "2^%u entries can't be split into "
+            "%u shards", log_entries, n_shards);
+    log_entries_per_shard = log_entries - log_shards;
+
+    size_t n_entries = ((size_t) 1) << log_entries_per_shard;
+    for (uint32_t i = 0; i < n_shards; i++) {
+        shards.emplace_back(new Shard());
+        Shard & s = *shards.back();
+        s.entries.assign(n_entries, { 0, 0, 0.f, 0 });
+        s.policies.resize(n_entries * policy_size);
+        s.boards.resize(n_entries * board_words);
+        s.lookups = s.hits = s.symmetric_hits = s.inserts = s.size = 0;
+    }
+
+    uint32_t n_tiles = w * h;
+    tile_maps.resize(8 * n_tiles);
+    for (uint32_t s = 0; s < 8; s++) {
+        Symmetry sym = symmetry(s);
+        for (coord_t y = 0; y < h; y++) {
+            for (coord_t x = 0; x < w; x++) {
+                coord_t tx = sym.mirror ? w - x - 1 : x;
+                coord_t ty = y;
+                for (uint32_t r = 0; r < sym.rotations; r++) {
+                    coord_t _x = tx;
+                    tx = w - ty - 1;
+                    ty = _x;
+                }
+                tile_maps[s * n_tiles + y * w + x] = ty * w + tx;
+            }
+        }
+    }
+}
+
+
+/*
+ * the state of a tile in a packed board
+ */
+static uint8_t tile_state(Color c) {
+    return c == Color::ko ? ZobristHash::ko : (uint8_t) c;
+}
+
+bool EvalCache::matches(const Go & g, const uint64_t * board, uint8_t turn,
+        uint32_t s) const {
+    Symmetry sym = symmetry(s);
+    if (turn_of(g) != (turn ^ sym.swap_colors)) {
+        return false;
+    }
+    uint32_t n_tiles = w * h;
+    const uint16_t * map = &tile_maps[(s & 7) * n_tiles];
+    for (uint32_t i = 0; i < n_tiles; i++) {
+        uint8_t tile = (board[i / 32] >> (2 * (i % 32))) & 3;
+        if (sym.swap_colors && (tile == ZobristHash::black ||
+                    tile == ZobristHash::white)) {
+            tile ^= 3;
+        }
+        uint32_t j = map[i];
+        if (tile_state(g.tile_at(j % w, j / w)) != tile) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool EvalCache::lookup(const Go & g, const Key & k, float & value,
+        float * policy) {
+    Shard & sh = shard_of(k.symm);
+    size_t slot = slot_of(k.symm);
+
+    std::lock_guard<std::mutex> l(sh.lock);
+    sh.lookups++;
+    const Entry & e = sh.entries[slot];
+    if (e.key != k.symm) {
+        return false;
+    }
+
+    // the symmetry taking the cached position to g, if there is one (there
+    // may not be if either has a ko, or if the keys collided). Raw hashes of
+    // different boards collide too, so a symmetry they agree on is only taken
+    // once the boards are compared
+    const uint64_t * board = &sh.boards[slot * board_words];
+    uint32_t s = 0;
+    while (s < n_symmetries) {
+        Symmetry sym = symmetry(s);
+        if (ZobristHash::transform(e.raw, sym.mirror, sym.rotations,
+                    sym.swap_colors) == k.raw &&
+                matches(g, board, e.turn, s)) {
+            break;
+        }
+        s++;
+    }
+    if (s == n_symmetries) {
+        return false;
+    }
+
+    sh.hits++;
+    sh.symmetric_hits += s != 0;
+
+    // exchanging colors makes black's wins white's
+    value = symmetry(s).swap_colors ? -e.value : e.value;
+    uint32_t n_tiles = w * h;
+    const float * cached = &sh.policies[slot * policy_size];
+    const uint16_t * map = &tile_maps[(s & 7) * n_tiles];
+    for (uint32_t i = 0; i < n_tiles; i++) {
+        policy[map[i]] = cached[i];
+    }
+    policy[n_tiles] = cached[n_tiles];
+    return true;
+}
+
+
+void EvalCache::insert(const Go & g, const Key & k, float value,
+        const float * policy) {
+    // the board is packed outside the lock
+    thread_local std::vector<uint64_t> board;
+    board.assign(board_words, 0);
+    for (coord_t y = 0; y < h; y++) {
+        for (coord_t x = 0; x < w; x++) {
+            uint32_t i = y * w + x;
+            board[i / 32] |= (uint64_t) tile_state(g.tile_at(x, y)) <<
+                (2 * (i % 32));
+        }
+    }
+
+    Shard & sh = shard_of(k.symm);
+    size_t slot = slot_of(k.symm);
+
+    std::lock_guard<std::mutex> l(sh.lock);
+    Entry & e = sh.entries[slot];
+    sh.size += e.key == 0;
+    sh.inserts++;
+    e = { k.symm, k.raw, value, turn_of(g) };
+    memcpy(&sh.policies[slot * policy_size], policy,
+            policy_size * sizeof(float));
+    memcpy(&sh.boards[slot * board_words], board.data(),
+            board_words * sizeof(uint64_t));
+}
+
+
+EvalCache::Stats EvalCache::get_stats() const {
+    Stats s = {};
+    for (const std::unique_ptr<Shard> & sh : shards) {
+        std::lock_guard<std::mutex> l(sh->lock);
+        s.lookups += sh->lookups;
+        s.hits += sh->hits;
+        s.symmetric_hits += sh->symmetric_hits;
+        s.inserts += sh->inserts;
+        s.size += sh->size;
+        s.capacity += sh->entries.size();
+    }
+    s.hit_rate = s.lookups == 0 ? 0. : (double) s.hits / s.lookups;
+    return s;
+}
+
+void EvalCache::reset_stats() {
+    for (const std::unique_ptr<Shard> & sh : shards) {
+        std::lock_guard<std::mutex> l(sh->lock);
+        sh->lookups = sh->hits = sh->symmetric_hits = sh->inserts = 0;
+    }
+}
+
+void EvalCache::clear() {
+    for (const std::unique_ptr<Shard> & sh : shards) {
+        std::lock_guard<std::mutex> l(sh->lock);
+        std::fill(sh->entries.begin(), sh->entries.end(),
+                Entry{ 0, 0, 0.f, 0 });
+        sh->size = 0;
+    }
+}
+
@@ -0,0 +1,49 @@
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <feature_encoder.h>
+
+
+FeatureEncoder::FeatureEncoder(coord_t w, coord_t h, uint32_t history) :
+        w(w), h(h), history(history) {}
+
+
+template<class T>
+void FeatureEncoder::encode(const Go & g, T * out) const {
+    GO_ASSERT(g.width() == w && g.height() == h, "encoding a %ux%u board for "
+            "a %ux%u network", g.width(), g.height(), w, h);
+
+    uint32_t n = n_planes();
+    T to_move = g.get_player() == Color::black;
+    memset(out, 0, (size_t) position_size() * sizeof(T));
+
+    T * tile = out;
+    for (coord_t y = 0; y < h; y++) {
+        for (coord_t x = 0; x < w; x++) {
+            Color c = g.tile_at(x, y);
+            if (c == Color::black || c == Color::white) {
+                tile[c == Color::black ? black_stones : white_stones] = 1;
+                uint32_t libs = std::min<uint32_t>(g.liberties_at(x, y), 3);
+                tile[liberties_1 + libs - 1] = 1;
+            }
+            else if (c == Color::ko) {
+                tile[ko_point] = 1;
+            }
+            tile[side_to_move] = to_move;
+            tile += n;
+        }
+    }
+
+    for (uint32_t i = 0; i < history; i++) {
+        board_idx_t idx = g.recent_move(i);
+        if (idx != Go::no_position) {
+            out[(g.idx_y(idx) * w + g.idx_x(idx)) * n + last_moves + i] = 1;
+        }
+    }
+}
+
+template void FeatureEncoder::encode<float>(const Go &, float *) const;
+template void FeatureEncoder::encode<int8_t>(const Go &, int8_t *) const;
+
@@ -7,63 +7,36 @@
 
 
 void FileMove::find_moves(const std::string & file_name) {
-    std::string str;
-    std::ifstream f(file_name);
-    std::shared_ptr<std::regex> r;
-    std::shared_ptr<std::sregex_iterator> begin, end;
-    while (1) {
-        if (r == nullptr || (*begin) == (*end)) {
-            if (!std::getline(f, str, ';')) {
-                break;
-            }
+    SgfCollection sgf(file_name);
+    GO_ASSERT(sgf.n_games() > 0, "no game in %s", file_name.c_str());
+    const SgfGame & sg = sgf.game(0);
+    GO_ASSERT(sg.w == game.width() && sg.h == game.height(), "%s is a game "
+            "on a %ux%u board, not %ux%u", file_name.c_str(), sg.w, sg.h,
+            game.width(), game.height());
+    // games are only replayed move by move from the empty board, which setup
+    // stones can't be placed on
+    GO_ASSERT(sgf.setup_begin(sg) == sgf.setup_end(sg), "%s places %zu setup "
+            "stones, which can't be replayed", file_name.c_str(),
+            (size_t) (sgf.setup_end(sg) - sgf.setup_begin(sg)));
 
-            r = std::make_shared<std::regex>("\\s*([^\\[]+)\\[([^\\]]*)\\]");
-            begin = std::make_shared<std::sregex_iterator>(
-                    str.begin(), str.end(), *r);
-            end = std::make_shared<std::sregex_iterator>();
+    GameWithInfo * gi;
+    if ((gi = dynamic_cast<GameWithInfo *>(&this->game))) {
+        gi->set_p1_name(SgfCollection::text(sg.black));
+        gi->set_p2_name(SgfCollection::text(sg.white));
+    }
+
+    for (const SgfMove * sm = sgf.moves_begin(sg); sm != sgf.moves_end(sg);
+            sm++) {
+        GoMove m;
+        if (sm->x == SgfMove::pass) {
+            m.color = Color::pass;
         }
         else {
-
-            std::smatch match = **begin;
-            (*begin)++;
-
-            std::string prop = match[1];
-            GoMove m;
-            if (prop == "B") {
-                m.color = Color::black;
-            }
-            else if (prop == "W") {
-                m.color = Color::white;
-            }
-            else if (prop == "PB") {
-                GameWithInfo * gi;
-                if ((gi = dynamic_cast<GameWithInfo *>(&this->game))) {
-                    gi->set_p1_name(match[2]);
-                }
-                continue;
-            }
-            else if (prop == "PW") {
-                GameWithInfo * gi;
-                if ((gi = dynamic_cast<GameWithInfo *>(&this->game))) {
-                    gi->set_p2_name(match[2]);
-                }
-                continue;
-            }
-            else {
-                continue;
-            }
-
-            std::string coords = match[2];
-            if (coords == "") {
-                m.color = Color::pass;
-            }
-            else {
-                m.x = (coord_t) (coords[0] - 'a');
-                m.y = (coord_t) (coords[1] - 'a');
-            }
-
-            moves.push_back(m);
+            m.color = (Color) sm->color;
+            m.x = sm->x;
+            m.y = sm->y;
         }
+        moves.push_back(m);
     }
 }
 
@@ -0,0 +1,111 @@
+
+#include <cstring>
+#include <stdexcept>
+
+#include <game_record.h>
+
+
+template<class T>
+static void append(std::vector<char> & buf, const T * vals, size_t n) {
+    size_t off = buf.size();
+    buf.resize(off + n * sizeof(T));
+    memcpy(&buf[off], vals, n * sizeof(T));
+}
+
+template<class T>
+static void append_val(std::vector<char> & buf, T val) {
+    append(buf, &val, 1);
+}
+
+template<class T>
+static void read_vals(std::ifstream & f, T * vals, size_t n,
+        const std::string & path) {
+    f.read(reinterpret_cast<char *>(vals), n * sizeof(T));
+    GO_ASSERT(f, "unexpected end of game record file %s", path.c_str());
+}
+
+
+GameRecordWriter::GameRecordWriter(const std::string & path) : path(path),
+        f(path, std::ios::binary) {
+    GO_ASSERT(f, "could not open game record file %s", path.c_str());
+    append_val(buf, file_magic);
+    append_val(buf, file_version);
+    f.write(buf.data(), buf.size());
+}
+
+void GameRecordWriter::write(const GameRecord & r) {
+    GO_ASSERT(r.moves.size() <= 0xffff, "game of %zu moves is too long to "
+            "record", r.moves.size());
+    GO_ASSERT(r.visit_start.size() == r.moves.size() + 1, "visits of %zu "
+            "moves recorded for a game of %zu", r.visit_start.size() - 1,
+            r.moves.size());
+
+    std::lock_guard<std::mutex> l(lock);
+    buf.clear();
+    append_val(buf, (uint8_t) r.w);
+    append_val(buf, (uint8_t) r.h);
+    append_val(buf, (uint16_t) r.moves.size());
+    append_val(buf, r.score);
+    append_val(buf, (uint32_t) r.visit_moves.size());
+    append(buf, r.moves.data(), r.moves.size());
+    for (size_t i = 0; i < r.moves.size(); i++) {
+        append_val(buf, (uint16_t) (r.visit_start[i + 1] - r.visit_start[i]));
+    }
+    append(buf, r.visit_moves.data(), r.visit_moves.size());
+    append(buf, r.visit_counts.data(), r.visit_counts.size());
+
+    f.write(buf.data(), buf.size());
+    GO_ASSERT(f, "failed to write game record file %s", path.c_str());
+}
+
+void GameRecordWriter::flush() {
+    std::lock_guard<std::mutex> l(lock);
+    f.flush();
+}
+
+
+GameRecordReader::GameRecordReader(const std::string & path) : path(path),
+        f(path, std::ios::binary) {
+    GO_ASSERT(f, "could not open game record file %s", path.c_str());
+    uint32_t header[2];
+    read_vals(f, header, 2, path);
+    GO_ASSERT(header[0] == GameRecordWriter::file_magic, "%s is not a game "
+            "record file", path.c_str());
+    GO_ASSERT(header[1] == GameRecordWriter::file_version, "game record file "
+            "%s has version %u, expected %u", path.c_str(), header[1],
+            GameRecordWriter::file_version);
+}
+
+bool GameRecordReader::next(GameRecord & r) {
+    uint8_t size[2];
+    f.read(reinterpret_cast<char *>(size), 2);
+    if (f.gcount() == 0 && f.eof()) {
+        return false;
+    }
+    GO_ASSERT(f, "unexpected end of game record file %s", path.c_str());
+
+    uint16_t n_moves;
+    uint32_t n_visits;
+    r.clear(size[0], size[1]);
+    read_vals(f, &n_moves, 1, path);
+    read_vals(f, &r.score, 1, path);
+    read_vals(f, &n_visits, 1, path);
+
+    r.moves.resize(n_moves);
+    read_vals(f, r.moves.data(), n_moves, path);
+    std::vector<uint16_t> n_entries(n_moves);
+    read_vals(f, n_entries.data(), n_moves, path);
+    for (uint16_t n : n_entries) {
+        r.visit_start.push_back(r.visit_start.back() + n);
+    }
+    GO_ASSERT(r.visit_start.back() == n_visits, "record in %s has %u visit "
+            "entries, but its moves have %u", path.c_str(), n_visits,
+            r.visit_start.back());
+
+    r.visit_moves.resize(n_visits);
+    r.visit_counts.resize(n_visits);
+    read_vals(f, r.visit_moves.data(), n_visits, path);
+    read_vals(f, r.visit_counts.data(), n_visits, path);
+    return true;
+}
+
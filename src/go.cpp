@@ -9,6 +9,7 @@
 #include <set>
 
 #include <go.h>
+#include <zobrist.h>
 
 #include <fun/print_colors.h>
 #include <util/util.h>
@@ -135,6 +136,77 @@ struct __attribute__((aligned(sizeof(uint64_t)))) TileString {
 
 
 
+/*
+ * copy of a tile saved to the undo journal before it was modified
+ */
+struct TileRecord {
+    board_idx_t idx;
+    Tile tile;
+};
+
+/*
+ * copy of a string saved to the undo journal before it was modified
+ */
+struct StringRecord {
+    uint32_t string_idx;
+    TileString str;
+};
+
+/*
+ * the state of the game before a move was played, along with where that
+ * move's records begin in the tile and string journals
+ */
+struct UndoFrame {
+    uint32_t tile_start;
+    uint32_t string_start;
+
+    int free_strings;
+    uint32_t black_captures, white_captures;
+
+    board_idx_t last_move;
+    board_idx_t ko_move;
+
+    // the tile that was played on, or no_position if the move was a pass
+    board_idx_t move;
+
+    zob_hash_t zob_raw;
+    zob_hash_t position_key;
+    bitboard_t stones[2];
+};
+
+
+/*
+ * random keys for each state of each tile of the largest padded board, from
+ * which Go::position_key is built. Empty and ko tiles have no key, so the
+ * key only depends on where the stones are
+ */
+struct PositionKeys {
+    static constexpr uint32_t n_tiles = (Go::max_size + 2) * (Go::max_size + 2);
+
+    zob_hash_t keys[n_tiles * ZobristHash::num_states];
+
+    constexpr PositionKeys() : keys() {
+        // splitmix64, so the keys are the same in every build
+        uint64_t x = 0;
+        for (uint32_t i = 0; i < n_tiles; i++) {
+            for (uint32_t state = 0; state < ZobristHash::num_states; state++) {
+                if (state != ZobristHash::black && state != ZobristHash::white) {
+                    continue;
+                }
+                x += 0x9e3779b97f4a7c15llu;
+                uint64_t z = x;
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9llu;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebllu;
+                keys[ZobristHash::num_states * i + state] = z ^ (z >> 31);
+            }
+        }
+    }
+};
+
+static constexpr PositionKeys position_keys;
+
+
+
 board_idx_t Go::to_idx(coord_t x, coord_t y) const {
     return (y + 1) * (this->w + 2) + (x + 1);
 }
@@ -187,6 +259,32 @@ bool Go::is_stone(board_idx_t idx) const {
     return (col ^ (col >> 1)) & 1;
 }
 
+bool Go::is_eye(board_idx_t idx, Color color) const {
+    // the border is gray, which matches either color
+    if (!color_matches(idx_up(idx), color) ||
+            !color_matches(idx_left(idx), color) ||
+            !color_matches(idx_right(idx), color) ||
+            !color_matches(idx_down(idx), color)) {
+        return false;
+    }
+
+    // the eye is false if the opponent holds two of its diagonals, or one on
+    // the edge of the board, where the eye can be captured in turn
+    Color o = other_color(color);
+    board_idx_t diag[4] = {
+        idx_left(idx_up(idx)), idx_right(idx_up(idx)),
+        idx_left(idx_down(idx)), idx_right(idx_down(idx))
+    };
+    uint32_t n_bad = 0;
+    uint32_t n_border = 0;
+    for (board_idx_t d : diag) {
+        Color c = tiles[d].color();
+        n_bad += c == o;
+        n_border += c == Color::gray;
+    }
+    return n_bad + (n_border != 0) < 2;
+}
+
 
 void Go::mark_free_tile(board_idx_t idx) {
     Tile & t = tiles[idx];
@@ -407,6 +505,8 @@ void Go::erase_string(uint32_t string_idx) {
     tile = s.first_tile;
     do {
         tiles[tile].set_color(Color::empty);
+        zob_tile(tile, color, Color::empty);
+        bb_toggle(tile, color);
         add_liberties(tile, color);
         tile = tiles[tile].next_tile;
     } while (tile != s.first_tile);
@@ -660,9 +760,10 @@ void Go::append_string(board_idx_t idx, Color color, uint32_t string_idx) {
 
         static_assert(TileString::tracked_liberties == 8);
         // we know TileString's are aligned by 8 bytes, so we can copy the
-        // entirety of liberty_list with two 8-byte memory transfers
-        *((uint64_t *) &pop_queue[0]) = *((uint64_t *) &s.liberty_list[0]);
-        *((uint64_t *) &pop_queue[4]) = *((uint64_t *) &s.liberty_list[4]);
+        // entirety of liberty_list with two 8-byte memory transfers (done
+        // through memcpy, since casting to uint64_t * breaks strict aliasing)
+        __builtin_memcpy(pop_queue, s.liberty_list,
+                TileString::tracked_liberties * sizeof(board_idx_t));
 
         s.liberties = liberty_list_merge(s.liberty_list,
                 TileString::tracked_liberties,
@@ -818,9 +919,10 @@ void Go::join_strings(uint32_t s1, uint32_t s2) {
 
         static_assert(TileString::tracked_liberties == 8);
         // we know TileString's are aligned by 8 bytes, so we can copy the
-        // entirety of liberty_list with two 8-byte memory transfers
-        *((uint64_t *) &s1_buf[0]) = *((uint64_t *) &str1.liberty_list[0]);
-        *((uint64_t *) &s1_buf[4]) = *((uint64_t *) &str1.liberty_list[4]);
+        // entirety of liberty_list with two 8-byte memory transfers (done
+        // through memcpy, since casting to uint64_t * breaks strict aliasing)
+        __builtin_memcpy(s1_buf, str1.liberty_list,
+                TileString::tracked_liberties * sizeof(board_idx_t));
 
         str1.liberties = liberty_list_merge(str1.liberty_list,
                 TileString::tracked_liberties,
@@ -1064,6 +1166,19 @@ void Go::_do_play(board_idx_t idx, Color color) {
     uint32_t first_string_idx = -1;
     uint8_t n_string_joins = 0;
     uint32_t n_captures = 0, str_idx;
+    // strings which will be captured, so a string adjacent to this tile in
+    // multiple directions is only counted once
+    uint32_t captured[4];
+    uint8_t n_captured = 0;
+    auto count_capture = [&](uint32_t str_idx) {
+        for (uint8_t i = 0; i < n_captured; i++) {
+            if (captured[i] == str_idx) {
+                return;
+            }
+        }
+        captured[n_captured++] = str_idx;
+        n_captures += strings[str_idx].size;
+    };
 
     Color o = other_color(color);
 
@@ -1077,7 +1192,7 @@ void Go::_do_play(board_idx_t idx, Color color) {
     }
     else if (tiles[n].color() == o &&
             strings[(str_idx = tiles[n].string_idx())].liberties == 1) {
-        n_captures += strings[str_idx].size;
+        count_capture(str_idx);
     }
 
     n = idx_left(idx);
@@ -1088,7 +1203,7 @@ void Go::_do_play(board_idx_t idx, Color color) {
     }
     else if (tiles[n].color() == o &&
             strings[(str_idx = tiles[n].string_idx())].liberties == 1) {
-        n_captures += strings[str_idx].size;
+        count_capture(str_idx);
     }
 
     n = idx_right(idx);
@@ -1099,7 +1214,7 @@ void Go::_do_play(board_idx_t idx, Color color) {
     }
     else if (tiles[n].color() == o &&
             strings[(str_idx = tiles[n].string_idx())].liberties == 1) {
-        n_captures += strings[str_idx].size;
+        count_capture(str_idx);
     }
 
     n = idx_down(idx);
@@ -1110,7 +1225,7 @@ void Go::_do_play(board_idx_t idx, Color color) {
     }
     else if (tiles[n].color() == o &&
             strings[(str_idx = tiles[n].string_idx())].liberties == 1) {
-        n_captures += strings[str_idx].size;
+        count_capture(str_idx);
     }
 
     board_idx_t new_ko_pos = no_position;
@@ -1147,9 +1262,18 @@ void Go::_do_play(board_idx_t idx, Color color) {
         merge_strings_around(idx, color, first_string_idx);
     }
 
+    zob_tile(idx, Color::empty, color);
+    bb_toggle(idx, color);
+
     subtract_liberties(idx, color);
 
     // record the new ko position (if there was one)
+    if (ko_move != no_position) {
+        zob_tile(ko_move, ZobristHash::ko, ZobristHash::empty);
+    }
+    if (new_ko_pos != no_position) {
+        zob_tile(new_ko_pos, ZobristHash::empty, ZobristHash::ko);
+    }
     ko_move = new_ko_pos;
 
     // add captures
@@ -1162,6 +1286,200 @@ void Go::_do_play(board_idx_t idx, Color color) {
 }
 
 
+void Go::reserve_journal() {
+    uint32_t n_moves = 2 * this->w * this->h;
+    frames.reserve(n_moves);
+    tile_journal.reserve(4 * n_moves);
+    string_journal.reserve(4 * n_moves);
+}
+
+
+void Go::journal_tile(board_idx_t idx) {
+    tile_journal.push_back({ idx, tiles[idx] });
+}
+
+
+void Go::journal_string(uint32_t string_idx) {
+    string_journal.push_back({ string_idx, strings[string_idx] });
+}
+
+
+void Go::journal_string_tiles(uint32_t string_idx) {
+    board_idx_t first_tile = strings[string_idx].first_tile;
+    board_idx_t tile = first_tile;
+    do {
+        journal_tile(tile);
+        tile = tiles[tile].next_tile;
+    } while (tile != first_tile);
+}
+
+
+void Go::journal_capture(uint32_t string_idx, Color color) {
+    board_idx_t first_tile = strings[string_idx].first_tile;
+    board_idx_t tile = first_tile;
+    do {
+        journal_tile(tile);
+
+        board_idx_t n;
+        FOR_EACH_ADJ(tile, n, {
+            if (tiles[n].color() == color) {
+                journal_string(tiles[n].string_idx());
+            }
+        });
+
+        tile = tiles[tile].next_tile;
+    } while (tile != first_tile);
+}
+
+
+void Go::journal_play(board_idx_t idx, Color color) {
+    board_idx_t n;
+    // strings adjacent to idx which have already been journaled, so strings
+    // touching idx from multiple directions are only saved once
+    uint32_t seen[Tile::num_neighbors];
+    uint8_t n_seen = 0;
+
+    journal_tile(idx);
+
+    // place_lone_tile may allocate the string at the head of the free list
+    if (((uint32_t) this->free_strings) != TileString::no_string) {
+        journal_string(this->free_strings);
+    }
+
+    FOR_EACH_ADJ(idx, n, {
+        if (is_stone(n)) {
+            uint32_t str_idx = tiles[n].string_idx();
+            bool dup = false;
+            for (uint8_t i = 0; i < n_seen; i++) {
+                dup |= seen[i] == str_idx;
+            }
+            if (!dup) {
+                seen[n_seen++] = str_idx;
+                journal_string(str_idx);
+
+                if (tiles[n].color() == color) {
+                    // friendly strings are relinked when idx is merged
+                    // into them
+                    journal_string_tiles(str_idx);
+                }
+                else if (strings[str_idx].liberties == 1) {
+                    journal_capture(str_idx, color);
+                }
+            }
+        }
+    });
+}
+
+
+void Go::push_move(board_idx_t idx, Color color) {
+    UndoFrame f;
+    f.tile_start = tile_journal.size();
+    f.string_start = string_journal.size();
+    f.free_strings = this->free_strings;
+    f.black_captures = this->black_captures;
+    f.white_captures = this->white_captures;
+    f.last_move = this->last_move;
+    f.ko_move = this->ko_move;
+    f.move = idx;
+    f.zob_raw = this->zob_raw;
+    f.position_key = this->position_key;
+    f.stones[0] = this->stones[0];
+    f.stones[1] = this->stones[1];
+    frames.push_back(f);
+
+    uint8_t prev_turn_idx = zob_turn_idx();
+
+    if (color == pass) {
+        // pass
+        this->last_move = last_move == one_pass ? two_passes : one_pass;
+    }
+    else {
+        journal_play(idx, color);
+        this->_do_play(idx, color);
+        this->last_move = idx;
+    }
+    this->turn++;
+
+    if (zh != nullptr) {
+        zob_raw ^= zob_turns[prev_turn_idx] ^ zob_turns[zob_turn_idx()];
+    }
+    // passing leaves the stones where they were, so only moves which place
+    // a stone make a new position
+    if (superko && color != pass) {
+        positions.insert(position_key);
+    }
+}
+
+
+void Go::zob_tile(board_idx_t idx, uint8_t from, uint8_t to) {
+    if (zh != nullptr) {
+        zob_raw ^= zob_tiles[ZobristHash::num_states * idx + from] ^
+            zob_tiles[ZobristHash::num_states * idx + to];
+    }
+    position_key ^= position_keys.keys[ZobristHash::num_states * idx + from] ^
+        position_keys.keys[ZobristHash::num_states * idx + to];
+}
+
+
+uint8_t Go::zob_turn_idx() const {
+    return (get_player() == white) + (has_passed() << 1);
+}
+
+bool Go::repeats_position(board_idx_t idx) {
+    push_move(idx, get_player());
+    bool repeats = superko_violation();
+    pop_move();
+    return repeats;
+}
+
+void Go::rebuild_positions() {
+    // take back every move without touching positions, then replay them,
+    // which inserts each position as it is reached
+    bool was_superko = superko;
+    superko = false;
+    std::vector<board_idx_t> moves;
+    while (!frames.empty()) {
+        moves.push_back(pop_move());
+    }
+    superko = was_superko;
+
+    positions.clear();
+    positions.insert(position_key);
+    for (size_t i = moves.size(); i > 0; i--) {
+        board_idx_t idx = moves[i - 1];
+        push_move(idx, idx == no_position ? pass : get_player());
+    }
+}
+
+
+void Go::init_bitboards() {
+    this->use_bitboards = this->n_tiles <= bitboard_bits;
+    this->stones[0] = 0;
+    this->stones[1] = 0;
+    this->board_mask = 0;
+    if (!use_bitboards) {
+        return;
+    }
+
+    for (coord_t y = 0; y < this->h; y++) {
+        for (coord_t x = 0; x < this->w; x++) {
+            board_idx_t idx = to_idx(x, y);
+            board_mask |= bb_bit(idx);
+            if (is_stone(idx)) {
+                bb_toggle(idx, tiles[idx].color());
+            }
+        }
+    }
+}
+
+
+void Go::bb_toggle(board_idx_t idx, Color color) {
+    if (use_bitboards) {
+        stones[color - Color::black] ^= bb_bit(idx);
+    }
+}
+
+
 bool Go::is_star_tile(coord_t x, coord_t y) const {
     if (this->w == 19 && this->h == 19) {
         return (x == 3 || x == 9 || x == 15) &&
@@ -1342,12 +1660,16 @@ void Go::_print_dbg(std::ostream & o,
 
 
 
-Go::Go() : g_data(nullptr) {
+Go::Go() : g_data(nullptr), zh(nullptr), zob_tiles(nullptr),
+        zob_turns(nullptr), zob_raw(0), position_key(0), superko(false),
+        use_bitboards(false) {
 }
 
 
 Go::Go(coord_t w, coord_t h) : w(w), h(h), turn(0), last_move(0),
-        ko_move(no_position), black_captures(0), white_captures(0) {
+        ko_move(no_position), black_captures(0), white_captures(0),
+        zh(nullptr), zob_tiles(nullptr), zob_turns(nullptr), zob_raw(0),
+        position_key(0), superko(false) {
     // includes the borders
     this->n_tiles = (this->w + 2) * (this->h + 2);
     this->max_n_strings = this->calc_max_n_strings();
@@ -1358,25 +1680,42 @@ Go::Go(coord_t w, coord_t h) : w(w), h(h), turn(0), last_move(0),
     g_data = malloc(g_data_size + Go::g_data_alignment);
     this->__assign_memory();
     this->clear();
+    this->init_bitboards();
+    this->reserve_journal();
 }
 
 
 Go::Go(const Go & g) : w(g.w), h(g.h), turn(g.turn), last_move(g.last_move),
         ko_move(g.ko_move), g_data_size(g.g_data_size), n_tiles(g.n_tiles),
         max_n_strings(g.max_n_strings), free_strings(g.free_strings),
-        black_captures(g.black_captures), white_captures(g.white_captures) {
+        black_captures(g.black_captures), white_captures(g.white_captures),
+        frames(g.frames), tile_journal(g.tile_journal),
+        string_journal(g.string_journal), redo_moves(g.redo_moves),
+        zh(g.zh), zob_tiles(g.zob_tiles), zob_turns(g.zob_turns),
+        zob_raw(g.zob_raw), position_key(g.position_key), superko(g.superko),
+        positions(g.positions), use_bitboards(g.use_bitboards),
+        stones{ g.stones[0], g.stones[1] }, board_mask(g.board_mask) {
     this->g_data = malloc(g_data_size + Go::g_data_alignment);
     this->__assign_memory();
     __builtin_memcpy(this->tiles, g.tiles, n_tiles * sizeof(Tile));
     __builtin_memcpy(this->strings, g.strings,
             max_n_strings * sizeof(TileString));
+    this->reserve_journal();
 }
 
 
 Go::Go(Go && g) : w(g.w), h(g.h), turn(g.turn), last_move(g.last_move),
         ko_move(g.ko_move), g_data_size(g.g_data_size), n_tiles(g.n_tiles),
         max_n_strings(g.max_n_strings), free_strings(g.free_strings),
-        black_captures(g.black_captures), white_captures(g.white_captures) {
+        black_captures(g.black_captures), white_captures(g.white_captures),
+        frames(std::move(g.frames)), tile_journal(std::move(g.tile_journal)),
+        string_journal(std::move(g.string_journal)),
+        redo_moves(std::move(g.redo_moves)), zh(g.zh),
+        zob_tiles(g.zob_tiles), zob_turns(g.zob_turns), zob_raw(g.zob_raw),
+        position_key(g.position_key), superko(g.superko),
+        positions(std::move(g.positions)),
+        use_bitboards(g.use_bitboards), stones{ g.stones[0], g.stones[1] },
+        board_mask(g.board_mask) {
 
     g_data = g.g_data;
     tiles = g.tiles;
@@ -1388,6 +1727,10 @@ Go::Go(Go && g) : w(g.w), h(g.h), turn(g.turn), last_move(g.last_move),
 
 
 Go & Go::operator=(const Go & g) {
+    // a copy of a game of the same size can keep its memory, so playouts
+    // can refill a scratch game from the search's game without allocating
+    bool reuse_memory = g_data != nullptr && g_data_size == g.g_data_size;
+
     w = g.w;
     h = g.h;
     turn = g.turn;
@@ -1399,11 +1742,28 @@ Go & Go::operator=(const Go & g) {
     free_strings = g.free_strings;
     black_captures = g.black_captures;
     white_captures = g.white_captures;
-
-    if (g_data) {
-        free(g_data);
+    frames = g.frames;
+    tile_journal = g.tile_journal;
+    string_journal = g.string_journal;
+    redo_moves = g.redo_moves;
+    zh = g.zh;
+    zob_tiles = g.zob_tiles;
+    zob_turns = g.zob_turns;
+    zob_raw = g.zob_raw;
+    position_key = g.position_key;
+    superko = g.superko;
+    positions = g.positions;
+    use_bitboards = g.use_bitboards;
+    stones[0] = g.stones[0];
+    stones[1] = g.stones[1];
+    board_mask = g.board_mask;
+
+    if (!reuse_memory) {
+        if (g_data) {
+            free(g_data);
+        }
+        this->g_data = malloc(g_data_size + Go::g_data_alignment);
     }
-    this->g_data = malloc(g_data_size + Go::g_data_alignment);
     this->__assign_memory();
     __builtin_memcpy(this->tiles, g.tiles, n_tiles * sizeof(Tile));
     __builtin_memcpy(this->strings, g.strings,
@@ -1429,6 +1789,21 @@ Go & Go::operator=(Go && g) {
     free_strings = g.free_strings;
     black_captures = g.black_captures;
     white_captures = g.white_captures;
+    frames = std::move(g.frames);
+    tile_journal = std::move(g.tile_journal);
+    string_journal = std::move(g.string_journal);
+    redo_moves = std::move(g.redo_moves);
+    zh = g.zh;
+    zob_tiles = g.zob_tiles;
+    zob_turns = g.zob_turns;
+    zob_raw = g.zob_raw;
+    position_key = g.position_key;
+    superko = g.superko;
+    positions = std::move(g.positions);
+    use_bitboards = g.use_bitboards;
+    stones[0] = g.stones[0];
+    stones[1] = g.stones[1];
+    board_mask = g.board_mask;
 
     if (g_data) {
         free(g_data);
@@ -1464,6 +1839,18 @@ Color Go::tile_at(coord_t x, coord_t y) const {
 }
 
 
+uint32_t Go::liberties_at(coord_t x, coord_t y) const {
+    board_idx_t idx = to_idx(x, y);
+    return is_stone(idx) ? num_liberties(idx) : 0;
+}
+
+
+board_idx_t Go::recent_move(uint32_t n) const {
+    return n < frames.size() ? frames[frames.size() - 1 - n].move :
+        no_position;
+}
+
+
 std::shared_ptr<Game> Go::clone() const {
     return std::make_shared<Go>(*this);
 }
@@ -1474,6 +1861,28 @@ bool Go::game_over() const {
 }
 
 int Go::get_score() const {
+    return use_bitboards ? bitboard_score() : uf_score();
+}
+
+int Go::bitboard_score() const {
+    uint32_t row_width = this->w + 2;
+    bitboard_t empty = board_mask & ~(stones[0] | stones[1]);
+
+    // the empty tiles reachable from black and white stones, respectively.
+    // The border is never in empty, so flooding can't wrap around between
+    // rows
+    bitboard_t b_reach = bb_flood(bb_dilate(stones[0], row_width) & empty,
+            empty, row_width);
+    bitboard_t w_reach = bb_flood(bb_dilate(stones[1], row_width) & empty,
+            empty, row_width);
+
+    // empty regions touching only one color belong to that color
+    int score = ((int) bb_popcount(b_reach & ~w_reach)) -
+        ((int) bb_popcount(w_reach & ~b_reach));
+    return score + black_captures - white_captures;
+}
+
+int Go::uf_score() const {
     union_find uf;
     uf_init(&uf, (this->w + 2) * (this->h + 2));
 
@@ -1598,8 +2007,34 @@ bool Go::has_passed() const {
     return last_move == one_pass;
 }
 
+void Go::set_zobrist(const ZobristHash * zh) {
+    this->zh = zh;
+    if (zh != nullptr) {
+        GO_ASSERT(this->w == zh->width() && this->h == zh->height(),
+                "Zobrist hash is for a different board size");
+        this->zob_tiles = zh->get_padded_table();
+        this->zob_turns = zh->get_turn_hashes();
+        this->zob_raw = zh->compute_raw_hash(*this);
+    }
+    else {
+        this->zob_tiles = nullptr;
+        this->zob_turns = nullptr;
+        this->zob_raw = 0;
+    }
+}
+
+void Go::set_superko(bool on) {
+    superko = on;
+    if (on) {
+        rebuild_positions();
+    }
+    else {
+        positions.clear();
+    }
+}
+
 bool Go::is_current() const {
-    return true;
+    return redo_moves.empty();
 }
 
 void Go::play(GameMove & m) {
@@ -1625,54 +2060,307 @@ void Go::play(GameMove & m) {
                 idx_str(idx).c_str());
     }
 
-    if (gm.color == pass) {
-        // pass
-        this->last_move = last_move == one_pass ? two_passes : one_pass;
-    }
-    else {
-        this->_do_play(idx, gm.color);
-        this->last_move = idx;
+    push_move(gm.color == pass ? no_position : idx, gm.color);
+    if (superko_violation()) {
+        pop_move();
+        GO_ASSERT(false, "move %s repeats an earlier position",
+                idx_str(idx).c_str());
     }
-    this->turn++;
+
+    // playing a new move discards the moves that could have been redone
+    redo_moves.clear();
 }
 
 void Go::undo() {
-    GO_ASSERT(false, "undo not implemented");
+    GO_ASSERT(!frames.empty(), "no moves to undo");
+
+    redo_moves.push_back(pop_move());
+}
+
+board_idx_t Go::pop_move() {
+    const UndoFrame & f = frames.back();
+
+    if (superko && f.move != no_position) {
+        positions.erase(position_key);
+    }
+
+    // restore in reverse order, so if anything was saved more than once, the
+    // oldest copy is the one left in place
+    for (size_t i = tile_journal.size(); i > f.tile_start; i--) {
+        const TileRecord & r = tile_journal[i - 1];
+        tiles[r.idx] = r.tile;
+    }
+    for (size_t i = string_journal.size(); i > f.string_start; i--) {
+        const StringRecord & r = string_journal[i - 1];
+        strings[r.string_idx] = r.str;
+    }
+    tile_journal.resize(f.tile_start);
+    string_journal.resize(f.string_start);
+
+    this->free_strings = f.free_strings;
+    this->black_captures = f.black_captures;
+    this->white_captures = f.white_captures;
+    this->last_move = f.last_move;
+    this->ko_move = f.ko_move;
+    this->zob_raw = f.zob_raw;
+    this->position_key = f.position_key;
+    this->stones[0] = f.stones[0];
+    this->stones[1] = f.stones[1];
+    this->turn--;
+
+    board_idx_t idx = f.move;
+    frames.pop_back();
+    return idx;
 }
 
 void Go::redo() {
-    GO_ASSERT(false, "redo not implemented");
+    GO_ASSERT(!redo_moves.empty(), "no moves to redo");
+
+    board_idx_t idx = redo_moves.back();
+    redo_moves.pop_back();
+    push_move(idx, idx == no_position ? pass : get_player());
 }
 
-void Go::for_each_legal_move(std::function<bool(Game &, GameMove &)> f) {
-    GoMove m;
+bool Go::is_capture(board_idx_t idx, Color color) const {
+    board_idx_t n;
+    Color o = other_color(color);
+    FOR_EACH_ADJ(idx, n, {
+        if (tiles[n].color() == o && num_liberties(n) == 1) {
+            return true;
+        }
+    });
+    return false;
+}
+
+bool Go::is_atari_escape(board_idx_t idx, Color color) const {
+    board_idx_t n;
+    FOR_EACH_ADJ(idx, n, {
+        if (tiles[n].color() == color && num_liberties(n) == 1) {
+            return true;
+        }
+    });
+    return false;
+}
+
+bitboard_t Go::legal_move_mask() const {
+    uint32_t row_width = this->w + 2;
+    bitboard_t empty = board_mask & ~(stones[0] | stones[1]);
+    bitboard_t cand = empty &
+        ~(ko_move == no_position ? 0 : bb_bit(ko_move));
+    Color color = get_player();
+
+    // any empty tile next to another empty tile always has a liberty, so only
+    // the tiles surrounded by stones and the border have to be checked one by
+    // one
+    bitboard_t legal = cand & bb_adjacent(empty, row_width);
+    for (bitboard_t rest = cand & ~legal; rest != 0; rest &= rest - 1) {
+        board_idx_t idx = bb_ctz(rest);
+        if (!move_is_suicide(idx, color)) {
+            legal |= bb_bit(idx);
+        }
+    }
+    return legal;
+}
+
+uint32_t Go::legal_moves(board_idx_t * moves) const {
+    uint32_t n_moves = 0;
 
     if (game_over()) {
-        // cannot play once the game has ended
-        return;
+        return 0;
     }
 
-    m.color = max_player() ? Color::black : Color::white;
+    if (use_bitboards) {
+        for (bitboard_t legal = legal_move_mask(); legal != 0;
+                legal &= legal - 1) {
+            moves[n_moves++] = bb_ctz(legal);
+        }
+        return n_moves;
+    }
 
-    coord_t w = this->w;
-    coord_t h = this->h;
-    for (coord_t y = 0; y < h; y++) {
-        for (coord_t x = 0; x < w; x++) {
+    Color color = get_player();
+    for (coord_t y = 0; y < this->h; y++) {
+        for (coord_t x = 0; x < this->w; x++) {
             board_idx_t idx = to_idx(x, y);
-            if (is_liberty(idx) && !move_is_suicide(idx, m.color) &&
-                    idx != this->ko_move) {
-                m.x = x;
-                m.y = y;
-                if (!f(*this, m)) {
-                    return;
-                }
+            // as in legal_move_mask, only look at the strings around tiles
+            // with no empty neighbors
+            bool has_liberty = is_liberty(idx_up(idx)) |
+                is_liberty(idx_left(idx)) | is_liberty(idx_right(idx)) |
+                is_liberty(idx_down(idx));
+
+            moves[n_moves] = idx;
+            n_moves += is_liberty(idx) && idx != this->ko_move &&
+                (has_liberty || !move_is_suicide(idx, color));
+        }
+    }
+    return n_moves;
+}
+
+void Go::for_each_legal_move(std::function<bool(Game &, GameMove &)> f) {
+    for_each_legal_move_inline(f);
+}
+
+void Go::refill(const Go & g) {
+    if (g_data == nullptr || g_data_size != g.g_data_size) {
+        // a game of another size needs new memory
+        *this = g;
+    }
+    else {
+        w = g.w;
+        h = g.h;
+        turn = g.turn;
+        last_move = g.last_move;
+        ko_move = g.ko_move;
+        n_tiles = g.n_tiles;
+        max_n_strings = g.max_n_strings;
+        free_strings = g.free_strings;
+        black_captures = g.black_captures;
+        white_captures = g.white_captures;
+        use_bitboards = g.use_bitboards;
+        stones[0] = g.stones[0];
+        stones[1] = g.stones[1];
+        board_mask = g.board_mask;
+        __builtin_memcpy(this->tiles, g.tiles, n_tiles * sizeof(Tile));
+        __builtin_memcpy(this->strings, g.strings,
+                max_n_strings * sizeof(TileString));
+    }
+
+    frames.clear();
+    tile_journal.clear();
+    string_journal.clear();
+    redo_moves.clear();
+    set_zobrist(nullptr);
+    if (superko) {
+        set_superko(false);
+    }
+    position_key = g.position_key;
+}
+
+int Go::playout(Xorshift & rng) {
+    // the history no longer matches the board once moves are played without
+    // journaling them
+    frames.clear();
+    tile_journal.clear();
+    string_journal.clear();
+    redo_moves.clear();
+    set_zobrist(nullptr);
+    if (superko) {
+        set_superko(false);
+    }
+
+    // the empty tiles, in no particular order, where the entry for the tile
+    // at idx is empty[empty_pos[idx]]
+    board_idx_t empty[max_legal_moves];
+    board_idx_t empty_pos[(max_size + 2) * (max_size + 2)];
+    uint32_t n_empty = 0;
+    for (coord_t y = 0; y < this->h; y++) {
+        for (coord_t x = 0; x < this->w; x++) {
+            board_idx_t idx = to_idx(x, y);
+            if (is_liberty(idx)) {
+                empty_pos[idx] = n_empty;
+                empty[n_empty++] = idx;
             }
         }
     }
+    auto swap_empty = [&](uint32_t i, uint32_t j) {
+        board_idx_t a = empty[i];
+        board_idx_t b = empty[j];
+        empty[i] = b;
+        empty[j] = a;
+        empty_pos[b] = i;
+        empty_pos[a] = j;
+    };
+    auto add_empty = [&](board_idx_t idx) {
+        empty_pos[idx] = n_empty;
+        empty[n_empty++] = idx;
+    };
+    auto remove_empty = [&](board_idx_t idx) {
+        swap_empty(empty_pos[idx], n_empty - 1);
+        n_empty--;
+    };
+
+    uint32_t max_moves = playout_moves_per_tile * this->w * this->h;
+    for (uint32_t n_moves = 0; last_move != two_passes && n_moves < max_moves;
+            n_moves++) {
+        Color color = get_player();
+        Color o = other_color(color);
+
+        // draw empty tiles until one can be played, moving each one that
+        // can't past the end of the tiles left to draw from
+        board_idx_t move = no_position;
+        for (uint32_t n_cand = n_empty; n_cand > 0; n_cand--) {
+            uint32_t i = rng.below(n_cand);
+            board_idx_t idx = empty[i];
+            if (idx != ko_move && !is_eye(idx, color) &&
+                    !move_is_suicide(idx, color)) {
+                move = idx;
+                break;
+            }
+            swap_empty(i, n_cand - 1);
+        }
 
-    // pass
-    m.color = Color::pass;
-    f(*this, m);
+        if (move == no_position) {
+            this->last_move = last_move == one_pass ? two_passes : one_pass;
+        }
+        else {
+            // the stones of the strings this move captures become empty,
+            // which has to be found before the strings are erased
+            uint32_t captured[Tile::num_neighbors];
+            uint8_t n_captured = 0;
+            board_idx_t n;
+            FOR_EACH_ADJ(move, n, {
+                if (tiles[n].color() == o &&
+                        strings[tiles[n].string_idx()].liberties == 1) {
+                    uint32_t str_idx = tiles[n].string_idx();
+                    bool seen = false;
+                    for (uint8_t i = 0; i < n_captured; i++) {
+                        seen |= captured[i] == str_idx;
+                    }
+                    if (!seen) {
+                        captured[n_captured++] = str_idx;
+                        board_idx_t tile = n;
+                        do {
+                            add_empty(tile);
+                            tile = tiles[tile].next_tile;
+                        } while (tile != n);
+                    }
+                }
+            });
+
+            remove_empty(move);
+            _do_play(move, color);
+            this->last_move = move;
+        }
+        this->turn++;
+    }
+
+    return tromp_taylor_score();
+}
+
+int Go::tromp_taylor_score() const {
+    int score = 0;
+    for (coord_t y = 0; y < this->h; y++) {
+        for (coord_t x = 0; x < this->w; x++) {
+            board_idx_t idx = to_idx(x, y);
+            Color c = tiles[idx].color();
+            if (c == black) {
+                score++;
+            }
+            else if (c == white) {
+                score--;
+            }
+            else {
+                // the colors of the stones around the tile, ignoring the
+                // border
+                uint8_t adj = 0;
+                board_idx_t n;
+                FOR_EACH_ADJ(idx, n, {
+                    adj |= is_stone(n) ? tiles[n].color() : 0;
+                });
+                score += (adj == black) - (adj == white);
+            }
+        }
+    }
+    return score;
 }
 
 
@@ -1904,6 +2592,52 @@ void Go::consistency_check() const {
             }
         }
     }
-}
 
+    GO_ASSERT(zh == nullptr || zob_raw == zh->compute_raw_hash(*this),
+            "incremental Zobrist hash %016llx does not match the board "
+            "%016llx", (unsigned long long) zob_raw,
+            (unsigned long long) zh->compute_raw_hash(*this));
+    zob_hash_t key = 0;
+    for (coord_t y = 0; y < this->h; y++) {
+        for (coord_t x = 0; x < this->w; x++) {
+            board_idx_t idx = to_idx(x, y);
+            key ^= position_keys.keys[ZobristHash::num_states * idx +
+                tiles[idx].color()];
+        }
+    }
+    GO_ASSERT(position_key == key, "incremental position key %016llx does "
+            "not match the board %016llx", (unsigned long long) position_key,
+            (unsigned long long) key);
+    GO_ASSERT(!superko || positions.count(position_key) > 0,
+            "the current position is missing from the superko history");
+
+    if (use_bitboards) {
+        for (int r = 0; r < this->h; r++) {
+            for (int c = 0; c < this->w; c++) {
+                board_idx_t idx = to_idx(c, r);
+                GO_ASSERT(bb_test(stones[0], idx) ==
+                        color_equals(idx, Color::black) &&
+                        bb_test(stones[1], idx) ==
+                        color_equals(idx, Color::white),
+                        "stone bitboards do not match the tile at %s",
+                        idx_str(idx).c_str());
+            }
+        }
 
+        GO_ASSERT(bitboard_score() == uf_score(), "bitboard score %d does "
+                "not match union find score %d", bitboard_score(), uf_score());
+
+        if (!game_over()) {
+            for (int r = 0; r < this->h; r++) {
+                for (int c = 0; c < this->w; c++) {
+                    board_idx_t idx = to_idx(c, r);
+                    bool legal = is_liberty(idx) && idx != ko_move &&
+                        !move_is_suicide(idx, get_player());
+                    GO_ASSERT(bb_test(legal_move_mask(), idx) == legal,
+                            "legal move mask is wrong at %s",
+                            idx_str(idx).c_str());
+                }
+            }
+        }
+    }
+}
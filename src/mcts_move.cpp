@@ -0,0 +1,486 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <thread>
+#include <type_traits>
+
+#include <game_state.h>
+#include <game_with_info.h>
+#include <mcts_move.h>
+
+
+/*
+ * the result of a finished game with the given score to black
+ */
+static float result(int score) {
+    return score > 0 ? 1.f : score < 0 ? -1.f : 0.f;
+}
+
+/*
+ * returns true if playing color at idx would fill in one of its own eyes,
+ * i.e. every tile next to idx is a stone of that color
+ */
+template<class G>
+static bool fills_eye(const G & g, board_idx_t idx, Color color) {
+    coord_t x = g.idx_x(idx);
+    coord_t y = g.idx_y(idx);
+    return (x == 0 || g.tile_at(x - 1, y) == color) &&
+        (x == g.width() - 1 || g.tile_at(x + 1, y) == color) &&
+        (y == 0 || g.tile_at(x, y - 1) == color) &&
+        (y == g.height() - 1 || g.tile_at(x, y + 1) == color);
+}
+
+
+/*
+ * adds v to a, which has no fetch_add for floats before C++20
+ */
+static void atomic_add(std::atomic<float> & a, float v) {
+    float cur = a.load(std::memory_order_relaxed);
+    while (!a.compare_exchange_weak(cur, cur + v, std::memory_order_relaxed)) {
+    }
+}
+
+
+MctsMove::MctsMove(Game & game, uint32_t playouts, float exploration,
+        uint32_t arena_log_size, uint32_t n_threads) :
+        game(game), playouts(playouts), exploration(exploration),
+        evaluator(nullptr), arena(1u << arena_log_size), n_nodes(0),
+        playouts_started(0), reuse(true), tree_game(nullptr),
+        playout_count(0), reused_count(0), verbose(true) {
+    set_threads(n_threads);
+}
+
+uint32_t MctsMove::select_child(const Node & n, uint32_t first) const {
+    float c_sqrt_n = exploration *
+        std::sqrt((float) n.visits.load(std::memory_order_relaxed));
+
+    uint32_t best = first;
+    float best_score = -INFINITY;
+    for (uint32_t i = first; i < first + n.n_children; i++) {
+        const Node & c = arena[i];
+        float score = c.q() + c_sqrt_n * c.prior /
+            (1 + c.visits.load(std::memory_order_relaxed));
+        if (score > best_score) {
+            best_score = score;
+            best = i;
+        }
+    }
+    return best;
+}
+
+uint32_t MctsMove::alloc_children(const board_idx_t * moves,
+        const float * priors, uint32_t n_moves) {
+    uint32_t first = n_nodes.load(std::memory_order_relaxed);
+    do {
+        if (first + n_moves > arena.size()) {
+            return no_node;
+        }
+    } while (!n_nodes.compare_exchange_weak(first, first + n_moves,
+                std::memory_order_relaxed));
+
+    for (uint32_t i = 0; i < n_moves; i++) {
+        arena[first + i].init(moves[i], priors[i]);
+    }
+    return first;
+}
+
+template<class G>
+float MctsMove::evaluate(G & g, SearchThread & t, uint32_t n, bool expand) {
+    if (!expand && evaluator == nullptr) {
+        return random_playout(g, t);
+    }
+
+    board_idx_t moves[Go::max_legal_moves + 1];
+    uint32_t n_moves = 0;
+    g.for_each_legal_move_inline([&](Game &, GoMove & m) -> bool {
+            moves[n_moves++] = m.color == Color::pass ? G::no_position :
+                g.to_idx(m.x, m.y);
+            return true;
+        });
+
+    float priors[Go::max_legal_moves + 1];
+    for (uint32_t i = 0; i < n_moves; i++) {
+        priors[i] = 1.f / n_moves;
+    }
+    float value = evaluator != nullptr ?
+        evaluator->evaluate(g, moves, n_moves, priors) :
+        random_playout(g, t);
+
+    if (expand) {
+        // once the arena is full, the tree stops growing
+        Node & node = arena[n];
+        uint32_t first = alloc_children(moves, priors, n_moves);
+        if (first != no_node) {
+            node.n_children = n_moves;
+        }
+        node.first_child.store(first, std::memory_order_release);
+    }
+    return value;
+}
+
+template<class G>
+float MctsMove::random_playout(G & g, SearchThread & t) {
+    board_idx_t moves[Go::max_legal_moves];
+    uint32_t max_moves = playout_moves_per_tile * g.width() * g.height();
+
+    uint32_t n_played = 0;
+    while (!g.game_over() && n_played < max_moves) {
+        Color color = g.get_player();
+        uint32_t n_moves = g.legal_moves(moves);
+
+        // draw moves at random until one doesn't fill an eye, dropping the
+        // ones that do, and pass if every move fills an eye
+        board_idx_t move = G::no_position;
+        while (n_moves > 0) {
+            uint32_t i = t.rng.below(n_moves);
+            if (!fills_eye(g, moves[i], color)) {
+                move = moves[i];
+                break;
+            }
+            moves[i] = moves[--n_moves];
+        }
+
+        g.play_idx(move);
+        n_played++;
+    }
+
+    float value = result(area_score(g));
+    for (; n_played > 0; n_played--) {
+        g.undo_idx();
+    }
+    return value;
+}
+
+float MctsMove::random_playout(Go & g, SearchThread & t) {
+    if (t.playout_game == nullptr) {
+        t.playout_game = std::make_unique<Go>(g);
+    }
+    else {
+        t.playout_game->refill(g);
+    }
+    int score = t.playout_game->playout(t.rng);
+    // playouts stopped before the end may leave larger empty regions, which
+    // only area_score counts
+    if (!t.playout_game->game_over()) {
+        score = area_score(*t.playout_game);
+    }
+    return result(score);
+}
+
+template<class G>
+void MctsMove::playout(G & g, SearchThread & t) {
+    bool root_black = g.max_player();
+
+    // every node on the way down takes a virtual loss, which is replaced by
+    // the value of the playout on the way back up
+    auto descend = [&](uint32_t n) {
+        arena[n].visits.fetch_add(1, std::memory_order_relaxed);
+        atomic_add(arena[n].value_sum, -1.f);
+        t.path.push_back(n);
+    };
+
+    t.path.clear();
+    uint32_t n = 0;
+    descend(n);
+    while (true) {
+        uint32_t first = arena[n].first_child.load(std::memory_order_acquire);
+        if (first == no_node || first == expanding) {
+            break;
+        }
+        n = select_child(arena[n], first);
+        g.play_idx(arena[n].move);
+        descend(n);
+    }
+
+    float value;
+    if (g.game_over()) {
+        value = result(area_score(g));
+    }
+    else {
+        // a leaf some other thread is expanding is only evaluated
+        uint32_t unexpanded = no_node;
+        bool expand = arena[n].first_child.compare_exchange_strong(
+                unexpanded, expanding, std::memory_order_relaxed);
+        value = evaluate(g, t, n, expand);
+    }
+
+    // the move into the node at depth d (with the root at depth 0) was made
+    // by the player to move at the root when d is odd
+    for (uint32_t d = 0; d < t.path.size(); d++) {
+        bool black_moved = root_black == ((d & 1) == 1);
+        atomic_add(arena[t.path[d]].value_sum,
+                (black_moved ? value : -value) + 1.f);
+    }
+
+    for (uint32_t d = 1; d < t.path.size(); d++) {
+        g.undo_idx();
+    }
+}
+
+/*
+ * returns true if a and b are in the same position, as far as the search can
+ * tell
+ */
+template<class G>
+static bool same_position(const G & a, const G & b) {
+    if (a.width() != b.width() || a.height() != b.height() ||
+            a.get_turn() != b.get_turn() || a.has_passed() != b.has_passed() ||
+            a.game_over() != b.game_over() || a.get_score() != b.get_score()) {
+        return false;
+    }
+    for (coord_t y = 0; y < a.height(); y++) {
+        for (coord_t x = 0; x < a.width(); x++) {
+            if (a.tile_at(x, y) != b.tile_at(x, y)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template<class G>
+uint32_t MctsMove::find_reused_root(const G & g) const {
+    const G * prev = dynamic_cast<const G *>(tree_game.get());
+    if (!reuse || prev == nullptr || g.get_turn() < prev->get_turn() ||
+            g.get_turn() - prev->get_turn() > max_reuse_depth) {
+        return no_node;
+    }
+
+    // walk the tree from the old root along every line as long as the game
+    // has moved on since, looking for the current position
+    G h(*prev);
+    uint32_t depth = g.get_turn() - prev->get_turn();
+    std::function<uint32_t(uint32_t, uint32_t)> find =
+        [&](uint32_t n, uint32_t d) -> uint32_t {
+            if (d == depth) {
+                return same_position(h, g) ? n : no_node;
+            }
+            uint32_t first = arena[n].first_child.load(
+                    std::memory_order_relaxed);
+            if (first >= expanding) {
+                return no_node;
+            }
+            for (uint32_t i = first; i < first + arena[n].n_children; i++) {
+                h.play_idx(arena[i].move);
+                uint32_t found = find(i, d + 1);
+                h.undo_idx();
+                if (found != no_node) {
+                    return found;
+                }
+            }
+            return no_node;
+        };
+    return find(0, 0);
+}
+
+void MctsMove::keep_subtree(uint32_t root) {
+    uint32_t end = n_nodes.load(std::memory_order_relaxed);
+    if (reuse_marks.size() != arena.size()) {
+        reuse_marks.resize(arena.size());
+    }
+    std::fill(reuse_marks.begin() + root, reuse_marks.begin() + end, no_node);
+    reuse_marks[root] = kept;
+
+    // every node is moved to an index no larger than its own, so the nodes
+    // it overwrites have already been moved, and each node's children are
+    // moved after it, keeping them contiguous
+    uint32_t next = 0;
+    for (uint32_t i = root; i < end; i++) {
+        uint32_t mark = reuse_marks[i];
+        if (mark == no_node) {
+            continue;
+        }
+        uint32_t dst = next++;
+        if (mark != kept) {
+            // the first of its parent's children, which now lives at mark
+            arena[mark].first_child.store(dst, std::memory_order_relaxed);
+        }
+
+        Node & src = arena[i];
+        uint32_t first = src.first_child.load(std::memory_order_relaxed);
+        if (dst != i) {
+            Node & d = arena[dst];
+            d.n_children = src.n_children;
+            d.move = src.move;
+            d.prior = src.prior;
+            d.visits.store(src.visits.load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+            d.value_sum.store(src.value_sum.load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+            d.first_child.store(first, std::memory_order_relaxed);
+        }
+        if (first < expanding) {
+            reuse_marks[first] = dst;
+            for (uint32_t c = first + 1; c < first + src.n_children; c++) {
+                reuse_marks[c] = kept;
+            }
+        }
+    }
+    n_nodes.store(next, std::memory_order_relaxed);
+}
+
+template<class G>
+void MctsMove::search(const G & g, GameMove & move) {
+    if (verbose) {
+        GameState state(g);
+        state.print();
+    }
+
+    // each thread plays and undoes moves on its own copy of the game
+    std::vector<G> games(threads.size(), g);
+    if constexpr (std::is_same<G, Go>::value) {
+        if (evaluator != nullptr && evaluator->get_zobrist() != nullptr) {
+            for (G & sg : games) {
+                sg.set_zobrist(evaluator->get_zobrist());
+            }
+        }
+    }
+
+    // carry over the statistics of the last search under this position,
+    // which count towards this search's playouts
+    uint32_t reused_root = find_reused_root(g);
+    if (reused_root != no_node) {
+        keep_subtree(reused_root);
+    }
+    else {
+        arena[0].init(G::no_position, 1.f);
+        n_nodes = 1;
+    }
+    reused_count = arena[0].visits.load(std::memory_order_relaxed);
+    playouts_started = reused_count;
+
+    auto run_playouts = [this, &games](uint32_t i) {
+        while (playouts_started.fetch_add(1, std::memory_order_relaxed) <
+                playouts) {
+            playout(games[i], threads[i]);
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> helpers;
+    for (uint32_t i = 1; i < threads.size(); i++) {
+        helpers.emplace_back(run_playouts, i);
+    }
+    run_playouts(0);
+    for (std::thread & helper : helpers) {
+        helper.join();
+    }
+    double secs = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    playout_count = reused_count < playouts ? playouts - reused_count : 0;
+    if (reuse) {
+        tree_game = g.clone();
+    }
+
+    // play the most visited move
+    const Node & r = arena[0];
+    uint32_t first = r.first_child.load(std::memory_order_relaxed);
+    board_idx_t best = G::no_position;
+    uint32_t best_visits = 0;
+    float best_q = 0;
+    for (uint32_t i = first; first < expanding && i < first + r.n_children;
+            i++) {
+        uint32_t visits = arena[i].visits.load(std::memory_order_relaxed);
+        if (visits > best_visits) {
+            best_visits = visits;
+            best = arena[i].move;
+            best_q = arena[i].q();
+        }
+    }
+
+    if (verbose) {
+        printf("%llu playouts (%llu reused) in %.3fs (%.0f/s), %u nodes, "
+                "value %.3f, ", (unsigned long long) playout_count,
+                (unsigned long long) reused_count, secs, playout_count / secs,
+                get_node_count(), best_q);
+        if (best == G::no_position) {
+            printf("pass\n");
+        }
+        else {
+            printf("%c%d\n", Go::COL_INDICATORS[g.idx_x(best)],
+                    g.height() - g.idx_y(best));
+        }
+    }
+
+    GoMove m;
+    if (best == G::no_position) {
+        m.color = Color::pass;
+    }
+    else {
+        m.color = g.get_player();
+        m.x = g.idx_x(best);
+        m.y = g.idx_y(best);
+    }
+    move = m;
+}
+
+template<coord_t N>
+bool MctsMove::search_bit_go(Game & g, GameMove & move) {
+    if constexpr (N > max_bit_go_size) {
+        return false;
+    }
+    else {
+        BitGo<N> * bg = dynamic_cast<BitGo<N> *>(&g);
+        if (bg == nullptr) {
+            return search_bit_go<N + 1>(g, move);
+        }
+        search(*bg, move);
+        return true;
+    }
+}
+
+void MctsMove::set_threads(uint32_t n_threads) {
+    GO_ASSERT(n_threads >= 1, "MctsMove needs at least one thread");
+
+    uint64_t s = std::chrono::steady_clock::now().time_since_epoch().count();
+    threads.clear();
+    for (uint32_t i = 0; i < n_threads; i++) {
+        threads.emplace_back(s + i);
+    }
+}
+
+void MctsMove::seed(uint64_t s) {
+    for (uint32_t i = 0; i < threads.size(); i++) {
+        // spread the seeds apart, so nearby seeds give unrelated playouts
+        threads[i].rng.seed((s + i) * 0x9e3779b97f4a7c15llu);
+    }
+}
+
+uint32_t MctsMove::get_root_visits(board_idx_t * moves,
+        uint32_t * visits) const {
+    if (n_nodes.load(std::memory_order_relaxed) == 0) {
+        return 0;
+    }
+    const Node & r = arena[0];
+    uint32_t first = r.first_child.load(std::memory_order_relaxed);
+    if (first >= expanding) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < r.n_children; i++) {
+        moves[i] = arena[first + i].move;
+        visits[i] = arena[first + i].visits.load(std::memory_order_relaxed);
+    }
+    return r.n_children;
+}
+
+MoveStatus MctsMove::next_move(GameMove & move) {
+
+    if (game.game_over()) {
+        getch();
+        return failed;
+    }
+
+    Game & g = game.strip();
+    Go * go = dynamic_cast<Go *>(&g);
+    if (go != nullptr) {
+        search(*go, move);
+    }
+    else {
+        GO_ASSERT(search_bit_go<1>(g, move), "MctsMove can only play Go or "
+                "square BitGo up to %ux%u", max_bit_go_size, max_bit_go_size);
+    }
+
+    return ok;
+}
+
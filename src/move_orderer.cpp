@@ -0,0 +1,46 @@
+
+#include <move_orderer.h>
+
+
+MoveOrderer::MoveOrderer(uint32_t n_tiles) : history(n_tiles, 0) {
+    for (uint32_t ply = 0; ply < max_ply; ply++) {
+        for (uint32_t i = 0; i < killers_per_ply; i++) {
+            killers[ply][i] = no_move;
+        }
+    }
+}
+
+
+void MoveOrderer::age_history() {
+    for (uint32_t & h : history) {
+        h >>= 1;
+    }
+}
+
+void MoveOrderer::new_search() {
+    for (uint32_t ply = 0; ply < max_ply; ply++) {
+        for (uint32_t i = 0; i < killers_per_ply; i++) {
+            killers[ply][i] = no_move;
+        }
+    }
+    age_history();
+}
+
+
+void MoveOrderer::cutoff(board_idx_t move, uint32_t ply, int depth) {
+    if (move == pass_move) {
+        return;
+    }
+
+    if (ply < max_ply && killers[ply][0] != move) {
+        killers[ply][1] = killers[ply][0];
+        killers[ply][0] = move;
+    }
+
+    // cutoffs close to the root prune much more of the tree
+    history[move] += depth * depth;
+    if (history[move] > max_history) {
+        age_history();
+    }
+}
+
@@ -0,0 +1,621 @@
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <game.h>
+#include <network.h>
+
+
+/*
+ * acc[o] += sum over i of in[i] * rows[i * n_out + o], for o < n_out, which
+ * is the inner loop of both convolutions (over one kernel tap) and dense
+ * layers. Each kernel keeps a block of acc in registers while it runs down
+ * the rows, broadcasting one input at a time
+ */
+typedef void (*mac_fn)(float * acc, const float * in, const float * rows,
+        uint32_t n_in, uint32_t n_out);
+
+/*
+ * the same for four inputs at once, in, in + in_stride, ... into acc,
+ * acc + n_out, ..., which loads each row once for all four. Convolutions
+ * run out of cache bandwidth for the weights otherwise
+ */
+typedef void (*mac4_fn)(float * acc, const float * in, const float * rows,
+        uint32_t n_in, uint32_t n_out, uint32_t in_stride);
+
+static void mac_scalar(float * acc, const float * in, const float * rows,
+        uint32_t n_in, uint32_t n_out) {
+    for (uint32_t i = 0; i < n_in; i++) {
+        float x = in[i];
+        const float * row = rows + (size_t) i * n_out;
+        for (uint32_t o = 0; o < n_out; o++) {
+            acc[o] += x * row[o];
+        }
+    }
+}
+
+static void mac4_scalar(float * acc, const float * in, const float * rows,
+        uint32_t n_in, uint32_t n_out, uint32_t in_stride) {
+    for (uint32_t p = 0; p < 4; p++) {
+        mac_scalar(acc + p * n_out, in + p * in_stride, rows, n_in, n_out);
+    }
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx2,fma")))
+static void mac_avx2(float * acc, const float * in, const float * rows,
+        uint32_t n_in, uint32_t n_out) {
+    uint32_t o = 0;
+    for (; o + 32 <= n_out; o += 32) {
+        __m256 a0 = _mm256_loadu_ps(acc + o);
+        __m256 a1 = _mm256_loadu_ps(acc + o + 8);
+        __m256 a2 = _mm256_loadu_ps(acc + o + 16);
+        __m256 a3 = _mm256_loadu_ps(acc + o + 24);
+        for (uint32_t i = 0; i < n_in; i++) {
+            __m256 x = _mm256_set1_ps(in[i]);
+            const float * row = rows + (size_t) i * n_out + o;
+            a0 = _mm256_fmadd_ps(x, _mm256_loadu_ps(row), a0);
+            a1 = _mm256_fmadd_ps(x, _mm256_loadu_ps(row + 8), a1);
+            a2 = _mm256_fmadd_ps(x, _mm256_loadu_ps(row + 16), a2);
+            a3 = _mm256_fmadd_ps(x, _mm256_loadu_ps(row + 24), a3);
+        }
+        _mm256_storeu_ps(acc + o, a0);
+        _mm256_storeu_ps(acc + o + 8, a1);
+        _mm256_storeu_ps(acc + o + 16, a2);
+        _mm256_storeu_ps(acc + o + 24, a3);
+    }
+    for (; o + 8 <= n_out; o += 8) {
+        // a single accumulator would wait on each fma in turn, so alternate
+        // between two
+        __m256 a = _mm256_loadu_ps(acc + o);
+        __m256 b = _mm256_setzero_ps();
+        uint32_t i = 0;
+        for (; i + 2 <= n_in; i += 2) {
+            const float * row = rows + (size_t) i * n_out + o;
+            a = _mm256_fmadd_ps(_mm256_set1_ps(in[i]), _mm256_loadu_ps(row),
+                    a);
+            b = _mm256_fmadd_ps(_mm256_set1_ps(in[i + 1]),
+                    _mm256_loadu_ps(row + n_out), b);
+        }
+        if (i < n_in) {
+            a = _mm256_fmadd_ps(_mm256_set1_ps(in[i]),
+                    _mm256_loadu_ps(rows + (size_t) i * n_out + o), a);
+        }
+        _mm256_storeu_ps(acc + o, _mm256_add_ps(a, b));
+    }
+    if (o < n_out) {
+        // the last few outputs, which are all there is for 1x1 convolutions
+        // into a handful of channels
+        for (uint32_t i = 0; i < n_in; i++) {
+            float x = in[i];
+            const float * row = rows + (size_t) i * n_out;
+            for (uint32_t j = o; j < n_out; j++) {
+                acc[j] += x * row[j];
+            }
+        }
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void mac4_avx2(float * acc, const float * in, const float * rows,
+        uint32_t n_in, uint32_t n_out, uint32_t in_stride) {
+    uint32_t o = 0;
+    for (; o + 8 <= n_out; o += 8) {
+        __m256 a[4];
+        for (uint32_t p = 0; p < 4; p++) {
+            a[p] = _mm256_loadu_ps(acc + p * n_out + o);
+        }
+        for (uint32_t i = 0; i < n_in; i++) {
+            __m256 w = _mm256_loadu_ps(rows + (size_t) i * n_out + o);
+            for (uint32_t p = 0; p < 4; p++) {
+                a[p] = _mm256_fmadd_ps(_mm256_set1_ps(in[p * in_stride + i]),
+                        w, a[p]);
+            }
+        }
+        for (uint32_t p = 0; p < 4; p++) {
+            _mm256_storeu_ps(acc + p * n_out + o, a[p]);
+        }
+    }
+    for (; o < n_out; o++) {
+        for (uint32_t p = 0; p < 4; p++) {
+            float sum = acc[p * n_out + o];
+            for (uint32_t i = 0; i < n_in; i++) {
+                sum += in[p * in_stride + i] * rows[(size_t) i * n_out + o];
+            }
+            acc[p * n_out + o] = sum;
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+static void mac_avx512(float * acc, const float * in, const float * rows,
+        uint32_t n_in, uint32_t n_out) {
+    uint32_t o = 0;
+    for (; o + 64 <= n_out; o += 64) {
+        __m512 a0 = _mm512_loadu_ps(acc + o);
+        __m512 a1 = _mm512_loadu_ps(acc + o + 16);
+        __m512 a2 = _mm512_loadu_ps(acc + o + 32);
+        __m512 a3 = _mm512_loadu_ps(acc + o + 48);
+        for (uint32_t i = 0; i < n_in; i++) {
+            __m512 x = _mm512_set1_ps(in[i]);
+            const float * row = rows + (size_t) i * n_out + o;
+            a0 = _mm512_fmadd_ps(x, _mm512_loadu_ps(row), a0);
+            a1 = _mm512_fmadd_ps(x, _mm512_loadu_ps(row + 16), a1);
+            a2 = _mm512_fmadd_ps(x, _mm512_loadu_ps(row + 32), a2);
+            a3 = _mm512_fmadd_ps(x, _mm512_loadu_ps(row + 48), a3);
+        }
+        _mm512_storeu_ps(acc + o, a0);
+        _mm512_storeu_ps(acc + o + 16, a1);
+        _mm512_storeu_ps(acc + o + 32, a2);
+        _mm512_storeu_ps(acc + o + 48, a3);
+    }
+    for (; o + 32 <= n_out; o += 32) {
+        // two rows at a time into separate accumulators, so there are as
+        // many fmas in flight as for blocks of 64
+        __m512 a0 = _mm512_loadu_ps(acc + o);
+        __m512 a1 = _mm512_loadu_ps(acc + o + 16);
+        __m512 b0 = _mm512_setzero_ps();
+        __m512 b1 = _mm512_setzero_ps();
+        uint32_t i = 0;
+        for (; i + 2 <= n_in; i += 2) {
+            __m512 x = _mm512_set1_ps(in[i]);
+            __m512 y = _mm512_set1_ps(in[i + 1]);
+            const float * row = rows + (size_t) i * n_out + o;
+            a0 = _mm512_fmadd_ps(x, _mm512_loadu_ps(row), a0);
+            a1 = _mm512_fmadd_ps(x, _mm512_loadu_ps(row + 16), a1);
+            b0 = _mm512_fmadd_ps(y, _mm512_loadu_ps(row + n_out), b0);
+            b1 = _mm512_fmadd_ps(y, _mm512_loadu_ps(row + n_out + 16), b1);
+        }
+        if (i < n_in) {
+            __m512 x = _mm512_set1_ps(in[i]);
+            const float * row = rows + (size_t) i * n_out + o;
+            a0 = _mm512_fmadd_ps(x, _mm512_loadu_ps(row), a0);
+            a1 = _mm512_fmadd_ps(x, _mm512_loadu_ps(row + 16), a1);
+        }
+        _mm512_storeu_ps(acc + o, _mm512_add_ps(a0, b0));
+        _mm512_storeu_ps(acc + o + 16, _mm512_add_ps(a1, b1));
+    }
+    for (; o < n_out; o += 16) {
+        // masked, so the last block may be partial, and four rows at a time
+        __mmask16 m = n_out - o >= 16 ? (__mmask16) 0xffff :
+            (__mmask16) ((1u << (n_out - o)) - 1);
+        __m512 a[4] = { _mm512_maskz_loadu_ps(m, acc + o),
+            _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps() };
+        uint32_t i = 0;
+        for (; i + 4 <= n_in; i += 4) {
+            const float * row = rows + (size_t) i * n_out + o;
+            for (uint32_t j = 0; j < 4; j++) {
+                a[j] = _mm512_fmadd_ps(_mm512_set1_ps(in[i + j]),
+                        _mm512_maskz_loadu_ps(m, row + j * n_out), a[j]);
+            }
+        }
+        for (; i < n_in; i++) {
+            a[0] = _mm512_fmadd_ps(_mm512_set1_ps(in[i]),
+                    _mm512_maskz_loadu_ps(m, rows + (size_t) i * n_out + o),
+                    a[0]);
+        }
+        _mm512_mask_storeu_ps(acc + o, m, _mm512_add_ps(
+                    _mm512_add_ps(a[0], a[1]), _mm512_add_ps(a[2], a[3])));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void mac4_avx512(float * acc, const float * in, const float * rows,
+        uint32_t n_in, uint32_t n_out, uint32_t in_stride) {
+    for (uint32_t o = 0; o < n_out; o += 16) {
+        __mmask16 m = n_out - o >= 16 ? (__mmask16) 0xffff :
+            (__mmask16) ((1u << (n_out - o)) - 1);
+        __m512 a[4];
+        for (uint32_t p = 0; p < 4; p++) {
+            a[p] = _mm512_maskz_loadu_ps(m, acc + p * n_out + o);
+        }
+        for (uint32_t i = 0; i < n_in; i++) {
+            __m512 w = _mm512_maskz_loadu_ps(m, rows + (size_t) i * n_out + o);
+            for (uint32_t p = 0; p < 4; p++) {
+                a[p] = _mm512_fmadd_ps(_mm512_set1_ps(in[p * in_stride + i]),
+                        w, a[p]);
+            }
+        }
+        for (uint32_t p = 0; p < 4; p++) {
+            _mm512_mask_storeu_ps(acc + p * n_out + o, m, a[p]);
+        }
+    }
+}
+
+
+#endif /* __x86_64__ */
+
+
+struct MacKernel {
+    mac_fn fn;
+    mac4_fn fn4;
+    const char * name;
+
+    MacKernel() : fn(mac_scalar), fn4(mac4_scalar), name("scalar") {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            fn = mac_avx512;
+            fn4 = mac4_avx512;
+            name = "avx512";
+        }
+        else if (__builtin_cpu_supports("avx2") &&
+                __builtin_cpu_supports("fma")) {
+            fn = mac_avx2;
+            fn4 = mac4_avx2;
+            name = "avx2";
+        }
+#endif
+    }
+};
+
+static const MacKernel mac_kernel;
+
+
+Network::Network(uint32_t h, uint32_t w, uint32_t c) : batch_capacity(0) {
+    GO_ASSERT(h > 0 && w > 0 && c > 0, "input of shape %ux%ux%u is empty",
+            h, w, c);
+    shapes.push_back({ h, w, c });
+}
+
+
+template<class T>
+static T read_val(std::ifstream & f, const std::string & path) {
+    T val;
+    f.read(reinterpret_cast<char *>(&val), sizeof(T));
+    GO_ASSERT(f, "unexpected end of network file %s", path.c_str());
+    return val;
+}
+
+static std::vector<float> read_floats(std::ifstream & f, uint32_t n,
+        const std::string & path) {
+    std::vector<float> v(n);
+    f.read(reinterpret_cast<char *>(v.data()), n * sizeof(float));
+    GO_ASSERT(f, "unexpected end of network file %s", path.c_str());
+    return v;
+}
+
+Network::Network(const std::string & path) : batch_capacity(0) {
+    std::ifstream f(path, std::ios::binary);
+    GO_ASSERT(f, "could not open network file %s", path.c_str());
+
+    GO_ASSERT(read_val<uint32_t>(f, path) == file_magic, "%s is not a network "
+            "file", path.c_str());
+    uint32_t version = read_val<uint32_t>(f, path);
+    GO_ASSERT(version == file_version, "network file %s has version %u, "
+            "expected %u", path.c_str(), version, file_version);
+
+    uint32_t h = read_val<uint32_t>(f, path);
+    uint32_t w = read_val<uint32_t>(f, path);
+    uint32_t c = read_val<uint32_t>(f, path);
+    GO_ASSERT(h > 0 && w > 0 && c > 0, "input of shape %ux%ux%u is empty",
+            h, w, c);
+    shapes.push_back({ h, w, c });
+
+    // layers are added through the builder methods, which check that they
+    // fit together
+    uint32_t n_layers = read_val<uint32_t>(f, path);
+    for (uint32_t i = 0; i < n_layers; i++) {
+        uint32_t type = read_val<uint32_t>(f, path);
+        uint32_t src = read_val<uint32_t>(f, path);
+        uint32_t dst = read_val<uint32_t>(f, path);
+        uint32_t k = read_val<uint32_t>(f, path);
+        uint32_t n_out = read_val<uint32_t>(f, path);
+        uint32_t n_weights = read_val<uint32_t>(f, path);
+        GO_ASSERT(n_weights <= (1u << 28), "layer %u of %s has %u weights",
+                i, path.c_str(), n_weights);
+        std::vector<float> weights = read_floats(f, n_weights, path);
+
+        switch (type) {
+            case conv:
+            case dense: {
+                GO_ASSERT(src < shapes.size(), "layer %u of %s reads "
+                        "undefined tensor %u", i, path.c_str(), src);
+                GO_ASSERT(n_weights >= n_out, "layer %u of %s has too few "
+                        "weights", i, path.c_str());
+                std::vector<float> bias(weights.end() - n_out, weights.end());
+                weights.resize(n_weights - n_out);
+                if (type == conv) {
+                    add_conv(src, dst, k, n_out, weights, bias);
+                }
+                else {
+                    add_dense(src, dst, n_out, weights, bias);
+                }
+                break;
+            }
+            case scale_shift: {
+                uint32_t half = n_weights / 2;
+                std::vector<float> shift(weights.begin() + half,
+                        weights.end());
+                weights.resize(half);
+                add_scale_shift(dst, weights, shift);
+                break;
+            }
+            case relu:
+                add_relu(dst);
+                break;
+            case add:
+                add_add(src, dst);
+                break;
+            case tanh:
+                add_tanh(dst);
+                break;
+            default:
+                GO_ASSERT(false, "layer %u of %s has unknown type %u", i,
+                        path.c_str(), type);
+        }
+    }
+
+    uint32_t n_outs = read_val<uint32_t>(f, path);
+    for (uint32_t i = 0; i < n_outs; i++) {
+        add_output(read_val<uint32_t>(f, path));
+    }
+}
+
+
+template<class T>
+static void write_val(std::ofstream & f, T val) {
+    f.write(reinterpret_cast<const char *>(&val), sizeof(T));
+}
+
+void Network::save(const std::string & path) const {
+    std::ofstream f(path, std::ios::binary);
+    GO_ASSERT(f, "could not open network file %s", path.c_str());
+
+    write_val(f, file_magic);
+    write_val(f, file_version);
+    write_val(f, shapes[0].h);
+    write_val(f, shapes[0].w);
+    write_val(f, shapes[0].c);
+
+    write_val(f, (uint32_t) layers.size());
+    for (const Layer & l : layers) {
+        write_val(f, (uint32_t) l.type);
+        write_val(f, l.src);
+        write_val(f, l.dst);
+        write_val(f, l.k);
+        write_val(f, l.n_out);
+        write_val(f, (uint32_t) l.weights.size());
+        f.write(reinterpret_cast<const char *>(l.weights.data()),
+                l.weights.size() * sizeof(float));
+    }
+
+    write_val(f, (uint32_t) outputs.size());
+    for (uint32_t t : outputs) {
+        write_val(f, t);
+    }
+    GO_ASSERT(f, "failed to write network file %s", path.c_str());
+}
+
+
+void Network::set_dst(uint32_t dst, Shape s) {
+    if (dst == shapes.size()) {
+        shapes.push_back(s);
+    }
+    else {
+        GO_ASSERT(dst != 0 && dst < shapes.size(), "layer %zu writes tensor "
+                "%u of %zu", layers.size(), dst, shapes.size());
+        const Shape & d = shapes[dst];
+        GO_ASSERT(d.h == s.h && d.w == s.w && d.c == s.c, "layer %zu writes "
+                "%ux%ux%u to tensor %u of shape %ux%ux%u", layers.size(),
+                s.h, s.w, s.c, dst, d.h, d.w, d.c);
+    }
+}
+
+void Network::add_conv(uint32_t src, uint32_t dst, uint32_t k, uint32_t n_out,
+        const std::vector<float> & kernel, const std::vector<float> & bias) {
+    GO_ASSERT(src < shapes.size(), "conv reads undefined tensor %u", src);
+    GO_ASSERT(src != dst, "conv can't run in place on tensor %u", src);
+    Shape in = shapes[src];
+    GO_ASSERT(k > 0 && n_out > 0, "conv with kernel size %u and %u outputs",
+            k, n_out);
+    GO_ASSERT(kernel.size() == (size_t) k * k * in.c * n_out, "conv kernel "
+            "has %zu weights, expected %u", kernel.size(), k * k * in.c * n_out);
+    GO_ASSERT(bias.size() == n_out, "conv bias has %zu weights, expected %u",
+            bias.size(), n_out);
+    set_dst(dst, { in.h, in.w, n_out });
+
+    Layer l = { conv, src, dst, k, n_out, kernel };
+    l.weights.insert(l.weights.end(), bias.begin(), bias.end());
+    layers.push_back(std::move(l));
+}
+
+void Network::add_scale_shift(uint32_t t, const std::vector<float> & scale,
+        const std::vector<float> & shift) {
+    GO_ASSERT(t != 0 && t < shapes.size(), "scale_shift on tensor %u", t);
+    uint32_t c = shapes[t].c;
+    GO_ASSERT(scale.size() == c && shift.size() == c, "scale_shift has %zu "
+            "scales and %zu shifts for %u channels", scale.size(),
+            shift.size(), c);
+
+    Layer l = { scale_shift, t, t, 0, c, scale };
+    l.weights.insert(l.weights.end(), shift.begin(), shift.end());
+    layers.push_back(std::move(l));
+}
+
+void Network::add_relu(uint32_t t) {
+    GO_ASSERT(t != 0 && t < shapes.size(), "relu on tensor %u", t);
+    layers.push_back({ relu, t, t, 0, 0, {} });
+}
+
+void Network::add_add(uint32_t src, uint32_t dst) {
+    GO_ASSERT(src < shapes.size(), "add reads undefined tensor %u", src);
+    GO_ASSERT(dst != 0 && dst < shapes.size() && dst != src, "add writes "
+            "tensor %u", dst);
+    GO_ASSERT(shapes[src].size() == shapes[dst].size(), "add of tensors "
+            "%u and %u of different sizes", src, dst);
+    layers.push_back({ add, src, dst, 0, 0, {} });
+}
+
+void Network::add_dense(uint32_t src, uint32_t dst, uint32_t n_out,
+        const std::vector<float> & kernel, const std::vector<float> & bias) {
+    GO_ASSERT(src < shapes.size(), "dense reads undefined tensor %u", src);
+    GO_ASSERT(src != dst, "dense can't run in place on tensor %u", src);
+    uint32_t n_in = shapes[src].size();
+    GO_ASSERT(n_out > 0, "dense with no outputs");
+    GO_ASSERT(kernel.size() == (size_t) n_in * n_out, "dense kernel has %zu "
+            "weights, expected %u", kernel.size(), n_in * n_out);
+    GO_ASSERT(bias.size() == n_out, "dense bias has %zu weights, expected %u",
+            bias.size(), n_out);
+    set_dst(dst, { 1, 1, n_out });
+
+    Layer l = { dense, src, dst, 0, n_out, kernel };
+    l.weights.insert(l.weights.end(), bias.begin(), bias.end());
+    layers.push_back(std::move(l));
+}
+
+void Network::add_tanh(uint32_t t) {
+    GO_ASSERT(t != 0 && t < shapes.size(), "tanh on tensor %u", t);
+    layers.push_back({ tanh, t, t, 0, 0, {} });
+}
+
+void Network::add_output(uint32_t t) {
+    GO_ASSERT(t < shapes.size(), "output of undefined tensor %u", t);
+    outputs.push_back(t);
+}
+
+
+void Network::run_conv(const Layer & l, uint32_t batch) {
+    const Shape & s = shapes[l.src];
+    uint32_t k = l.k;
+    uint32_t n_out = l.n_out;
+    // as Keras pads "same" convolutions, with the extra row/column (for even
+    // kernels) at the bottom/right
+    int pad = (k - 1) / 2;
+    size_t tap_size = (size_t) s.c * n_out;
+    const float * bias = l.weights.data() + tap_size * k * k;
+
+    for (uint32_t b = 0; b < batch; b++) {
+        const float * in = tensors[l.src].data() + (size_t) b * s.size();
+        float * out = tensors[l.dst].data() + (size_t) b * s.h * s.w * n_out;
+
+        for (int y = 0; y < (int) s.h; y++) {
+            int x = 0;
+            while (x < (int) s.w) {
+                float * acc = out + ((size_t) y * s.w + x) * n_out;
+
+                // the taps of one kernel row which fall on the board read
+                // consecutive pixels with consecutive weights, so each row is
+                // one run of the kernel
+                int kx0 = std::max(0, pad - x);
+                int kx1 = std::min((int) k, (int) s.w + pad - x);
+                // four pixels whose kernels lie entirely on the board in x
+                // are run together
+                bool block = kx0 == 0 && x + 3 + (int) k - pad <= (int) s.w;
+                int n_px = block ? 4 : 1;
+
+                for (int p = 0; p < n_px; p++) {
+                    memcpy(acc + p * n_out, bias, n_out * sizeof(float));
+                }
+                for (int ky = 0; ky < (int) k; ky++) {
+                    int iy = y + ky - pad;
+                    if (iy < 0 || iy >= (int) s.h) {
+                        continue;
+                    }
+                    const float * px = in +
+                        ((size_t) iy * s.w + x + kx0 - pad) * s.c;
+                    const float * rows = l.weights.data() +
+                        (ky * k + kx0) * tap_size;
+                    if (block) {
+                        mac_kernel.fn4(acc, px, rows, k * s.c, n_out, s.c);
+                    }
+                    else {
+                        mac_kernel.fn(acc, px, rows, (kx1 - kx0) * s.c,
+                                n_out);
+                    }
+                }
+                x += n_px;
+            }
+        }
+    }
+}
+
+void Network::run_dense(const Layer & l, uint32_t batch) {
+    uint32_t n_in = shapes[l.src].size();
+    uint32_t n_out = l.n_out;
+    const float * bias = l.weights.data() + (size_t) n_in * n_out;
+
+    float * out = tensors[l.dst].data();
+    const float * in = tensors[l.src].data();
+    for (uint32_t b = 0; b < batch; b++) {
+        memcpy(out + (size_t) b * n_out, bias, n_out * sizeof(float));
+    }
+    // batches are run four inputs at a time
+    uint32_t b = 0;
+    for (; b + 4 <= batch; b += 4) {
+        mac_kernel.fn4(out + (size_t) b * n_out, in + (size_t) b * n_in,
+                l.weights.data(), n_in, n_out, n_in);
+    }
+    for (; b < batch; b++) {
+        mac_kernel.fn(out + (size_t) b * n_out, in + (size_t) b * n_in,
+                l.weights.data(), n_in, n_out);
+    }
+}
+
+void Network::forward(const float * input, uint32_t batch) {
+    if (batch > batch_capacity) {
+        tensors.resize(shapes.size());
+        for (uint32_t t = 0; t < shapes.size(); t++) {
+            tensors[t].resize((size_t) shapes[t].size() * batch);
+        }
+        batch_capacity = batch;
+    }
+    memcpy(tensors[0].data(), input,
+            (size_t) shapes[0].size() * batch * sizeof(float));
+
+    for (const Layer & l : layers) {
+        size_t n = (size_t) shapes[l.dst].size() * batch;
+        float * dst = tensors[l.dst].data();
+
+        switch (l.type) {
+            case conv:
+                run_conv(l, batch);
+                break;
+            case dense:
+                run_dense(l, batch);
+                break;
+            case scale_shift: {
+                uint32_t c = l.n_out;
+                const float * scale = l.weights.data();
+                const float * shift = scale + c;
+                for (size_t i = 0; i < n; i += c) {
+                    for (uint32_t j = 0; j < c; j++) {
+                        dst[i + j] = dst[i + j] * scale[j] + shift[j];
+                    }
+                }
+                break;
+            }
+            case relu:
+                for (size_t i = 0; i < n; i++) {
+                    dst[i] = dst[i] > 0.f ? dst[i] : 0.f;
+                }
+                break;
+            case add: {
+                const float * src = tensors[l.src].data();
+                for (size_t i = 0; i < n; i++) {
+                    dst[i] += src[i];
+                }
+                break;
+            }
+            case tanh:
+                for (size_t i = 0; i < n; i++) {
+                    dst[i] = std::tanh(dst[i]);
+                }
+                break;
+        }
+    }
+}
+
+
+const char * Network::simd_name() {
+    return mac_kernel.name;
+}
+
@@ -0,0 +1,72 @@
+
+#include <cstdio>
+#include <stdexcept>
+
+#include <game.h>
+#include <position_set.h>
+
+
+PositionSet::PositionSet() : table(1u << default_log_size, { 0, 0 }),
+        n_keys(0) {}
+
+
+void PositionSet::clear() {
+    table.assign(1u << default_log_size, { 0, 0 });
+    n_keys = 0;
+}
+
+
+void PositionSet::grow() {
+    std::vector<Entry> old(table.size() * 2, { 0, 0 });
+    old.swap(table);
+
+    for (const Entry & e : old) {
+        if (e.count != 0) {
+            table[find(e.key)] = e;
+        }
+    }
+}
+
+
+void PositionSet::insert(uint64_t key) {
+    uint32_t i = find(key);
+    if (table[i].count != 0) {
+        table[i].count++;
+        return;
+    }
+
+    table[i] = { key, 1 };
+    n_keys++;
+    if (n_keys * max_load_inv > table.size()) {
+        grow();
+    }
+}
+
+
+void PositionSet::erase(uint64_t key) {
+    uint32_t i = find(key);
+    GO_ASSERT(table[i].count != 0, "erasing a position which is not in the "
+            "set");
+    if (--table[i].count != 0) {
+        return;
+    }
+    n_keys--;
+
+    // shift back every following entry of the probe sequence which could
+    // have been placed at i, so lookups never stop early at the hole
+    uint32_t j = i;
+    while (true) {
+        j = (j + 1) & mask();
+        if (table[j].count == 0) {
+            break;
+        }
+        uint32_t home = ((uint32_t) (table[j].key >> 32)) & mask();
+        // the entry at j may move to i if i lies cyclically in [home, j)
+        if (((j - home) & mask()) >= ((j - i) & mask())) {
+            table[i] = table[j];
+            table[j].count = 0;
+            i = j;
+        }
+    }
+}
+
@@ -0,0 +1,224 @@
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <replay_buffer.h>
+
+
+size_t ReplayBuffer::map_size(uint32_t record_size, uint64_t capacity) {
+    return sizeof(Header) + capacity * (sizeof(uint64_t) + record_size);
+}
+
+void ReplayBuffer::map(int fd, size_t n_bytes) {
+    void * m = mmap(nullptr, n_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+            0);
+    close(fd);
+    GO_ASSERT(m != MAP_FAILED, "could not map replay buffer %s",
+            name.c_str());
+    data = (uint8_t *) m;
+    mapped_size = n_bytes;
+    header = reinterpret_cast<Header *>(data);
+}
+
+ReplayBuffer::ReplayBuffer(const std::string & name, coord_t w, coord_t h,
+        uint64_t capacity) : name(name), codec(w, h) {
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "stamps must "
+            "be lock free to be shared between processes");
+    GO_ASSERT(capacity > 0, "replay buffer %s has no room", name.c_str());
+
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    GO_ASSERT(fd != -1, "could not create replay buffer %s: %s",
+            name.c_str(), strerror(errno));
+    size_t n_bytes = map_size(codec.record_size(), capacity);
+    if (ftruncate(fd, n_bytes) != 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        GO_ASSERT(false, "could not size replay buffer %s", name.c_str());
+    }
+    // the new object is zero filled, so every stamp starts at 0
+    map(fd, n_bytes);
+
+    header->version = version;
+    header->w = w;
+    header->h = h;
+    header->record_size = codec.record_size();
+    header->capacity = capacity;
+    header->head.store(0, std::memory_order_relaxed);
+    header->games.store(0, std::memory_order_relaxed);
+    header->magic.store(magic, std::memory_order_release);
+
+    stamps = reinterpret_cast<std::atomic<uint64_t> *>(data + sizeof(Header));
+    slots = data + sizeof(Header) + capacity * sizeof(uint64_t);
+}
+
+ReplayBuffer::ReplayBuffer(const std::string & name) : name(name),
+        codec(1, 1) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    GO_ASSERT(fd != -1, "could not open replay buffer %s: %s", name.c_str(),
+            strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(Header)) {
+        close(fd);
+        GO_ASSERT(false, "replay buffer %s isn't set up", name.c_str());
+    }
+    map(fd, st.st_size);
+
+    GO_ASSERT(header->magic.load(std::memory_order_acquire) == magic,
+            "%s is not a replay buffer, or isn't set up", name.c_str());
+    GO_ASSERT(header->version == version, "replay buffer %s has version %u, "
+            "expected %u", name.c_str(), header->version, version);
+    GO_ASSERT(header->record_size == TrainingCodec::record_size(header->w,
+                header->h) && mapped_size == map_size(header->record_size,
+                header->capacity), "replay buffer %s has a bad header",
+            name.c_str());
+
+    codec = TrainingCodec(header->w, header->h);
+    stamps = reinterpret_cast<std::atomic<uint64_t> *>(data + sizeof(Header));
+    slots = data + sizeof(Header) + header->capacity * sizeof(uint64_t);
+}
+
+ReplayBuffer::~ReplayBuffer() {
+    munmap(data, mapped_size);
+}
+
+void ReplayBuffer::remove(const std::string & name) {
+    shm_unlink(name.c_str());
+}
+
+
+void ReplayBuffer::write_slot(uint64_t n, const uint8_t * rec) {
+    std::atomic<uint64_t> & stamp = stamps[n % header->capacity];
+    uint64_t cur = stamp.load(std::memory_order_acquire);
+    // set once an earlier position is found being written here
+    bool waiting = false;
+    std::chrono::steady_clock::time_point waiting_since;
+    while (true) {
+        if (cur >= 2 * n + 1) {
+            // a writer of a later position lapped this one
+            return;
+        }
+        if (cur & 1) {
+            // an earlier position is still being written here, which only
+            // happens if capacity positions were claimed meanwhile. If its
+            // writer died the stamp never turns even, and the slot can't be
+            // taken over safely, as the writer may only be slow
+            if (!waiting) {
+                waiting = true;
+                waiting_since = std::chrono::steady_clock::now();
+            }
+            GO_ASSERT(std::chrono::steady_clock::now() - waiting_since <
+                    max_write_wait, "position %llu of replay buffer %s was "
+                    "never finished, so position %llu can't be written",
+                    (unsigned long long) (cur / 2),
+                    name.c_str(), (unsigned long long) n);
+            std::this_thread::yield();
+            cur = stamp.load(std::memory_order_acquire);
+        }
+        else if (stamp.compare_exchange_weak(cur, 2 * n + 1,
+                    std::memory_order_acq_rel)) {
+            break;
+        }
+    }
+
+    memcpy(slots + (n % header->capacity) * header->record_size, rec,
+            header->record_size);
+    stamp.store(2 * n + 2, std::memory_order_release);
+}
+
+void ReplayBuffer::add_game(const GameRecord & r) {
+    uint32_t rs = header->record_size;
+    thread_local std::vector<uint8_t> records;
+    records.resize(r.moves.size() * rs);
+    codec.pack_game(r, header->games.fetch_add(1, std::memory_order_relaxed),
+            records.data());
+
+    // the positions of a game are claimed together, so they sit side by side
+    uint64_t first = header->head.fetch_add(r.moves.size(),
+            std::memory_order_acq_rel);
+    for (size_t i = 0; i < r.moves.size(); i++) {
+        write_slot(first + i, &records[i * rs]);
+    }
+}
+
+bool ReplayBuffer::read(uint64_t n, uint8_t * rec) const {
+    const std::atomic<uint64_t> & stamp = stamps[n % header->capacity];
+    uint64_t before = stamp.load(std::memory_order_acquire);
+    if (before != 2 * n + 2) {
+        return false;
+    }
+    memcpy(rec, slots + (n % header->capacity) * header->record_size,
+            header->record_size);
+    // the copy must be done before the stamp is read again
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return stamp.load(std::memory_order_relaxed) == before;
+}
+
+void ReplayBuffer::sample(uint32_t n, Xorshift & rng, TrainingBatch & b,
+        double half_life) const {
+    uint64_t head = n_positions();
+    uint64_t count = std::min(head, header->capacity);
+    GO_ASSERT(count > 0, "replay buffer %s is empty", name.c_str());
+
+    // the chance of drawing the position of age a is proportional to
+    // e^(-rate * a), and ages are drawn by inverting the distribution over
+    // the ages held, in which the oldest has cumulative probability 1 - tail
+    double rate = half_life > 0 ? std::log(2.) / half_life : 0.;
+    double tail = -std::expm1(-rate * count);
+
+    codec.resize(b, n);
+    thread_local std::vector<uint8_t> rec;
+    rec.resize(header->record_size);
+    uint32_t k = 0;
+    // failed reads since the last position was read, and when they began to
+    // take long enough to wait on
+    uint32_t misses = 0;
+    std::chrono::steady_clock::time_point waiting_since;
+    while (k < n) {
+        // positions still being written, or overwritten while being read,
+        // are skipped for others. If none can be read the writers are
+        // mid-write, so let them run and look at the latest positions again,
+        // giving up only if they never finish (which they won't if a writer
+        // died)
+        if (misses == 64) {
+            waiting_since = std::chrono::steady_clock::now();
+        }
+        if (misses >= 64 && misses % 64 == 0) {
+            std::this_thread::yield();
+            GO_ASSERT(std::chrono::steady_clock::now() - waiting_since <
+                    max_read_wait, "could not read positions from replay "
+                    "buffer %s", name.c_str());
+            head = n_positions();
+            count = std::min(head, header->capacity);
+            tail = -std::expm1(-rate * count);
+        }
+
+        uint64_t age;
+        if (half_life > 0) {
+            double u = (rng.next() >> 11) * 0x1.0p-53;
+            age = std::min<uint64_t>(count - 1,
+                    (uint64_t) (-std::log1p(-u * tail) / rate));
+        }
+        else {
+            age = rng.next() % count;
+        }
+        uint64_t i = head - 1 - age;
+        if (!read(i, rec.data())) {
+            misses++;
+            continue;
+        }
+        codec.decode(rec.data(), codec.random_symmetry(rng), b, k);
+        b.positions[k] = i;
+        k++;
+        misses = 0;
+    }
+}
+
@@ -0,0 +1,157 @@
+
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <self_play.h>
+#include <xorshift.h>
+
+
+SelfPlay::SelfPlay(coord_t w, coord_t h, uint32_t playouts,
+        uint32_t n_threads) : w(w), h(h), playouts(playouts),
+        n_threads(n_threads), sample_moves(default_sample_moves),
+        exploration(MctsMove::default_exploration),
+        seed(std::chrono::steady_clock::now().time_since_epoch().count()),
+        evaluator(nullptr), games_started(0), games_done(0),
+        positions_done(0), playing(false) {
+    GO_ASSERT(n_threads >= 1, "SelfPlay needs at least one thread");
+    start = end = std::chrono::steady_clock::now();
+}
+
+void SelfPlay::play_game(uint64_t i, GameRecord & r, GameRecordWriter & out) {
+    // spread the seeds apart, as MctsMove::seed does
+    uint64_t s = (seed + i) * 0x9e3779b97f4a7c15llu;
+    Xorshift rng(s);
+
+    // each expansion adds a node for every legal move, so this holds the
+    // whole tree of a search, and keeps hundreds of games small
+    uint32_t n_tiles = w * h;
+    uint32_t arena_log_size = 1;
+    while ((1ull << arena_log_size) < (uint64_t) playouts * (n_tiles + 1) &&
+            arena_log_size < MctsMove::default_arena_log_size) {
+        arena_log_size++;
+    }
+
+    Go g(w, h);
+    MctsMove m(g, playouts, exploration, arena_log_size, 1);
+    m.set_evaluator(evaluator);
+    m.set_verbose(false);
+    m.seed(s);
+
+    std::vector<board_idx_t> moves(Go::max_legal_moves + 1);
+    std::vector<uint32_t> visits(Go::max_legal_moves + 1);
+    std::vector<uint16_t> visited(Go::max_legal_moves + 1);
+    std::vector<uint32_t> counts(Go::max_legal_moves + 1);
+
+    r.clear(w, h);
+    uint32_t max_moves = max_moves_per_tile * n_tiles;
+    while (!g.game_over() && r.moves.size() < max_moves) {
+        GoMove best;
+        m.next_move(best);
+
+        uint32_t n = m.get_root_visits(moves.data(), visits.data());
+        uint32_t n_visited = 0;
+        uint64_t total = 0;
+        for (uint32_t j = 0; j < n; j++) {
+            if (visits[j] == 0) {
+                continue;
+            }
+            visited[n_visited] = moves[j] == Go::no_position ?
+                GameRecord::pass : g.idx_y(moves[j]) * w + g.idx_x(moves[j]);
+            counts[n_visited] = visits[j];
+            total += visits[j];
+            n_visited++;
+        }
+
+        board_idx_t idx = best.color == Color::pass ? Go::no_position :
+            g.to_idx(best.x, best.y);
+        if (r.moves.size() < sample_moves && total > 0) {
+            uint64_t pick = ((rng.next() >> 32) * total) >> 32;
+            uint32_t j = 0;
+            while (pick >= visits[j]) {
+                pick -= visits[j];
+                j++;
+            }
+            idx = moves[j];
+        }
+
+        r.add_move(idx == Go::no_position ? GameRecord::pass :
+                g.idx_y(idx) * w + g.idx_x(idx), visited.data(),
+                counts.data(), n_visited);
+        g.play_idx(idx);
+    }
+    r.score = g.get_score();
+
+    out.write(r);
+    positions_done.fetch_add(r.moves.size(), std::memory_order_relaxed);
+    games_done.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SelfPlay::play(uint64_t n_games, GameRecordWriter & out) {
+    games_started = 0;
+    games_done = 0;
+    positions_done = 0;
+    start = std::chrono::steady_clock::now();
+    playing.store(true, std::memory_order_release);
+
+    // the first error any thread hit, which would terminate the program if
+    // it escaped a thread, so it stops every thread and is rethrown here
+    std::mutex error_lock;
+    std::exception_ptr error;
+    auto fail = [&]() {
+        std::lock_guard<std::mutex> l(error_lock);
+        if (!error) {
+            error = std::current_exception();
+        }
+        // hand out no more games
+        games_started.store(n_games, std::memory_order_relaxed);
+    };
+
+    auto run_games = [this, n_games, &out, &fail]() {
+        try {
+            GameRecord r;
+            uint64_t i;
+            while ((i = games_started.fetch_add(1,
+                            std::memory_order_relaxed)) < n_games) {
+                play_game(i, r, out);
+            }
+        } catch (...) {
+            fail();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < n_threads; i++) {
+        threads.emplace_back(run_games);
+    }
+    run_games();
+    for (std::thread & t : threads) {
+        t.join();
+    }
+    // the games finished before any error are kept
+    try {
+        out.flush();
+    } catch (...) {
+        fail();
+    }
+
+    end = std::chrono::steady_clock::now();
+    playing.store(false, std::memory_order_release);
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+SelfPlay::Stats SelfPlay::get_stats() const {
+    Stats s;
+    bool running = playing.load(std::memory_order_acquire);
+    s.games = games_done.load(std::memory_order_relaxed);
+    s.positions = positions_done.load(std::memory_order_relaxed);
+    s.seconds = std::chrono::duration<double>((running ?
+                std::chrono::steady_clock::now() : end) - start).count();
+    s.games_per_hour = s.seconds > 0 ? 3600. * s.games / s.seconds : 0.;
+    s.positions_per_second = s.seconds > 0 ? s.positions / s.seconds : 0.;
+    return s;
+}
+
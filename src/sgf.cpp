@@ -0,0 +1,319 @@
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <sgf.h>
+
+
+// the largest board SGF has coordinates for
+static constexpr coord_t max_sgf_size = 52;
+
+/*
+ * property identifiers of up to 4 letters packed into an int, so the ones
+ * kept can be told apart with a switch
+ */
+static constexpr uint32_t prop_id(const char * s) {
+    uint32_t id = 0;
+    for (; *s != '\0'; s++) {
+        id = (id << 8) | (uint8_t) *s;
+    }
+    return id;
+}
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' ||
+        c == '\f';
+}
+
+/*
+ * the coordinate of the letter c, or max_sgf_size if it isn't one
+ */
+static uint32_t sgf_coord(char c) {
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a';
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return c - 'A' + 26;
+    }
+    return max_sgf_size;
+}
+
+/*
+ * the number at the start of s, stopping at the first character which isn't
+ * a digit, or -1 if there is none
+ */
+static int32_t parse_uint(std::string_view s, size_t & i) {
+    int32_t n = -1;
+    for (; i < s.size() && s[i] >= '0' && s[i] <= '9' && n < 0xffff; i++) {
+        n = (n < 0 ? 0 : 10 * n) + (s[i] - '0');
+    }
+    return n;
+}
+
+
+SgfCollection::SgfCollection(const std::string & path) : path(path),
+        data(nullptr), size(0), mapped(false) {
+    int fd = open(path.c_str(), O_RDONLY);
+    GO_ASSERT(fd != -1, "could not open sgf file %s", path.c_str());
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    if (ok && st.st_size > 0) {
+        size = st.st_size;
+        void * m = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ok = m != MAP_FAILED;
+        data = ok ? (const char *) m : nullptr;
+        mapped = ok;
+    }
+    ::close(fd);
+    GO_ASSERT(ok, "could not map sgf file %s", path.c_str());
+    if (mapped) {
+        // read once, front to back
+        madvise((void *) data, size, MADV_SEQUENTIAL);
+    }
+
+    parse();
+}
+
+SgfCollection::SgfCollection(const char * data, size_t size) :
+        path("<buffer>"), data(data), size(size), mapped(false) {
+    parse();
+}
+
+SgfCollection::~SgfCollection() {
+    if (mapped) {
+        munmap((void *) data, size);
+    }
+}
+
+
+void SgfCollection::parse() {
+    const char * p = data;
+    const char * const end = data + size;
+
+    // the trees of the game being read which are open
+    uint32_t depth = 0;
+    // set once the main line ended, which is at the first tree to close, as
+    // every tree opened before it was the first variation of its parent
+    bool line_done = false;
+    SgfGame * g = nullptr;
+
+    while (p < end) {
+        char c = *p;
+        if (depth == 0) {
+            // text between games is ignored
+            const char * open = (const char *) memchr(p, '(', end - p);
+            if (open == nullptr) {
+                break;
+            }
+            p = open + 1;
+            depth = 1;
+            line_done = false;
+            games.push_back({ 19, 19, 0.f, {}, {}, {}, (uint32_t) moves.size(),
+                    (uint32_t) moves.size(), (uint32_t) moves.size() });
+            g = &games.back();
+            continue;
+        }
+
+        if (is_space(c) || c == ';') {
+            p++;
+        }
+        else if (c == '(') {
+            depth++;
+            p++;
+        }
+        else if (c == ')') {
+            depth--;
+            line_done = true;
+            p++;
+            if (depth == 0) {
+                g->end = moves.size();
+                // in files for boards up to 19x19, tt is also a pass
+                if (g->w <= 19 && g->h <= 19) {
+                    for (uint32_t i = g->move_start; i < g->end; i++) {
+                        if (moves[i].x == 19 && moves[i].y == 19) {
+                            moves[i].x = moves[i].y = SgfMove::pass;
+                        }
+                    }
+                }
+                for (uint32_t i = g->setup_start; i < g->end; i++) {
+                    const SgfMove & m = moves[i];
+                    GO_ASSERT(m.x == SgfMove::pass || (m.x < g->w &&
+                                m.y < g->h), "move %u of game %zu of %s is "
+                            "off the %ux%u board", i - g->setup_start,
+                            games.size() - 1, path.c_str(), g->w, g->h);
+                }
+            }
+        }
+        else if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) {
+            // property identifiers are capital letters, but old versions of
+            // the format allowed lower case ones in between
+            uint32_t id = 0;
+            for (; p < end && ((*p >= 'A' && *p <= 'Z') ||
+                        (*p >= 'a' && *p <= 'z')); p++) {
+                if (*p <= 'Z') {
+                    id = (id << 8) | (uint8_t) *p;
+                }
+            }
+
+            // each value of the property
+            bool first = true;
+            while (true) {
+                for (; p < end && is_space(*p); p++);
+                if (p == end || *p != '[') {
+                    GO_ASSERT(!first, "property without a value at byte %zu "
+                            "of %s", (size_t) (p - data), path.c_str());
+                    break;
+                }
+                first = false;
+                p++;
+
+                // the value runs to the first ] not escaped by an odd number
+                // of backslashes
+                const char * close = p;
+                while (true) {
+                    close = (const char *) memchr(close, ']', end - close);
+                    GO_ASSERT(close != nullptr, "unterminated property value "
+                            "at byte %zu of %s", (size_t) (p - data),
+                            path.c_str());
+                    const char * b = close;
+                    for (; b > p && b[-1] == '\\'; b--);
+                    if (((close - b) & 1) == 0) {
+                        break;
+                    }
+                    close++;
+                }
+                std::string_view v(p, close - p);
+                p = close + 1;
+
+                if (line_done) {
+                    continue;
+                }
+                switch (id) {
+                    case prop_id("B"):
+                    case prop_id("W"): {
+                        SgfMove m;
+                        m.color = id == prop_id("B") ? Color::black :
+                            Color::white;
+                        if (v.empty()) {
+                            m.x = m.y = SgfMove::pass;
+                        }
+                        else {
+                            GO_ASSERT(v.size() == 2 && sgf_coord(v[0]) <
+                                    max_sgf_size && sgf_coord(v[1]) <
+                                    max_sgf_size, "bad move at byte %zu of "
+                                    "%s", (size_t) (v.data() - data),
+                                    path.c_str());
+                            m.x = sgf_coord(v[0]);
+                            m.y = sgf_coord(v[1]);
+                        }
+                        moves.push_back(m);
+                        break;
+                    }
+                    case prop_id("AB"):
+                    case prop_id("AW"): {
+                        if (moves.size() != g->move_start) {
+                            break;
+                        }
+                        // a point, or the rectangle between two corners
+                        GO_ASSERT((v.size() == 2 || (v.size() == 5 &&
+                                        v[2] == ':')) &&
+                                sgf_coord(v[0]) < max_sgf_size &&
+                                sgf_coord(v[1]) < max_sgf_size &&
+                                (v.size() == 2 || (sgf_coord(v[3]) <
+                                    max_sgf_size && sgf_coord(v[4]) <
+                                    max_sgf_size)), "bad setup stone at "
+                                "byte %zu of %s", (size_t) (v.data() - data),
+                                path.c_str());
+                        uint32_t x0 = sgf_coord(v[0]), y0 = sgf_coord(v[1]);
+                        uint32_t x1 = x0, y1 = y0;
+                        if (v.size() == 5) {
+                            x1 = sgf_coord(v[3]);
+                            y1 = sgf_coord(v[4]);
+                        }
+                        uint8_t color = id == prop_id("AB") ? Color::black :
+                            Color::white;
+                        for (uint32_t y = std::min(y0, y1);
+                                y <= std::max(y0, y1); y++) {
+                            for (uint32_t x = std::min(x0, x1);
+                                    x <= std::max(x0, x1); x++) {
+                                moves.push_back({ color, (uint8_t) x,
+                                        (uint8_t) y });
+                            }
+                        }
+                        g->move_start = moves.size();
+                        break;
+                    }
+                    case prop_id("SZ"): {
+                        // either the size of a square board or w:h
+                        size_t i = 0;
+                        int32_t w = parse_uint(v, i), h = w;
+                        if (i < v.size() && v[i] == ':') {
+                            i++;
+                            h = parse_uint(v, i);
+                        }
+                        GO_ASSERT(i == v.size() && w > 0 && h > 0 &&
+                                w <= max_sgf_size && h <= max_sgf_size,
+                                "bad board size at byte %zu of %s",
+                                (size_t) (v.data() - data), path.c_str());
+                        g->w = w;
+                        g->h = h;
+                        break;
+                    }
+                    case prop_id("KM"):
+                        // the value always ends at a ], where strtof stops
+                        g->komi = strtof(v.data(), nullptr);
+                        break;
+                    case prop_id("PB"):
+                        g->black = v;
+                        break;
+                    case prop_id("PW"):
+                        g->white = v;
+                        break;
+                    case prop_id("RE"):
+                        g->result = v;
+                        break;
+                }
+            }
+        }
+        else {
+            GO_ASSERT(false, "unexpected '%c' at byte %zu of %s", c,
+                    (size_t) (p - data), path.c_str());
+        }
+    }
+    GO_ASSERT(depth == 0, "game %zu of %s is cut off", games.size() - 1,
+            path.c_str());
+}
+
+
+std::string SgfCollection::text(std::string_view value) {
+    std::string s;
+    s.reserve(value.size());
+    for (size_t i = 0; i < value.size(); i++) {
+        if (value[i] != '\\') {
+            s.push_back(value[i]);
+            continue;
+        }
+        i++;
+        if (i == value.size()) {
+            break;
+        }
+        // an escaped line break is a soft one, and is left out
+        if (value[i] == '\r' || value[i] == '\n') {
+            if (i + 1 < value.size() && value[i + 1] != value[i] &&
+                    (value[i + 1] == '\r' || value[i + 1] == '\n')) {
+                i++;
+            }
+            continue;
+        }
+        s.push_back(value[i]);
+    }
+    return s;
+}
+
@@ -0,0 +1,336 @@
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <training_data.h>
+
+
+/*
+ * the number of uint64 words a w x h board packed 2 bits to a tile takes
+ */
+static uint32_t board_words(coord_t w, coord_t h) {
+    return (2 * w * h + 63) / 64;
+}
+
+static uint32_t policy_bytes(coord_t w, coord_t h) {
+    return ((w * h + 1) * sizeof(uint16_t) + 7) & ~7u;
+}
+
+
+uint32_t TrainingCodec::record_size(coord_t w, coord_t h) {
+    return sizeof(TrainingRecord) + board_words(w, h) * sizeof(uint64_t) +
+        policy_bytes(w, h);
+}
+
+const std::array<uint32_t, 256> TrainingCodec::unpack_table = []() {
+    std::array<uint32_t, 256> t;
+    for (uint32_t b = 0; b < 256; b++) {
+        uint8_t tiles[4];
+        for (uint32_t i = 0; i < 4; i++) {
+            tiles[i] = (b >> (2 * i)) & 3;
+        }
+        memcpy(&t[b], tiles, 4);
+    }
+    return t;
+}();
+
+TrainingCodec::TrainingCodec(coord_t w, coord_t h) : w(w), h(h),
+        n_words(board_words(w, h)) {
+    uint32_t n_tiles = w * h;
+    sources.resize(8 * n_tiles);
+    for (uint32_t s = 0; s < 8; s++) {
+        if (w != h && (s & 1) != 0) {
+            // turns the board on its side
+            continue;
+        }
+        for (coord_t y = 0; y < h; y++) {
+            for (coord_t x = 0; x < w; x++) {
+                coord_t tx = (s & 4) ? w - x - 1 : x;
+                coord_t ty = y;
+                coord_t cw = w, ch = h;
+                for (uint32_t r = 0; r < (s & 3); r++) {
+                    coord_t _x = tx;
+                    tx = ch - ty - 1;
+                    ty = _x;
+                    std::swap(cw, ch);
+                }
+                sources[s * n_tiles + ty * cw + tx] = y * w + x;
+            }
+        }
+    }
+}
+
+void TrainingCodec::pack_game(const GameRecord & r, uint32_t game,
+        uint8_t * out) const {
+    GO_ASSERT(r.w == w && r.h == h, "can't pack a %ux%u game into records of "
+            "%ux%u positions", r.w, r.h, w, h);
+
+    uint32_t n_tiles = w * h;
+    uint32_t size = record_size();
+    float value = r.score > 0 ? 1.f : r.score < 0 ? -1.f : 0.f;
+
+    Go g(w, h);
+    for (size_t i = 0; i < r.moves.size(); i++) {
+        uint8_t * rec = out + i * size;
+        memset(rec, 0, size);
+
+        TrainingRecord & tr = *reinterpret_cast<TrainingRecord *>(rec);
+        tr.value = value;
+        tr.score = r.score;
+        tr.game = game;
+        tr.move_number = i;
+        tr.move = r.moves[i];
+        tr.turn = (g.get_player() == Color::white) + (g.has_passed() << 1);
+
+        uint64_t * board = reinterpret_cast<uint64_t *>(rec + sizeof(tr));
+        for (uint32_t t = 0; t < n_tiles; t++) {
+            Color c = g.tile_at(t % w, t / w);
+            uint64_t tile = c == Color::black ? 1 : c == Color::white ? 2 :
+                c == Color::ko ? 3 : 0;
+            board[t / 32] |= tile << (2 * (t % 32));
+        }
+
+        uint16_t * policy = reinterpret_cast<uint16_t *>(board + n_words);
+        uint64_t total = 0;
+        for (uint32_t j = r.visit_start[i]; j < r.visit_start[i + 1]; j++) {
+            total += r.visit_counts[j];
+        }
+        for (uint32_t j = r.visit_start[i]; j < r.visit_start[i + 1]; j++) {
+            uint16_t m = r.visit_moves[j];
+            uint32_t t = m == GameRecord::pass ? n_tiles : m;
+            GO_ASSERT(t <= n_tiles, "visited move %u is off the board", m);
+            policy[t] = std::lround(0xffff * (double) r.visit_counts[j] /
+                    total);
+        }
+
+        uint16_t m = r.moves[i];
+        g.play_idx(m == GameRecord::pass ? Go::no_position :
+                g.to_idx(m % w, m / w));
+    }
+}
+
+void TrainingCodec::read(const uint8_t * rec, uint32_t s, uint8_t * board,
+        float * policy) const {
+    GO_ASSERT(s < 8 && (w == h || (s & 1) == 0), "symmetry %u of a %ux%u "
+            "board", s, w, h);
+    uint32_t n_tiles = w * h;
+    const uint8_t * packed = rec + sizeof(TrainingRecord);
+
+    // unpack the board a byte (4 tiles) at a time, then move every tile at
+    // once through the symmetry's table
+    thread_local std::vector<uint8_t> tiles;
+    tiles.resize(n_words * 32);
+    for (uint32_t b = 0; b < n_words * 8; b++) {
+        memcpy(&tiles[4 * b], &unpack_table[packed[b]], 4);
+    }
+    const uint16_t * src = &sources[s * n_tiles];
+    for (uint32_t t = 0; t < n_tiles; t++) {
+        board[t] = tiles[src[t]];
+    }
+
+    if (policy != nullptr) {
+        const uint16_t * p = reinterpret_cast<const uint16_t *>(packed +
+                n_words * sizeof(uint64_t));
+        uint32_t total = 0;
+        for (uint32_t t = 0; t <= n_tiles; t++) {
+            total += p[t];
+        }
+        float scale = total == 0 ? 0.f : 1.f / total;
+        for (uint32_t t = 0; t < n_tiles; t++) {
+            policy[t] = p[src[t]] * scale;
+        }
+        policy[n_tiles] = p[n_tiles] * scale;
+    }
+}
+
+void TrainingCodec::decode(const uint8_t * rec, uint32_t s, TrainingBatch & b,
+        uint32_t k) const {
+    uint32_t n_tiles = w * h;
+    uint32_t n_planes = TrainingBatch::n_planes;
+
+    thread_local std::vector<uint8_t> board;
+    board.resize(n_tiles);
+    read(rec, s, board.data(), &b.policies[(size_t) k * (n_tiles + 1)]);
+
+    const TrainingRecord & r = *reinterpret_cast<const TrainingRecord *>(rec);
+    uint8_t player = (r.turn & 1) ? 2 : 1;
+    float black_to_move = player == 1 ? 1.f : 0.f;
+    float * in = &b.inputs[(size_t) k * n_tiles * n_planes];
+    for (uint32_t t = 0; t < n_tiles; t++) {
+        uint8_t c = board[t];
+        bool empty = c == 0 || c == 3;
+        in[0] = c == player;
+        in[1] = !empty && c != player;
+        in[2] = empty;
+        in[3] = black_to_move;
+        in += n_planes;
+    }
+    b.values[k] = r.value;
+    b.symmetries[k] = s;
+}
+
+void TrainingCodec::resize(TrainingBatch & b, uint32_t n) const {
+    uint32_t n_tiles = w * h;
+    b.n = n;
+    b.inputs.resize((size_t) n * n_tiles * TrainingBatch::n_planes);
+    b.policies.resize((size_t) n * (n_tiles + 1));
+    b.values.resize(n);
+    b.symmetries.resize(n);
+    b.positions.resize(n);
+}
+
+
+TrainingWriter::TrainingWriter(const std::string & path, coord_t w,
+        coord_t h, uint32_t chunk_positions) : path(path),
+        f(path, std::ios::binary), closed(false), codec(w, h), chunk_fill(0),
+        n_games(0) {
+    GO_ASSERT(f, "could not open training file %s", path.c_str());
+    GO_ASSERT(chunk_positions > 0, "chunks must hold at least one position");
+
+    header = {};
+    header.magic = file_magic;
+    header.version = file_version;
+    header.w = w;
+    header.h = h;
+    header.record_size = codec.record_size();
+    header.chunk_positions = chunk_positions;
+    chunk.resize((size_t) chunk_positions * header.record_size);
+
+    // rewritten by close, once the counts are known
+    f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+}
+
+TrainingWriter::~TrainingWriter() {
+    if (!closed) {
+        close();
+    }
+}
+
+void TrainingWriter::write_chunk() {
+    if (chunk_fill == 0) {
+        return;
+    }
+    chunks.push_back({ (uint64_t) f.tellp(), header.n_positions });
+    f.write(reinterpret_cast<const char *>(chunk.data()),
+            (size_t) chunk_fill * header.record_size);
+    GO_ASSERT(f, "failed to write training file %s", path.c_str());
+    header.n_positions += chunk_fill;
+    chunk_fill = 0;
+}
+
+void TrainingWriter::add_game(const GameRecord & r) {
+    GO_ASSERT(!closed, "training file %s is closed", path.c_str());
+    uint32_t size = header.record_size;
+    game_records.resize(r.moves.size() * size);
+    codec.pack_game(r, n_games, game_records.data());
+
+    for (size_t i = 0; i < r.moves.size(); i++) {
+        memcpy(&chunk[(size_t) chunk_fill * size], &game_records[i * size],
+                size);
+        if (++chunk_fill == header.chunk_positions) {
+            write_chunk();
+        }
+    }
+    n_games++;
+}
+
+void TrainingWriter::close() {
+    GO_ASSERT(!closed, "training file %s is already closed", path.c_str());
+    closed = true;
+    write_chunk();
+
+    header.n_chunks = chunks.size();
+    header.index_offset = f.tellp();
+    f.write(reinterpret_cast<const char *>(chunks.data()),
+            chunks.size() * sizeof(TrainingChunk));
+    f.seekp(0);
+    f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    f.close();
+    GO_ASSERT(f, "failed to write training file %s", path.c_str());
+}
+
+
+TrainingReader::TrainingReader(const std::string & path) : path(path),
+        data(nullptr), size(0), codec(1, 1) {
+    int fd = open(path.c_str(), O_RDONLY);
+    GO_ASSERT(fd != -1, "could not open training file %s", path.c_str());
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(*header)) {
+        size = st.st_size;
+        void * m = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        data = m == MAP_FAILED ? nullptr : (const uint8_t *) m;
+    }
+    ::close(fd);
+    GO_ASSERT(data != nullptr, "could not map training file %s",
+            path.c_str());
+    // minibatches read records from all over the file
+    madvise((void *) data, size, MADV_RANDOM);
+
+    header = reinterpret_cast<const TrainingFileHeader *>(data);
+    GO_ASSERT(header->magic == TrainingWriter::file_magic, "%s is not a "
+            "training file", path.c_str());
+    GO_ASSERT(header->version == TrainingWriter::file_version, "training file "
+            "%s has version %u, expected %u", path.c_str(), header->version,
+            TrainingWriter::file_version);
+    GO_ASSERT(header->w > 0 && header->h > 0 &&
+            header->w * header->h <= Go::max_legal_moves &&
+            header->chunk_positions > 0 && header->record_size ==
+            TrainingCodec::record_size(header->w, header->h), "training "
+            "file %s has a bad header", path.c_str());
+    GO_ASSERT(header->index_offset <= size && header->n_chunks <=
+            (size - header->index_offset) / sizeof(TrainingChunk), "training "
+            "file %s is truncated", path.c_str());
+
+    GO_ASSERT((header->n_positions + header->chunk_positions - 1) /
+            header->chunk_positions == header->n_chunks, "training file %s "
+            "has %llu positions in %llu chunks", path.c_str(),
+            (unsigned long long) header->n_positions,
+            (unsigned long long) header->n_chunks);
+
+    // every chunk but the last is full, so the chunk of a position is found
+    // by dividing
+    chunks = reinterpret_cast<const TrainingChunk *>(data +
+            header->index_offset);
+    for (uint64_t c = 0; c < header->n_chunks; c++) {
+        uint64_t n = std::min<uint64_t>(header->chunk_positions,
+                header->n_positions - c * header->chunk_positions);
+        GO_ASSERT(chunks[c].first_position == c * header->chunk_positions &&
+                chunks[c].offset <= size && n * header->record_size <=
+                size - chunks[c].offset, "chunk %llu of training file %s is "
+                "corrupt", (unsigned long long) c, path.c_str());
+    }
+
+    codec = TrainingCodec(header->w, header->h);
+}
+
+TrainingReader::~TrainingReader() {
+    munmap((void *) data, size);
+}
+
+const uint8_t * TrainingReader::record_at(uint64_t i) const {
+    GO_ASSERT(i < header->n_positions, "position %llu of %llu",
+            (unsigned long long) i, (unsigned long long) header->n_positions);
+    const TrainingChunk & c = chunks[i / header->chunk_positions];
+    return data + c.offset + (i - c.first_position) * header->record_size;
+}
+
+void TrainingReader::sample(uint32_t n, Xorshift & rng,
+        TrainingBatch & b) const {
+    GO_ASSERT(header->n_positions > 0, "training file %s is empty",
+            path.c_str());
+    codec.resize(b, n);
+    for (uint32_t k = 0; k < n; k++) {
+        uint64_t i = rng.next() % header->n_positions;
+        codec.decode(record_at(i), codec.random_symmetry(rng), b, k);
+        b.positions[k] = i;
+    }
+}
+
@@ -0,0 +1,89 @@
+
+#include <cstdlib>
+#include <stdexcept>
+
+#include <util/util.h>
+
+#include <transposition_table.h>
+
+
+TranspositionTable::TranspositionTable(uint32_t log_size) :
+        n_entries(1llu << log_size) {
+    GO_ASSERT(n_entries >= bucket_size, "transposition table must have at "
+            "least %u entries", bucket_size);
+
+    mem = malloc(n_entries * sizeof(Slot) + alignment);
+    if (!mem) {
+        throw std::runtime_error("unable to malloc memory for transposition "
+                "table");
+    }
+    slots = (Slot *) util::align_up((uint64_t) mem, alignment);
+
+    clear();
+}
+
+TranspositionTable::~TranspositionTable() {
+    free(mem);
+}
+
+
+void TranspositionTable::clear() {
+    for (uint64_t i = 0; i < n_entries; i++) {
+        slots[i].check.store(0, std::memory_order_relaxed);
+        slots[i].data.store(0, std::memory_order_relaxed);
+    }
+}
+
+
+bool TranspositionTable::probe(zob_hash_t key, TTEntry & e) const {
+    const Slot * b = bucket(key);
+    for (uint32_t i = 0; i < bucket_size; i++) {
+        uint64_t data = b[i].data.load(std::memory_order_relaxed);
+        uint64_t check = b[i].check.load(std::memory_order_relaxed);
+        if ((check ^ data) == key) {
+            e = unpack(key, data);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void TranspositionTable::store(zob_hash_t key, uint16_t raw_check, int depth,
+        uint8_t bound, int score, uint16_t move) {
+    Slot * b = bucket(key);
+
+    // depth-preferred replacement: overwrite this key's entry if it has one,
+    // otherwise the shallowest entry in the bucket (empty entries have depth
+    // 0). Other threads may be changing the bucket at the same time, which
+    // at worst replaces a better entry than we meant to
+    Slot * dst = &b[0];
+    uint8_t dst_depth = 0xff;
+    for (uint32_t i = 0; i < bucket_size; i++) {
+        uint64_t data = b[i].data.load(std::memory_order_relaxed);
+        uint64_t check = b[i].check.load(std::memory_order_relaxed);
+        TTEntry e = unpack(check ^ data, data);
+
+        if (e.key == key) {
+            if (depth < e.depth && e.bound == exact) {
+                // don't replace a deeper exact score with a shallower one
+                return;
+            }
+            if (move == no_move && e.raw_check == raw_check) {
+                // keep the best move from the previous search
+                move = e.move;
+            }
+            dst = &b[i];
+            break;
+        }
+        if (i == 0 || e.depth < dst_depth) {
+            dst = &b[i];
+            dst_depth = e.depth;
+        }
+    }
+
+    uint64_t data = pack(score, (uint8_t) depth, bound, move, raw_check);
+    dst->data.store(data, std::memory_order_relaxed);
+    dst->check.store(key ^ data, std::memory_order_relaxed);
+}
+
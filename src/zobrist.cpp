@@ -34,6 +34,18 @@ zob_hash_t ZobristHash::col_x(zob_hash_t h) {
 }
 
 
+zob_hash_t ZobristHash::transform(zob_hash_t h, bool mirror,
+        uint32_t rotations, bool swap_colors) {
+    if (mirror) {
+        h = vmir(h);
+    }
+    for (uint32_t i = 0; i < rotations % 4; i++) {
+        h = rot(h);
+    }
+    return swap_colors ? col_x(h) : h;
+}
+
+
 void ZobristHash::rot_coords(coord_t & x, coord_t & y) const {
     coord_t _x = x;
     coord_t _y = y;
@@ -294,6 +306,59 @@ ZobristHash::ZobristHash(coord_t w, coord_t h) : w(w), h(h), zt(nullptr) {
 
     initialize();
 
+    size_t n_padded_entries = (w + 2) * (h + 2) * num_states;
+    zob_hash_t * padded_table = (zob_hash_t *) calloc(n_padded_entries,
+            sizeof(zob_hash_t));
+    if (!padded_table) {
+        throw std::runtime_error("unable to malloc memory for zorist hash table");
+    }
+    for (coord_t y = 0; y < h; y++) {
+        for (coord_t x = 0; x < w; x++) {
+            board_idx_t padded_idx = (y + 1) * (w + 2) + (x + 1);
+            for (uint8_t c = 0; c < num_states; c++) {
+                padded_table[num_states * padded_idx + c] =
+                    table[to_idx(x, y, c)];
+            }
+        }
+    }
+
+    padded_zt = std::make_shared<ZobTable>(padded_table);
+
+    // splitmix64, so symm_key is the same in every run
+    uint64_t seed = 0;
+    auto next_key = [&]() {
+        seed += 0x9e3779b97f4a7c15llu;
+        uint64_t z = seed;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9llu;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebllu;
+        return z ^ (z >> 31);
+    };
+    symm_keys.assign(w * h * num_states, 0);
+    for (uint32_t i = 0; i < w * h; i++) {
+        for (uint8_t c = black; c < num_states; c++) {
+            symm_keys[num_states * i + c] = next_key();
+        }
+    }
+    for (uint32_t t = 0; t < 4; t++) {
+        symm_turn_keys[t] = next_key();
+    }
+
+    symm_dest.resize(8 * w * h);
+    for (uint32_t s = 0; s < 8; s++) {
+        for (coord_t y = 0; y < h; y++) {
+            for (coord_t x = 0; x < w; x++) {
+                coord_t tx = x, ty = y;
+                if (s & 4) {
+                    mir_coords(tx, ty);
+                }
+                for (uint32_t r = 0; r < (s & 3); r++) {
+                    rot_coords(tx, ty);
+                }
+                symm_dest[s * w * h + y * w + x] = ty * w + tx;
+            }
+        }
+    }
+
 
     /*
     printf("moves:\n");
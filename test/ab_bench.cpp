@@ -0,0 +1,144 @@
+#include <cstdio>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <thread>
+
+#include <alpha_beta_move.h>
+#include <bit_go.h>
+#include <go.h>
+
+
+struct BenchResult {
+    uint64_t nodes;
+    double secs;
+};
+
+
+static BenchResult run_search(Game & g, int depth, bool order_moves,
+        uint32_t n_threads=1, bool reductions=false, bool pvs=false) {
+    AlphaBetaMove ab(g, depth, 20, order_moves, n_threads);
+    ab.set_reductions(reductions);
+    ab.set_pvs(pvs);
+    GoMove m;
+
+    auto start = std::chrono::steady_clock::now();
+    ab.next_move(m);
+    auto end = std::chrono::steady_clock::now();
+
+    return { ab.get_node_count(),
+        std::chrono::duration<double>(end - start).count() };
+}
+
+
+/*
+ * searches the opening position of g to the given depth with and without
+ * move ordering, and reports how many fewer leaves ordering visits
+ */
+static void bench(const char * name, Game & g, int depth) {
+    BenchResult plain = run_search(g, depth, false);
+    BenchResult ordered = run_search(g, depth, true);
+
+    printf("%-12s depth %2d: %10llu leaves %8.3fs unordered, "
+            "%10llu leaves %8.3fs ordered (%.1f%% fewer leaves)\n",
+            name, depth, (unsigned long long) plain.nodes, plain.secs,
+            (unsigned long long) ordered.nodes, ordered.secs,
+            100. * (1. - ((double) ordered.nodes) / plain.nodes));
+}
+
+
+/*
+ * searches the opening position of g to the given depth with and without
+ * null move pruning and late move reductions
+ */
+static void bench_reductions(const char * name, Game & g, int depth) {
+    BenchResult full = run_search(g, depth, true, 1, false, true);
+    BenchResult reduced = run_search(g, depth, true, 1, true, true);
+
+    printf("%-12s depth %2d: %10llu leaves %8.3fs full width, "
+            "%10llu leaves %8.3fs reduced (%.1f%% fewer leaves)\n",
+            name, depth, (unsigned long long) full.nodes, full.secs,
+            (unsigned long long) reduced.nodes, reduced.secs,
+            100. * (1. - ((double) reduced.nodes) / full.nodes));
+}
+
+
+/*
+ * searches n_positions positions of a 5x5 board, each reached by playing
+ * n_moves random moves from a fixed seed, to the given depth with and
+ * without principal variation search
+ */
+static void bench_pvs(uint32_t n_positions, uint32_t n_moves, int depth) {
+    std::mt19937 rng(1);
+    BenchResult plain = { 0, 0 };
+    BenchResult pvs = { 0, 0 };
+
+    for (uint32_t i = 0; i < n_positions; i++) {
+        BitGo<5> g;
+        board_idx_t moves[BitGo<5>::n_tiles];
+        for (uint32_t j = 0; j < n_moves && !g.game_over(); j++) {
+            uint32_t n_legal = g.legal_moves(moves);
+            if (n_legal == 0) {
+                break;
+            }
+            g.play_idx(moves[rng() % n_legal]);
+        }
+        if (g.game_over()) {
+            continue;
+        }
+
+        BenchResult p = run_search(g, depth, true, 1, true, false);
+        BenchResult v = run_search(g, depth, true, 1, true, true);
+        plain.nodes += p.nodes;
+        plain.secs += p.secs;
+        pvs.nodes += v.nodes;
+        pvs.secs += v.secs;
+    }
+
+    printf("%2u positions depth %2d: %10llu leaves %8.3fs full window, "
+            "%10llu leaves %8.3fs pvs (%.1f%% fewer leaves)\n", n_positions,
+            depth, (unsigned long long) plain.nodes, plain.secs,
+            (unsigned long long) pvs.nodes, pvs.secs,
+            100. * (1. - ((double) pvs.nodes) / plain.nodes));
+}
+
+
+/*
+ * searches the opening position of g to the given depth with 1, 2, 4, ...
+ * threads, and reports the speedup of each over searching with one
+ */
+static void bench_threads(const char * name, Game & g, int depth) {
+    uint32_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    BenchResult base = run_search(g, depth, true, 1);
+    for (uint32_t n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+        BenchResult res = n_threads == 1 ? base :
+            run_search(g, depth, true, n_threads);
+        printf("%-12s depth %2d, %2u threads: %10llu leaves %8.3fs "
+                "(%.0f leaves/s, %.2fx time to depth)\n", name, depth,
+                n_threads, (unsigned long long) res.nodes, res.secs,
+                res.nodes / res.secs, base.secs / res.secs);
+    }
+}
+
+
+int main() {
+    Go go4(4, 4);
+    BitGo<4> bit_go4;
+    BitGo<5> bit_go5;
+
+    bench("Go 4x4", go4, 8);
+    bench("BitGo 4x4", bit_go4, 10);
+    bench("BitGo 5x5", bit_go5, 8);
+
+    bench_reductions("BitGo 5x5", bit_go5, 11);
+
+    bench_pvs(16, 6, 11);
+
+    bench_threads("BitGo 5x5", bit_go5, 9);
+
+    return 0;
+}
+
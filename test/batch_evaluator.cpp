@@ -0,0 +1,221 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <batch_evaluator.h>
+#include <go.h>
+#include <mcts_move.h>
+#include <network.h>
+
+
+static std::vector<float> random_weights(size_t n, float scale) {
+    std::vector<float> w(n);
+    for (float & x : w) {
+        x = scale * (2.f * rand() / RAND_MAX - 1.f);
+    }
+    return w;
+}
+
+
+/*
+ * a small network with random weights taking the planes of
+ * BatchEvaluator::encode_stones for an n x n board
+ */
+static Network random_network(uint32_t n) {
+    Network net(n, n, 4);
+    net.add_conv(0, 1, 3, 8, random_weights(3 * 3 * 4 * 8, .5f),
+            random_weights(8, .1f));
+    net.add_relu(1);
+    net.add_dense(1, 2, 1, random_weights(n * n * 8, .1f),
+            random_weights(1, .1f));
+    net.add_tanh(2);
+    net.add_dense(1, 3, n * n + 1, random_weights(n * n * 8 * (n * n + 1),
+                .1f), random_weights(n * n + 1, .1f));
+    net.add_output(2);
+    net.add_output(3);
+    return net;
+}
+
+
+/*
+ * the moves of g as MctsMove gives them to evaluators
+ */
+static std::vector<board_idx_t> legal_moves(Go & g) {
+    std::vector<board_idx_t> moves;
+    g.for_each_legal_move_inline([&](Game &, GoMove & m) -> bool {
+            moves.push_back(m.color == Color::pass ? Go::no_position :
+                g.to_idx(m.x, m.y));
+            return true;
+        });
+    return moves;
+}
+
+
+/*
+ * a random position n moves into a game on a 5x5 board
+ */
+static Go random_position(uint32_t n) {
+    Go g(5, 5);
+    for (uint32_t i = 0; i < n && !g.game_over(); i++) {
+        std::vector<board_idx_t> moves = legal_moves(g);
+        // don't pass unless there's nothing else
+        board_idx_t idx = moves[rand() % std::max<size_t>(moves.size() - 1,
+                1)];
+        g.play_idx(idx);
+    }
+    return g;
+}
+
+
+/*
+ * checks that positions evaluated by many threads at once in batches get the
+ * same values and priors as positions evaluated one at a time
+ */
+static void check_batches(Network & net) {
+    const uint32_t n_threads = 4;
+    const uint32_t n_positions = 50;
+
+    std::vector<Go> positions;
+    for (uint32_t i = 0; i < n_positions; i++) {
+        positions.push_back(random_position(i % 20));
+    }
+
+    // a batch of one with no timeout evaluates every position alone
+    std::vector<float> values(n_positions);
+    std::vector<std::vector<float>> priors(n_positions);
+    {
+        BatchEvaluator e(net, 1, std::chrono::microseconds(0));
+        for (uint32_t i = 0; i < n_positions; i++) {
+            std::vector<board_idx_t> moves = legal_moves(positions[i]);
+            priors[i].resize(moves.size());
+            values[i] = e.evaluate(positions[i], moves.data(), moves.size(),
+                    priors[i].data());
+        }
+        BatchEvaluator::Stats s = e.get_stats();
+        GO_ASSERT(s.positions == n_positions && s.batches == n_positions,
+                "%llu batches of %llu positions with a batch size of 1",
+                (unsigned long long) s.batches,
+                (unsigned long long) s.positions);
+    }
+
+    // with a timeout longer than the test, every batch waits until each
+    // thread has submitted a position
+    BatchEvaluator e(net, n_threads, std::chrono::seconds(10));
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < n_threads; t++) {
+        threads.emplace_back([&, t]() {
+                for (uint32_t i = 0; i < n_positions; i++) {
+                    uint32_t p = (i + t * 7) % n_positions;
+                    Go g(positions[p]);
+                    std::vector<board_idx_t> moves = legal_moves(g);
+                    std::vector<float> pr(moves.size());
+                    float v = e.evaluate(g, moves.data(), moves.size(),
+                            pr.data());
+                    GO_ASSERT(std::fabs(v - values[p]) < 1e-4f, "batched "
+                            "value %f, alone %f", v, values[p]);
+                    float sum = 0.f;
+                    for (uint32_t j = 0; j < moves.size(); j++) {
+                        GO_ASSERT(std::fabs(pr[j] - priors[p][j]) < 1e-4f,
+                                "batched prior %f, alone %f", pr[j],
+                                priors[p][j]);
+                        sum += pr[j];
+                    }
+                    GO_ASSERT(std::fabs(sum - 1.f) < 1e-4f, "priors sum to "
+                            "%f", sum);
+                }
+            });
+    }
+    for (std::thread & t : threads) {
+        t.join();
+    }
+
+    BatchEvaluator::Stats s = e.get_stats();
+    GO_ASSERT(s.positions == n_threads * n_positions, "%llu positions "
+            "evaluated", (unsigned long long) s.positions);
+    GO_ASSERT(s.fill_ratio == 1., "batches %.2f full", s.fill_ratio);
+    GO_ASSERT(s.max_queue_depth == n_threads && s.queue_depth == 0,
+            "queue depth %u, at most %u", s.queue_depth, s.max_queue_depth);
+}
+
+
+/*
+ * checks that a batch which can't fill is run once its timeout passes
+ */
+static void check_timeout(Network & net) {
+    BatchEvaluator e(net, 8, std::chrono::milliseconds(2));
+    Go g(5, 5);
+    std::vector<board_idx_t> moves = legal_moves(g);
+    std::vector<float> priors(moves.size());
+    for (int i = 0; i < 5; i++) {
+        e.evaluate(g, moves.data(), moves.size(), priors.data());
+    }
+
+    BatchEvaluator::Stats s = e.get_stats();
+    GO_ASSERT(s.batches == 5 && s.fill_ratio == 1. / 8, "%llu batches %.3f "
+            "full", (unsigned long long) s.batches, s.fill_ratio);
+    GO_ASSERT(s.latency_p50 >= 2000, "median latency %.0fus under the 2ms "
+            "timeout", s.latency_p50);
+
+    e.reset_stats();
+    s = e.get_stats();
+    GO_ASSERT(s.positions == 0 && s.batches == 0 && s.latency_p99 == 0,
+            "stats not reset");
+}
+
+
+/*
+ * checks that a position the network can't evaluate throws in the thread
+ * which submitted it, and leaves the evaluator working
+ */
+static void check_errors(Network & net) {
+    BatchEvaluator e(net, 2, std::chrono::milliseconds(1));
+    Go small(4, 4);
+    std::vector<board_idx_t> moves = legal_moves(small);
+    std::vector<float> priors(moves.size());
+    bool threw = false;
+    try {
+        e.evaluate(small, moves.data(), moves.size(), priors.data());
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    GO_ASSERT(threw, "evaluated a 4x4 board with a 5x5 network");
+
+    Go g(5, 5);
+    moves = legal_moves(g);
+    priors.resize(moves.size());
+    e.evaluate(g, moves.data(), moves.size(), priors.data());
+    GO_ASSERT(e.get_stats().positions == 1, "%llu positions evaluated",
+            (unsigned long long) e.get_stats().positions);
+}
+
+
+int main() {
+    srand(0);
+    Network net = random_network(5);
+
+    check_batches(net);
+    check_timeout(net);
+    check_errors(net);
+
+    // a search with one thread per entry of the batch
+    Go g(5, 5);
+    BatchEvaluator e(net, 4, std::chrono::milliseconds(1));
+    MctsMove m(g, 2000);
+    m.set_threads(4);
+    m.set_evaluator(&e);
+    GoMove move;
+    m.next_move(move);
+
+    BatchEvaluator::Stats s = e.get_stats();
+    printf("batch_evaluator ok (search: %llu positions in %llu batches, "
+            "%.0f%% full, latency p50 %.0fus p90 %.0fus p99 %.0fus)\n",
+            (unsigned long long) s.positions,
+            (unsigned long long) s.batches, 100 * s.fill_ratio,
+            s.latency_p50, s.latency_p90, s.latency_p99);
+    return 0;
+}
+
@@ -0,0 +1,110 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <memory>
+#include <vector>
+
+#include <bit_go.h>
+#include <go.h>
+#include <zobrist.h>
+
+
+static std::vector<GoMove> legal_moves(Game & g) {
+    std::vector<GoMove> moves;
+    g.for_each_legal_move([&](Game &, GameMove & m) -> bool {
+            moves.push_back(dynamic_cast<GoMove &>(m));
+            return true;
+        });
+    return moves;
+}
+
+
+/*
+ * checks that bg is in the same state as g, with the same legal moves
+ */
+template<coord_t W, coord_t H>
+static void check_same(BitGo<W, H> & bg, Go & g) {
+    for (coord_t y = 0; y < H; y++) {
+        for (coord_t x = 0; x < W; x++) {
+            GO_ASSERT(bg.tile_at(x, y) == g.tile_at(x, y), "tile (%u, %u) "
+                    "differs on turn %u", x, y, g.get_turn());
+        }
+    }
+    GO_ASSERT(bg.get_score() == g.get_score() &&
+            bg.get_turn() == g.get_turn() &&
+            bg.game_over() == g.game_over() &&
+            bg.get_raw_hash() == g.get_raw_hash(),
+            "state differs on turn %u", g.get_turn());
+
+    std::vector<GoMove> bm = legal_moves(bg);
+    std::vector<GoMove> gm = legal_moves(g);
+    GO_ASSERT(bm.size() == gm.size(), "BitGo has %zu legal moves, Go has %zu",
+            bm.size(), gm.size());
+    for (size_t i = 0; i < bm.size(); i++) {
+        GO_ASSERT(bm[i].color == gm[i].color &&
+                (bm[i].color == Color::pass ||
+                 (bm[i].x == gm[i].x && bm[i].y == gm[i].y)),
+                "legal move %zu differs on turn %u", i, g.get_turn());
+    }
+}
+
+
+/*
+ * plays random games on BitGo and Go side by side, checking that they agree
+ * on every position, and that BitGo undoes and redoes moves correctly
+ */
+template<coord_t W, coord_t H = W>
+static void check_bit_go(int n_games) {
+    for (int game = 0; game < n_games; game++) {
+        BitGo<W, H> bg;
+        Go g(W, H);
+        // ZobristHash only supports square boards
+        std::unique_ptr<ZobristHash> zh;
+        if (W == H) {
+            zh = std::make_unique<ZobristHash>(W, H);
+            bg.set_zobrist(zh.get());
+            g.set_zobrist(zh.get());
+        }
+
+        while (!g.game_over() && g.get_turn() < 4 * W * H) {
+            check_same(bg, g);
+
+            std::vector<GoMove> moves = legal_moves(g);
+            // only pass once no other moves can be made, so games reach
+            // captures and kos before they end
+            size_t n = moves.size() > 1 ? moves.size() - 1 : 1;
+            GoMove m = moves[rand() % n];
+
+            bg.play(m);
+            bg.consistency_check();
+            bg.undo();
+            GO_ASSERT(!bg.is_current(), "game is current after undo");
+            check_same(bg, g);
+            bg.redo();
+            GO_ASSERT(bg.is_current(), "game is not current after redo");
+
+            g.play(m);
+        }
+        check_same(bg, g);
+
+        while (bg.get_turn() > 0) {
+            bg.undo();
+            g.undo();
+            check_same(bg, g);
+        }
+    }
+}
+
+
+int main() {
+    srand(0);
+
+    check_bit_go<5>(100);
+    check_bit_go<7, 4>(50);
+    check_bit_go<9>(20);
+    check_bit_go<11>(10);
+
+    printf("bit_go ok\n");
+    return 0;
+}
+
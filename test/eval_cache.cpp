@@ -0,0 +1,328 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <thread>
+#include <vector>
+
+#include <batch_evaluator.h>
+#include <eval_cache.h>
+#include <go.h>
+#include <mcts_move.h>
+#include <network.h>
+#include <zobrist.h>
+
+
+/*
+ * the tile (x, y) is moved to by mirroring the board (if mirror is set) and
+ * then rotating it rotations times
+ */
+static void transform(coord_t w, bool mirror, uint32_t rotations, coord_t & x,
+        coord_t & y) {
+    if (mirror) {
+        x = w - x - 1;
+    }
+    for (uint32_t r = 0; r < rotations; r++) {
+        coord_t _x = x;
+        x = w - y - 1;
+        y = _x;
+    }
+}
+
+
+/*
+ * plays n random moves (other than passing) on a w x w board, writing them to
+ * moves, and returns false if the game ends or a ko is left on the board
+ */
+static bool random_game(coord_t w, uint32_t n, Go & g,
+        std::vector<board_idx_t> & moves) {
+    board_idx_t legal[Go::max_legal_moves];
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t n_legal = g.legal_moves(legal);
+        if (n_legal == 0) {
+            return false;
+        }
+        board_idx_t idx = legal[rand() % n_legal];
+        moves.push_back(idx);
+        g.play_idx(idx);
+    }
+    for (coord_t y = 0; y < w; y++) {
+        for (coord_t x = 0; x < w; x++) {
+            if (g.tile_at(x, y) == Color::ko) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+/*
+ * checks that every symmetry of a cached position finds it, with the policy
+ * moved to the matching tiles and the value negated if the colors are
+ * exchanged, and that ZobristHash::transform gives the raw hash of each
+ */
+static void check_symmetries(coord_t w) {
+    EvalCache cache(w, w, 8, 4);
+    ZobristHash zh(w, w);
+    uint32_t n_tiles = w * w;
+
+    for (int trial = 0; trial < 20; trial++) {
+        Go g(w, w);
+        std::vector<board_idx_t> moves;
+        if (!random_game(w, 2 + rand() % (n_tiles / 2), g, moves)) {
+            continue;
+        }
+
+        // every tile's logit is its index
+        std::vector<float> policy(cache.get_policy_size());
+        for (uint32_t i = 0; i < policy.size(); i++) {
+            policy[i] = i;
+        }
+        cache.clear();
+        cache.insert(g, .5f, policy.data());
+
+        for (uint32_t s = 0; s < 16; s++) {
+            bool mirror = s & 4, swap = s & 8;
+            uint32_t rotations = s & 3;
+
+            // replay the game through the symmetry, letting white move first
+            // to exchange the colors
+            Go t(w, w);
+            // half the symmetries are looked up by the hash the game keeps
+            if (s & 1) {
+                t.set_zobrist(&cache.get_zobrist());
+            }
+            if (swap) {
+                t.play_idx(Go::no_position);
+            }
+            for (board_idx_t idx : moves) {
+                coord_t x = g.idx_x(idx), y = g.idx_y(idx);
+                transform(w, mirror, rotations, x, y);
+                t.play_idx(t.to_idx(x, y));
+            }
+
+            GO_ASSERT(zh.compute_raw_hash(t) == ZobristHash::transform(
+                        zh.compute_raw_hash(g), mirror, rotations, swap),
+                    "hash of symmetry %u of a %ux%u board", s, w, w);
+
+            float value;
+            std::vector<float> out(cache.get_policy_size());
+            GO_ASSERT(cache.lookup(t, value, out.data()), "symmetry %u of a "
+                    "%ux%u board not found", s, w, w);
+            GO_ASSERT(value == (swap ? -.5f : .5f), "value %f for symmetry "
+                    "%u", value, s);
+            for (coord_t y = 0; y < w; y++) {
+                for (coord_t x = 0; x < w; x++) {
+                    coord_t tx = x, ty = y;
+                    transform(w, mirror, rotations, tx, ty);
+                    // symmetric positions may be found through another
+                    // symmetry, which moves the stones to the same tiles
+                    Color c = g.tile_at(x, y);
+                    Color tc = t.tile_at(tx, ty);
+                    GO_ASSERT(c == Color::empty || tc == (swap ?
+                                other_color(c) : c), "stone moved wrongly");
+                    if (out[ty * w + tx] != y * w + x) {
+                        // only allowed if the position has another symmetry
+                        bool self_symmetric = false;
+                        for (uint32_t s2 = 0; s2 < 16; s2++) {
+                            self_symmetric |= s2 != s &&
+                                ZobristHash::transform(
+                                        zh.compute_raw_hash(g), s2 & 4,
+                                        s2 & 3, s2 & 8) ==
+                                zh.compute_raw_hash(t);
+                        }
+                        GO_ASSERT(self_symmetric, "policy of (%u, %u) not "
+                                "moved to (%u, %u) by symmetry %u", x, y, tx,
+                                ty, s);
+                    }
+                }
+            }
+            GO_ASSERT(out[n_tiles] == n_tiles, "pass logit changed");
+        }
+    }
+
+    EvalCache::Stats st = cache.get_stats();
+    GO_ASSERT(st.hits == st.lookups && st.symmetric_hits > 0, "%llu of %llu "
+            "lookups hit", (unsigned long long) st.hits,
+            (unsigned long long) st.lookups);
+}
+
+
+/*
+ * checks that every hit is on a symmetry of the position looked up, over the
+ * positions of many random games. Each position is cached with its own tiles
+ * as its policy and its turn as the pass logit, so the policy a hit gives
+ * back is the board it was cached for, moved onto the board looked up
+ */
+static uint64_t check_false_hits(coord_t w, uint32_t n_games) {
+    EvalCache cache(w, w, 12, 4);
+    uint32_t n_tiles = w * w;
+    std::vector<float> policy(cache.get_policy_size());
+    uint64_t hits = 0;
+
+    for (uint32_t i = 0; i < n_games; i++) {
+        Go g(w, w);
+        board_idx_t legal[Go::max_legal_moves];
+        for (uint32_t m = 0; m < 4 * n_tiles && !g.game_over(); m++) {
+            float value;
+            if (cache.lookup(g, value, policy.data())) {
+                // colors are exchanged if the value was negated
+                bool swap = value < 0;
+                for (uint32_t t = 0; t < n_tiles; t++) {
+                    Color c = g.tile_at(t % w, t / w);
+                    float expect = c == Color::ko ? 3.f : swap &&
+                        c != Color::empty ? (float) other_color(c) :
+                        (float) c;
+                    GO_ASSERT(policy[t] == expect, "hit on another board at "
+                            "move %u of game %u", m, i);
+                }
+                float turn = (g.get_player() == Color::white) ^ swap;
+                GO_ASSERT(policy[n_tiles] == turn + 2 * g.has_passed(),
+                        "hit on another turn at move %u of game %u", m, i);
+                hits++;
+            }
+            else {
+                for (uint32_t t = 0; t < n_tiles; t++) {
+                    Color c = g.tile_at(t % w, t / w);
+                    policy[t] = c == Color::ko ? 3.f : (float) c;
+                }
+                policy[n_tiles] = (g.get_player() == Color::white) +
+                    2 * g.has_passed();
+                cache.insert(g, 1.f, policy.data());
+            }
+
+            uint32_t n_legal = g.legal_moves(legal);
+            // pass only now and then, or if there is nothing else
+            if (n_legal == 0 || rand() % 16 == 0) {
+                g.play_idx(Go::no_position);
+            }
+            else {
+                g.play_idx(legal[rand() % n_legal]);
+            }
+        }
+    }
+    return hits;
+}
+
+
+/*
+ * checks that the cache holds no more than its capacity, and that lookups
+ * and inserts from many threads at once are all counted
+ */
+static void check_bounds() {
+    const uint32_t n_threads = 4;
+    const uint32_t n_ops = 2000;
+    EvalCache cache(9, 9, 10, 8);
+
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < n_threads; t++) {
+        threads.emplace_back([&cache, t]() {
+                std::vector<float> policy(cache.get_policy_size(), 0.f);
+                srand(t);
+                for (uint32_t i = 0; i < n_ops; i++) {
+                    Go g(9, 9);
+                    std::vector<board_idx_t> moves;
+                    random_game(9, 1 + i % 30, g, moves);
+                    float value;
+                    if (!cache.lookup(g, value, policy.data())) {
+                        cache.insert(g, 0.f, policy.data());
+                    }
+                }
+            });
+    }
+    for (std::thread & t : threads) {
+        t.join();
+    }
+
+    EvalCache::Stats s = cache.get_stats();
+    GO_ASSERT(s.capacity == 1024 && s.size <= s.capacity, "%llu entries in "
+            "a cache of %llu", (unsigned long long) s.size,
+            (unsigned long long) s.capacity);
+    GO_ASSERT(s.lookups == n_threads * n_ops && s.inserts + s.hits ==
+            s.lookups, "%llu lookups, %llu hits and %llu inserts",
+            (unsigned long long) s.lookups, (unsigned long long) s.hits,
+            (unsigned long long) s.inserts);
+
+    cache.clear();
+    GO_ASSERT(cache.get_stats().size == 0, "cleared cache not empty");
+}
+
+
+/*
+ * a BatchEvaluator which checks that the games it is given keep the hash of
+ * its cache up to date, as MctsMove should have them do
+ */
+class HashCheckingEvaluator : public BatchEvaluator {
+public:
+    using BatchEvaluator::BatchEvaluator;
+
+    virtual float evaluate(const Game & g, const board_idx_t * moves,
+            uint32_t n_moves, float * priors) {
+        const Go & go = dynamic_cast<const Go &>(g);
+        GO_ASSERT(get_zobrist() != nullptr && go.get_zobrist() ==
+                get_zobrist() && go.get_raw_hash() ==
+                get_zobrist()->compute_raw_hash(go), "search game doesn't "
+                "keep the cache's hash");
+        return BatchEvaluator::evaluate(g, moves, n_moves, priors);
+    }
+};
+
+
+static std::vector<float> random_weights(size_t n, float scale) {
+    std::vector<float> w(n);
+    for (float & x : w) {
+        x = scale * (2.f * rand() / RAND_MAX - 1.f);
+    }
+    return w;
+}
+
+
+int main() {
+    srand(0);
+
+    check_symmetries(5);
+    check_symmetries(6);
+    check_symmetries(9);
+    check_bounds();
+    uint64_t hits = check_false_hits(5, 2000);
+
+    // searching the same position twice with a cache in front of the network
+    // evaluates most of the second tree from the cache
+    Network net(5, 5, 4);
+    net.add_conv(0, 1, 3, 8, random_weights(3 * 3 * 4 * 8, .5f),
+            random_weights(8, .1f));
+    net.add_relu(1);
+    net.add_dense(1, 2, 1, random_weights(25 * 8, .1f),
+            random_weights(1, .1f));
+    net.add_tanh(2);
+    net.add_dense(1, 3, 25, random_weights(25 * 8 * 25, .1f),
+            random_weights(25, .1f));
+    net.add_output(2);
+    net.add_output(3);
+
+    EvalCache cache(5, 5);
+    HashCheckingEvaluator e(net, 1, std::chrono::microseconds(0));
+    e.set_cache(&cache);
+
+    Go g(5, 5);
+    MctsMove m(g, 1000);
+    m.set_evaluator(&e);
+    m.set_reuse(false);
+    GoMove move;
+    m.next_move(move);
+    uint64_t first = e.get_stats().positions;
+    m.next_move(move);
+    uint64_t second = e.get_stats().positions - first;
+    GO_ASSERT(second < first / 2, "second search evaluated %llu positions, "
+            "the first %llu", (unsigned long long) second,
+            (unsigned long long) first);
+
+    EvalCache::Stats s = cache.get_stats();
+    printf("eval_cache ok (%llu hits on random 5x5 games all true, search "
+            "hit rate %.1f%%, %llu of %llu hits on another symmetry, %llu "
+            "entries)\n", (unsigned long long) hits, 100 * s.hit_rate,
+            (unsigned long long) s.symmetric_hits,
+            (unsigned long long) s.hits, (unsigned long long) s.size);
+    return 0;
+}
+
@@ -0,0 +1,164 @@
+#include <chrono>
+#include <cstdio>
+
+#include <algorithm>
+#include <vector>
+
+#include <feature_encoder.h>
+#include <go.h>
+
+
+template<class T>
+static T plane_at(const FeatureEncoder & fe, const T * out, coord_t w,
+        coord_t x, coord_t y, uint32_t plane) {
+    return out[(y * w + x) * fe.n_planes() + plane];
+}
+
+/*
+ * the number of tiles set in the given plane
+ */
+template<class T>
+static uint32_t plane_count(const FeatureEncoder & fe, const T * out,
+        uint32_t n_tiles, uint32_t plane) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < n_tiles; i++) {
+        n += out[i * fe.n_planes() + plane] != 0;
+    }
+    return n;
+}
+
+
+static void play(Go & g, coord_t x, coord_t y) {
+    g.play_idx(g.to_idx(x, y));
+}
+
+
+/*
+ * checks every plane of a position where white has just taken a ko
+ */
+static void check_ko() {
+    Go g(5, 5);
+    play(g, 1, 0);
+    play(g, 2, 0);
+    play(g, 0, 1);
+    play(g, 3, 1);
+    play(g, 1, 2);
+    play(g, 2, 2);
+    play(g, 2, 1);
+    // captures the black stone at (2, 1), which black can't retake at once
+    play(g, 1, 1);
+
+    FeatureEncoder fe(5, 5);
+    std::vector<float> out(fe.position_size(), -1.f);
+    fe.encode(g, out.data());
+
+    GO_ASSERT(plane_count(fe, out.data(), 25, FeatureEncoder::black_stones)
+            == 3, "wrong number of black stones");
+    GO_ASSERT(plane_count(fe, out.data(), 25, FeatureEncoder::white_stones)
+            == 4, "wrong number of white stones");
+    GO_ASSERT(plane_at(fe, out.data(), 5, 1, 1, FeatureEncoder::white_stones)
+            == 1.f, "capturing stone missing");
+    GO_ASSERT(plane_count(fe, out.data(), 25, FeatureEncoder::side_to_move)
+            == 25, "black to move, but the side to move plane isn't set");
+
+    GO_ASSERT(plane_count(fe, out.data(), 25, FeatureEncoder::ko_point) == 1
+            && plane_at(fe, out.data(), 5, 2, 1, FeatureEncoder::ko_point)
+            == 1.f, "ko point not at (2, 1)");
+
+    // the capturing stone has only the ko point, the white stone at (3, 1)
+    // has 4 liberties, and the black stone at (1, 0) has 1
+    GO_ASSERT(plane_at(fe, out.data(), 5, 1, 1, FeatureEncoder::liberties_1)
+            == 1.f, "capturing stone not in atari");
+    GO_ASSERT(plane_at(fe, out.data(), 5, 3, 1,
+                FeatureEncoder::liberties_3_plus) == 1.f &&
+            plane_at(fe, out.data(), 5, 3, 1, FeatureEncoder::liberties_1)
+            == 0.f, "liberties of (3, 1) wrong");
+    GO_ASSERT(plane_at(fe, out.data(), 5, 1, 0, FeatureEncoder::liberties_1)
+            == 1.f, "liberties of (1, 0) wrong");
+    // every stone is in exactly one liberty plane
+    uint32_t n_libs = 0;
+    for (uint32_t p = FeatureEncoder::liberties_1;
+            p <= FeatureEncoder::liberties_3_plus; p++) {
+        n_libs += plane_count(fe, out.data(), 25, p);
+    }
+    GO_ASSERT(n_libs == 7, "%u stones in liberty planes, expected 7", n_libs);
+
+    // the last four moves, most recent first, including the captured stone
+    coord_t last[4][2] = { { 1, 1 }, { 2, 1 }, { 2, 2 }, { 1, 2 } };
+    for (uint32_t i = 0; i < 4; i++) {
+        uint32_t p = FeatureEncoder::last_moves + i;
+        GO_ASSERT(plane_count(fe, out.data(), 25, p) == 1 &&
+                plane_at(fe, out.data(), 5, last[i][0], last[i][1], p) == 1.f,
+                "move %u ago not at (%u, %u)", i, last[i][0], last[i][1]);
+    }
+
+    // the int8 encoding is the same
+    std::vector<int8_t> out8(fe.position_size(), -1);
+    fe.encode(g, out8.data());
+    for (uint32_t i = 0; i < fe.position_size(); i++) {
+        GO_ASSERT(out8[i] == out[i], "int8 entry %u is %d, float is %f", i,
+                out8[i], out[i]);
+    }
+
+    // after black passes, the last move plane is empty, and white is to move
+    g.play_idx(Go::no_position);
+    fe.encode(g, out.data());
+    GO_ASSERT(plane_count(fe, out.data(), 25, FeatureEncoder::last_moves)
+            == 0, "pass marked in the last move plane");
+    GO_ASSERT(plane_at(fe, out.data(), 5, 1, 1,
+                FeatureEncoder::last_moves + 1) == 1.f, "history not shifted "
+            "by the pass");
+    GO_ASSERT(plane_count(fe, out.data(), 25, FeatureEncoder::side_to_move)
+            == 0, "white to move, but the side to move plane is set");
+}
+
+
+/*
+ * checks that a batch is each position encoded in turn
+ */
+static void check_batch() {
+    Go g1(9, 9), g2(9, 9);
+    play(g2, 4, 4);
+    play(g2, 3, 3);
+
+    FeatureEncoder fe(9, 9, 2);
+    const Go * games[2] = { &g1, &g2 };
+    std::vector<float> batch(2 * fe.position_size());
+    fe.encode_batch(games, 2, batch.data());
+
+    std::vector<float> one(fe.position_size());
+    for (uint32_t b = 0; b < 2; b++) {
+        fe.encode(*games[b], one.data());
+        GO_ASSERT(std::equal(one.begin(), one.end(),
+                    batch.begin() + b * fe.position_size()), "entry %u of "
+                "the batch differs", b);
+    }
+    GO_ASSERT(plane_count(fe, batch.data(), 81, FeatureEncoder::black_stones)
+            == 0, "stones on an empty board");
+}
+
+
+int main() {
+    check_ko();
+    check_batch();
+
+    // encoding speed on a 19x19 board part way through a game
+    Go g(19, 19);
+    for (coord_t i = 0; i < 19; i++) {
+        play(g, i, (i * 7) % 19);
+        play(g, i, (i * 7 + 9) % 19);
+    }
+    FeatureEncoder fe(19, 19);
+    std::vector<int8_t> out(fe.position_size());
+    uint32_t n = 20000;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < n; i++) {
+        fe.encode(g, out.data());
+    }
+    double s = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+    printf("feature_encoder ok (%.0f 19x19 positions/s)\n", n / s);
+    return 0;
+}
+
@@ -1,21 +1,29 @@
 
 #include <algorithm>
+#include <atomic>
+#include <exception>
 #include <getopt.h>
 #include <iostream>
 #include <iomanip>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <curses.h>
 
 #include <fun/print_colors.h>
 
 #include <alpha_beta_move.h>
+#include <batch_evaluator.h>
+#include <bit_go.h>
 #include <file_move.h>
 #include <game_with_history.h>
 #include <game_with_info.h>
 #include <go.h>
+#include <mcts_move.h>
+#include <network.h>
 #include <recorded_game.h>
+#include <self_play.h>
 #include <user_move.h>
 
 
@@ -63,8 +71,7 @@ void regular_print(const Game & g) {
 
 int main(int argc, char * argv[]) {
 
-    std::shared_ptr<Go> game = std::make_shared<Go>(5, 5);
-    std::shared_ptr<Game> cur_game = game;
+    std::shared_ptr<Game> cur_game = std::make_shared<Go>(5, 5);
 
 #define SAVE_FILE_SIZE 128
     char save_file[SAVE_FILE_SIZE];
@@ -76,36 +83,155 @@ int main(int argc, char * argv[]) {
 
     std::shared_ptr<MoveGen> move_gen = nullptr;
     bool do_ai = false, do_file = false;
+    // forbid repeating any earlier position, not just simple ko
+    bool superko = false;
+    // the sgf file to replay the first game of
+    std::string input_file;
+    // seconds the AI may think for each move, or 0 to search to a fixed depth
+    double ai_time = 0;
+    // threads the AI searches with
+    uint32_t ai_threads = 1;
+    // playouts per move of the Monte Carlo tree search AI, or 0 to play with
+    // alpha-beta search
+    uint32_t ai_playouts = 0;
+    // the network file the Monte Carlo tree search AI evaluates positions
+    // with, or empty for random playouts
+    std::string network_file;
+    // games of self-play to record to the save file, or 0 to play one game
+    uint64_t self_play_games = 0;
 
     int opt;
-    while ((opt = getopt(argc, argv, "af:s:")) != -1) {
+    while ((opt = getopt(argc, argv, "abf:j:km:n:p:s:t:")) != -1) {
         switch(opt) {
             case 'a':
                 do_ai = true;
                 break;
+            case 'b':
+                // play on a bitboard representation of the board
+                cur_game = std::make_shared<BitGo<5>>();
+                break;
             case 'f':
                 do_file = true;
+                input_file = optarg;
+                break;
+            case 'j':
+                ai_threads = atoi(optarg);
+                break;
+            case 'k':
+                superko = true;
+                break;
+            case 'm':
+                ai_playouts = atoi(optarg);
+                break;
+            case 'n':
+                network_file = optarg;
+                break;
+            case 'p':
+                self_play_games = strtoull(optarg, nullptr, 10);
                 break;
             case 's':
                 strncpy(save_file, optarg, SAVE_FILE_SIZE);
                 break;
+            case 't':
+                ai_time = atof(optarg);
+                break;
             case '?':
             default:
-                std::cout << "usage: " << argv[0] << " [-a]" <<
+                std::cout << "usage: " << argv[0] << " [-a] [-b]" <<
                    " [-f <input sgf file>]" <<
-                   " [-s <output sgf file name>]" << std::endl;
+                   " [-j <AI threads>]" <<
+                   " [-k]" <<
+                   " [-m <AI playouts per move>]" <<
+                   " [-n <AI network file>]" <<
+                   " [-p <self-play games>]" <<
+                   " [-s <output sgf or self-play record file name>]" <<
+                   " [-t <seconds per AI move>]" << std::endl;
                 return -1;
         }
     }
 
-    if (do_ai) {
+    // applied once every option is read, so the board -b picks is known
+    if (superko) {
+        GO_ASSERT(std::dynamic_pointer_cast<Go>(cur_game) != nullptr,
+                "superko is only supported by Go, not with -b");
+        std::dynamic_pointer_cast<Go>(cur_game)->set_superko(true);
+    }
+
+    std::shared_ptr<Network> network = nullptr;
+    std::shared_ptr<BatchEvaluator> evaluator = nullptr;
+
+    if (self_play_games > 0) {
+        // each thread plays its own game, so the network's batches fill
+        // from every game at once
+        SelfPlay sp(cur_game->width(), cur_game->height(), ai_playouts > 0 ?
+                ai_playouts : SelfPlay::default_playouts, ai_threads);
+        if (!network_file.empty()) {
+            network = std::make_shared<Network>(network_file);
+            evaluator = std::make_shared<BatchEvaluator>(*network,
+                    ai_threads, std::chrono::milliseconds(1));
+            sp.set_evaluator(evaluator.get());
+        }
+        GameRecordWriter out(save_file[0] != '\0' ? save_file :
+                "self_play.rec");
+
+        // an error playing is passed back here rather than escaping the
+        // thread
+        std::atomic<bool> done(false);
+        std::exception_ptr error;
+        std::thread t([&sp, &out, &done, &error, self_play_games]() {
+                try {
+                    sp.play(self_play_games, out);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                done.store(true, std::memory_order_release);
+            });
+        SelfPlay::Stats st;
+        do {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            st = sp.get_stats();
+            printf("\r%llu/%llu games, %.0f games/hour, %.0f positions/s",
+                    (unsigned long long) st.games,
+                    (unsigned long long) self_play_games, st.games_per_hour,
+                    st.positions_per_second);
+            fflush(stdout);
+        } while (!done.load(std::memory_order_acquire));
+        t.join();
+        printf("\n");
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return 0;
+    }
+
+    if (do_ai && ai_playouts > 0) {
+        std::shared_ptr<GameWithHistory> gh =
+            std::make_shared<GameWithHistory>(cur_game);
+        cur_game = gh;
+        std::shared_ptr<MctsMove> mcts = std::make_shared<MctsMove>(
+                *cur_game, ai_playouts);
+        mcts->set_threads(ai_threads);
+        if (!network_file.empty()) {
+            // batch the positions of every search thread together
+            network = std::make_shared<Network>(network_file);
+            evaluator = std::make_shared<BatchEvaluator>(*network,
+                    ai_threads, std::chrono::milliseconds(1));
+            mcts->set_evaluator(evaluator.get());
+        }
+        move_gen = mcts;
+    }
+    else if (do_ai) {
         std::shared_ptr<GameWithHistory> gh =
             std::make_shared<GameWithHistory>(cur_game);
         cur_game = gh;
-        move_gen = std::make_shared<AlphaBetaMove>(*cur_game, 11);
+        std::shared_ptr<AlphaBetaMove> ab = std::make_shared<AlphaBetaMove>(
+                *cur_game, ai_time > 0 ? AlphaBetaMove::inf_depth : 11);
+        ab->set_time_limit(ai_time);
+        ab->set_threads(ai_threads);
+        move_gen = ab;
     }
     else if (do_file) {
-        move_gen = std::make_shared<FileMove>(optarg, *cur_game);
+        move_gen = std::make_shared<FileMove>(input_file, *cur_game);
     }
     else {
         move_gen = std::make_shared<UserMove>(*cur_game);
@@ -0,0 +1,222 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <vector>
+
+#include <bit_go.h>
+#include <go.h>
+#include <mcts_move.h>
+#include <xorshift.h>
+
+
+/*
+ * an evaluator which scores positions by who is ahead on the board
+ */
+class ScoreEvaluator : public MctsEvaluator {
+public:
+    virtual float evaluate(const Game & g, const board_idx_t *, uint32_t,
+            float *) {
+        int score = g.get_score();
+        return score > 0 ? 1.f : score < 0 ? -1.f : 0.f;
+    }
+};
+
+
+/*
+ * an evaluator which counts its calls and scores every position as even
+ */
+class CountingEvaluator : public MctsEvaluator {
+public:
+    uint32_t n_calls = 0;
+
+    virtual float evaluate(const Game &, const board_idx_t *, uint32_t,
+            float *) {
+        n_calls++;
+        return 0.f;
+    }
+};
+
+
+static GoMove random_move(Game & g) {
+    std::vector<GoMove> moves;
+    g.for_each_legal_move([&](Game &, GameMove & m) -> bool {
+            moves.push_back(dynamic_cast<GoMove &>(m));
+            return true;
+        });
+    // only pass once no other moves can be made
+    size_t n = moves.size() > 1 ? moves.size() - 1 : 1;
+    return moves[rand() % n];
+}
+
+
+/*
+ * checks that searching Go and BitGo picks the same moves over a random
+ * game, since both list their legal moves in the same order (Go's playouts
+ * draw their moves differently from BitGo's, so leaves are scored by an
+ * evaluator)
+ */
+static void check_go_bit_go() {
+    Go g(5, 5);
+    BitGo<5> bg;
+    ScoreEvaluator e;
+    MctsMove mg(g, 500);
+    MctsMove mbg(bg, 500);
+    mg.set_evaluator(&e);
+    mbg.set_evaluator(&e);
+
+    while (!g.game_over() && g.get_turn() < 20) {
+        GoMove m1, m2;
+        mg.next_move(m1);
+        mbg.next_move(m2);
+        GO_ASSERT(m1.color == m2.color && (m1.color == Color::pass ||
+                    (m1.x == m2.x && m1.y == m2.y)), "Go and BitGo searches "
+                "differ on turn %u", g.get_turn());
+        GO_ASSERT(mg.get_node_count() == mbg.get_node_count(), "Go and BitGo "
+                "trees differ in size on turn %u", g.get_turn());
+
+        GoMove m = random_move(g);
+        g.play(m);
+        bg.play(m);
+    }
+}
+
+
+/*
+ * checks that Go and BitGo positions are given the same area score over
+ * random games, and that it is the score Go's playouts end with
+ */
+static void check_area_score() {
+    Xorshift rng(15);
+    Go scratch(5, 5);
+    for (int game = 0; game < 20; game++) {
+        Go g(5, 5);
+        BitGo<5> bg;
+        while (!g.game_over() && g.get_turn() < 60) {
+            GoMove m = random_move(g);
+            g.play(m);
+            bg.play(m);
+            GO_ASSERT(MctsMove::area_score(g) == MctsMove::area_score(bg),
+                    "Go scores %d and BitGo %d on turn %u",
+                    MctsMove::area_score(g), MctsMove::area_score(bg),
+                    g.get_turn());
+
+            scratch.refill(g);
+            int score = scratch.playout(rng);
+            scratch.consistency_check();
+            GO_ASSERT(!scratch.game_over() ||
+                    score == MctsMove::area_score(scratch), "playout "
+                    "scored %d, area %d", score,
+                    MctsMove::area_score(scratch));
+        }
+    }
+}
+
+
+/*
+ * checks that a full arena stops the tree from growing without stopping the
+ * search, and that leaves are given to the evaluator once each
+ */
+static void check_arena() {
+    Go g(5, 5);
+    CountingEvaluator e;
+    MctsMove m(g, 1000, MctsMove::default_exploration, 6);
+    m.set_evaluator(&e);
+
+    GoMove move;
+    m.next_move(move);
+    GO_ASSERT(m.get_node_count() <= 64, "arena of 64 nodes holds %u",
+            m.get_node_count());
+    GO_ASSERT(e.n_calls == 1000, "%u leaves evaluated in 1000 playouts",
+            e.n_calls);
+}
+
+
+/*
+ * checks that the subtree under our move and the opponent's reply is kept
+ * for the next search, counting towards its playouts
+ */
+static void check_reuse() {
+    Go g(5, 5);
+    MctsMove m(g, 5000);
+    m.seed(1);
+
+    for (int i = 0; i < 8 && !g.game_over(); i++) {
+        GoMove move;
+        m.next_move(move);
+        GO_ASSERT(i == 0 || m.get_reused_count() > 0, "nothing reused on "
+                "turn %u", g.get_turn());
+        GO_ASSERT(m.get_reused_count() >= 5000 ||
+                m.get_reused_count() + m.get_playout_count() == 5000,
+                "%llu playouts reused and %llu made, not 5000",
+                (unsigned long long) m.get_reused_count(),
+                (unsigned long long) m.get_playout_count());
+        g.play(move);
+        if (!g.game_over()) {
+            GoMove reply = random_move(g);
+            g.play(reply);
+        }
+    }
+
+    // with reuse off, every search starts from a new tree
+    m.set_reuse(false);
+    GoMove move;
+    m.next_move(move);
+    GO_ASSERT(m.get_reused_count() == 0, "reused a tree with reuse off");
+}
+
+
+/*
+ * plays MCTS with random playouts as black against a random player from
+ * start, searching with the given number of threads, and returns the number
+ * of games black wins
+ */
+template<class G>
+static int play_random(const G & start, int n_games, uint32_t playouts,
+        uint32_t n_threads=1) {
+    int wins = 0;
+    for (int game = 0; game < n_games; game++) {
+        G g(start);
+        MctsMove m(g, playouts);
+        m.set_threads(n_threads);
+        m.seed(game);
+
+        while (!g.game_over() && g.get_turn() < 100) {
+            if (g.max_player()) {
+                GoMove move;
+                m.next_move(move);
+                g.play(move);
+            }
+            else {
+                GoMove move = random_move(g);
+                g.play(move);
+            }
+        }
+        wins += g.get_score() > 0;
+    }
+    return wins;
+}
+
+
+int main() {
+    srand(0);
+
+    check_area_score();
+    check_go_bit_go();
+    check_arena();
+    check_reuse();
+
+    int wins = play_random(BitGo<5>(), 6, 2000);
+    GO_ASSERT(wins >= 5, "MCTS won %d of 6 games on BitGo against a random "
+            "player", wins);
+    int go_wins = play_random(Go(5, 5), 6, 2000);
+    GO_ASSERT(go_wins >= 5, "MCTS won %d of 6 games on Go against a random "
+            "player", go_wins);
+    int mt_wins = play_random(Go(5, 5), 6, 2000, 4);
+    GO_ASSERT(mt_wins >= 5, "MCTS with 4 threads won %d of 6 games on Go "
+            "against a random player", mt_wins);
+
+    printf("mcts ok (won %d, %d and %d of 6 games against a random player)\n",
+            wins, go_wins, mt_wins);
+    return 0;
+}
+
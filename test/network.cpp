@@ -0,0 +1,295 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#include <game.h>
+#include <network.h>
+
+
+/*
+ * a tensor of height x width x channels floats, for the reference network
+ */
+struct Tensor {
+    int h, w, c;
+    std::vector<float> v;
+
+    Tensor(int h, int w, int c) : h(h), w(w), c(c), v(h * w * c) {}
+
+    float & at(int y, int x, int ch) {
+        return v[(y * w + x) * c + ch];
+    }
+};
+
+
+static std::vector<float> random_weights(size_t n, float scale) {
+    std::vector<float> w(n);
+    for (float & x : w) {
+        x = scale * (2.f * rand() / RAND_MAX - 1.f);
+    }
+    return w;
+}
+
+
+/*
+ * the layers of the network, straight from their definitions
+ */
+static Tensor ref_conv(Tensor & in, int k, int n_out,
+        const std::vector<float> & kernel, const std::vector<float> & bias) {
+    Tensor out(in.h, in.w, n_out);
+    int pad = (k - 1) / 2;
+    for (int y = 0; y < in.h; y++) {
+        for (int x = 0; x < in.w; x++) {
+            for (int o = 0; o < n_out; o++) {
+                double sum = bias[o];
+                for (int ky = 0; ky < k; ky++) {
+                    for (int kx = 0; kx < k; kx++) {
+                        int iy = y + ky - pad, ix = x + kx - pad;
+                        if (iy < 0 || iy >= in.h || ix < 0 || ix >= in.w) {
+                            continue;
+                        }
+                        for (int i = 0; i < in.c; i++) {
+                            sum += in.at(iy, ix, i) *
+                                kernel[((ky * k + kx) * in.c + i) * n_out + o];
+                        }
+                    }
+                }
+                out.at(y, x, o) = sum;
+            }
+        }
+    }
+    return out;
+}
+
+static void ref_scale_shift(Tensor & t, const std::vector<float> & scale,
+        const std::vector<float> & shift) {
+    for (size_t i = 0; i < t.v.size(); i++) {
+        t.v[i] = t.v[i] * scale[i % t.c] + shift[i % t.c];
+    }
+}
+
+static void ref_relu(Tensor & t) {
+    for (float & x : t.v) {
+        x = x > 0 ? x : 0;
+    }
+}
+
+static Tensor ref_dense(Tensor & in, int n_out,
+        const std::vector<float> & kernel, const std::vector<float> & bias) {
+    Tensor out(1, 1, n_out);
+    for (int o = 0; o < n_out; o++) {
+        double sum = bias[o];
+        for (size_t i = 0; i < in.v.size(); i++) {
+            sum += in.v[i] * kernel[i * n_out + o];
+        }
+        out.v[o] = sum;
+    }
+    return out;
+}
+
+
+/*
+ * builds the network of py/monte_carlo.py with random weights (a 5x5
+ * convolution, one residual block, and value and policy heads) along with a
+ * reference implementation of it, and checks the two agree
+ */
+class ResNet {
+private:
+    int h, w, c, filters;
+
+    struct Weights {
+        std::vector<float> kernel, bias, scale, shift;
+    };
+
+    Weights stem, res1, res2, value_conv, policy_conv, value_dense1,
+            value_dense2, policy_dense;
+
+    Weights conv_weights(int k, int n_in, int n_out) {
+        return { random_weights(k * k * n_in * n_out, 1.f / k),
+            random_weights(n_out, .1f), random_weights(n_out, 1.f),
+            random_weights(n_out, .1f) };
+    }
+
+    Weights dense_weights(int n_in, int n_out) {
+        return { random_weights(n_in * n_out, 2.f / std::sqrt(n_in)),
+            random_weights(n_out, .1f), {}, {} };
+    }
+
+public:
+    ResNet(int h, int w, int c, int filters) : h(h), w(w), c(c),
+            filters(filters) {
+        stem = conv_weights(5, c, filters);
+        res1 = conv_weights(3, filters, filters);
+        res2 = conv_weights(3, filters, filters);
+        value_conv = conv_weights(1, filters, 1);
+        policy_conv = conv_weights(1, filters, 2);
+        value_dense1 = dense_weights(h * w, 128);
+        value_dense2 = dense_weights(128, 1);
+        policy_dense = dense_weights(2 * h * w, h * w);
+    }
+
+    Network build() const {
+        Network net(h, w, c);
+        // tensor 1 is the trunk, 2 the residual branch, 3 and 4 the value
+        // head, 5 and 6 the policy head
+        net.add_conv(0, 1, 5, filters, stem.kernel, stem.bias);
+        net.add_scale_shift(1, stem.scale, stem.shift);
+        net.add_relu(1);
+
+        net.add_conv(1, 2, 3, filters, res1.kernel, res1.bias);
+        net.add_scale_shift(2, res1.scale, res1.shift);
+        net.add_relu(2);
+        net.add_conv(2, 3, 3, filters, res2.kernel, res2.bias);
+        net.add_scale_shift(3, res2.scale, res2.shift);
+        net.add_add(1, 3);
+        net.add_relu(3);
+
+        net.add_conv(3, 4, 1, 1, value_conv.kernel, value_conv.bias);
+        net.add_scale_shift(4, value_conv.scale, value_conv.shift);
+        net.add_relu(4);
+        net.add_dense(4, 5, 128, value_dense1.kernel, value_dense1.bias);
+        net.add_relu(5);
+        net.add_dense(5, 6, 1, value_dense2.kernel, value_dense2.bias);
+        net.add_tanh(6);
+
+        net.add_conv(3, 7, 1, 2, policy_conv.kernel, policy_conv.bias);
+        net.add_scale_shift(7, policy_conv.scale, policy_conv.shift);
+        net.add_relu(7);
+        net.add_dense(7, 8, h * w, policy_dense.kernel, policy_dense.bias);
+
+        net.add_output(6);
+        net.add_output(8);
+        return net;
+    }
+
+    /*
+     * returns the value followed by the policy logits for input
+     */
+    std::vector<float> reference(const float * input) const {
+        Tensor x(h, w, c);
+        x.v.assign(input, input + h * w * c);
+
+        Tensor t = ref_conv(x, 5, filters, stem.kernel, stem.bias);
+        ref_scale_shift(t, stem.scale, stem.shift);
+        ref_relu(t);
+
+        Tensor r = ref_conv(t, 3, filters, res1.kernel, res1.bias);
+        ref_scale_shift(r, res1.scale, res1.shift);
+        ref_relu(r);
+        r = ref_conv(r, 3, filters, res2.kernel, res2.bias);
+        ref_scale_shift(r, res2.scale, res2.shift);
+        for (size_t i = 0; i < r.v.size(); i++) {
+            r.v[i] += t.v[i];
+        }
+        ref_relu(r);
+
+        Tensor v = ref_conv(r, 1, 1, value_conv.kernel, value_conv.bias);
+        ref_scale_shift(v, value_conv.scale, value_conv.shift);
+        ref_relu(v);
+        v = ref_dense(v, 128, value_dense1.kernel, value_dense1.bias);
+        ref_relu(v);
+        v = ref_dense(v, 1, value_dense2.kernel, value_dense2.bias);
+
+        Tensor p = ref_conv(r, 1, 2, policy_conv.kernel, policy_conv.bias);
+        ref_scale_shift(p, policy_conv.scale, policy_conv.shift);
+        ref_relu(p);
+        p = ref_dense(p, h * w, policy_dense.kernel, policy_dense.bias);
+
+        std::vector<float> res = { std::tanh(v.v[0]) };
+        res.insert(res.end(), p.v.begin(), p.v.end());
+        return res;
+    }
+};
+
+
+/*
+ * checks that a batch run through net matches the reference network, input
+ * by input
+ */
+static void check_forward(Network & net, const ResNet & ref,
+        const std::vector<float> & inputs, uint32_t batch) {
+    net.forward(inputs.data(), batch);
+    uint32_t n_in = net.input_size();
+    uint32_t n_policy = net.output_size(1);
+
+    for (uint32_t b = 0; b < batch; b++) {
+        std::vector<float> expected = ref.reference(&inputs[b * n_in]);
+        float value = net.output(0)[b];
+        GO_ASSERT(std::fabs(value - expected[0]) < 1e-4f, "value %f of "
+                "input %u, expected %f", value, b, expected[0]);
+        for (uint32_t i = 0; i < n_policy; i++) {
+            float p = net.output(1)[b * n_policy + i];
+            float e = expected[i + 1];
+            GO_ASSERT(std::fabs(p - e) < 1e-3f * (1.f + std::fabs(e)),
+                    "policy logit %u of input %u is %f, expected %f", i, b,
+                    p, e);
+        }
+    }
+}
+
+
+static std::vector<float> random_inputs(uint32_t n) {
+    // stone planes are 0 or 1
+    std::vector<float> v(n);
+    for (float & x : v) {
+        x = rand() % 3 == 0;
+    }
+    return v;
+}
+
+
+int main() {
+    srand(0);
+
+    ResNet ref(9, 9, 4, 32);
+    Network net = ref.build();
+    GO_ASSERT(net.n_outputs() == 2 && net.output_size(0) == 1 &&
+            net.output_size(1) == 81, "network has the wrong outputs");
+
+    std::vector<float> inputs = random_inputs(8 * net.input_size());
+    check_forward(net, ref, inputs, 1);
+    check_forward(net, ref, inputs, 8);
+    // a smaller batch after a larger one reuses the buffers
+    check_forward(net, ref, inputs, 3);
+
+    const char * path = "/tmp/test_network.gonn";
+    net.save(path);
+    Network loaded(path);
+    check_forward(loaded, ref, inputs, 8);
+
+    // a file cut short is rejected
+    {
+        std::ifstream f(path, std::ios::binary);
+        std::vector<char> bytes((std::istreambuf_iterator<char>(f)),
+                std::istreambuf_iterator<char>());
+        std::ofstream(path, std::ios::binary).write(bytes.data(),
+                bytes.size() / 2);
+        bool threw = false;
+        try {
+            Network bad(path);
+        }
+        catch (const std::runtime_error &) {
+            threw = true;
+        }
+        GO_ASSERT(threw, "loaded a truncated network file");
+    }
+    remove(path);
+
+    uint32_t n_runs = 2000;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < n_runs; i++) {
+        net.forward(&inputs[(i % 8) * net.input_size()], 1);
+    }
+    double us = std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count() / n_runs;
+
+    printf("network ok (%s kernels, %.1f us per 9x9 evaluation)\n",
+            Network::simd_name(), us);
+    return 0;
+}
+
@@ -0,0 +1,86 @@
+#include <cstdio>
+
+#include <chrono>
+
+#include <go.h>
+#include <mcts_move.h>
+#include <xorshift.h>
+
+
+/*
+ * runs random playouts from the empty board of the given size for about the
+ * given number of seconds, and reports how many were played per second. Each
+ * playout is run on a scratch copy of the empty board, as a tree search
+ * would
+ */
+static void bench(coord_t size, double secs) {
+    Go start(size, size);
+    Go g(start);
+    Xorshift rng(1);
+
+    uint64_t n_playouts = 0;
+    uint64_t n_moves = 0;
+    uint64_t black_wins = 0;
+    double elapsed = 0;
+    auto begin = std::chrono::steady_clock::now();
+    while (elapsed < secs) {
+        for (int i = 0; i < 256; i++) {
+            g.refill(start);
+            int score = g.playout(rng);
+            n_playouts++;
+            n_moves += g.get_turn();
+            black_wins += score > 0;
+        }
+        elapsed = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - begin).count();
+
+        // the last playout must have left a consistent board
+        g.consistency_check();
+    }
+
+    printf("%2ux%-2u: %10.0f playouts/s, %6.1f moves per playout, black wins "
+            "%.1f%%\n", size, size, n_playouts / elapsed,
+            ((double) n_moves) / n_playouts,
+            100. * black_wins / n_playouts);
+}
+
+
+/*
+ * searches the empty board of the given size with MCTS using 1, 2, 4, ...
+ * threads up to max_threads, and reports how many playouts per second each
+ * makes
+ */
+static void bench_threads(coord_t size, uint32_t playouts,
+        uint32_t max_threads) {
+    Go g(size, size);
+    double base = 0;
+    for (uint32_t n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+        MctsMove m(g, playouts);
+        m.set_threads(n_threads);
+        m.seed(1);
+        GoMove move;
+
+        auto start = std::chrono::steady_clock::now();
+        m.next_move(move);
+        double secs = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+
+        double rate = playouts / secs;
+        if (n_threads == 1) {
+            base = rate;
+        }
+        printf("%2ux%-2u MCTS %2u threads: %10.0f playouts/s (%.2fx)\n",
+                size, size, n_threads, rate, rate / base);
+    }
+}
+
+
+int main() {
+    bench(5, 1);
+    bench(9, 1);
+    bench(19, 1);
+
+    bench_threads(9, 100000, 16);
+
+    return 0;
+}
@@ -0,0 +1,203 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <game_record.h>
+#include <go.h>
+#include <replay_buffer.h>
+#include <xorshift.h>
+
+
+/*
+ * a random game of up to n moves on a w x w board, where the search visited
+ * only the move played
+ */
+static GameRecord random_record(coord_t w, uint32_t n, Xorshift & rng) {
+    GameRecord r;
+    r.clear(w, w);
+    Go g(w, w);
+    board_idx_t legal[Go::max_legal_moves];
+    for (uint32_t i = 0; i < n && !g.game_over(); i++) {
+        uint32_t n_legal = g.legal_moves(legal);
+        board_idx_t idx = n_legal == 0 ? Go::no_position :
+            legal[rng.below(n_legal)];
+        uint16_t move = idx == Go::no_position ? GameRecord::pass :
+            g.idx_y(idx) * w + g.idx_x(idx);
+        uint32_t visits = 1;
+        r.add_move(move, &move, &visits, 1);
+        g.play_idx(idx);
+    }
+    r.score = g.get_score();
+    return r;
+}
+
+
+/*
+ * checks that every position in b has a policy summing to 1 and exactly one
+ * of the stone planes set on each tile
+ */
+static void check_batch(const TrainingBatch & b, uint32_t n_tiles) {
+    for (uint32_t k = 0; k < b.n; k++) {
+        float sum = 0;
+        for (uint32_t t = 0; t <= n_tiles; t++) {
+            sum += b.policies[k * (n_tiles + 1) + t];
+        }
+        GO_ASSERT(std::fabs(sum - 1.f) < 1e-4f, "policy sums to %f", sum);
+        for (uint32_t t = 0; t < n_tiles; t++) {
+            const float * in = &b.inputs[(k * n_tiles + t) * 4];
+            GO_ASSERT(in[0] + in[1] + in[2] == 1.f, "planes of tile %u", t);
+        }
+    }
+}
+
+
+int main() {
+    const coord_t size = 5;
+    const uint32_t n_tiles = size * size;
+    const uint64_t capacity = 500;
+    const uint32_t n_writers = 3;
+    const uint32_t games_per_writer = 40;
+    std::string name = "/go_replay_test_" + std::to_string(getpid());
+
+    ReplayBuffer::remove(name);
+    ReplayBuffer rb(name, size, size, capacity);
+
+    bool threw = false;
+    try {
+        ReplayBuffer missing(name + "_missing");
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    GO_ASSERT(threw, "attached to a buffer which doesn't exist");
+
+    // writer processes append their games while this one samples
+    std::vector<pid_t> writers;
+    for (uint32_t p = 0; p < n_writers; p++) {
+        pid_t pid = fork();
+        GO_ASSERT(pid != -1, "fork failed");
+        if (pid == 0) {
+            try {
+                ReplayBuffer out(name);
+                Xorshift rng(p + 1);
+                for (uint32_t i = 0; i < games_per_writer; i++) {
+                    out.add_game(random_record(size, 60, rng));
+                }
+            } catch (const std::runtime_error & e) {
+                fprintf(stderr, "writer %u: %s\n", p, e.what());
+                _exit(1);
+            }
+            _exit(0);
+        }
+        writers.push_back(pid);
+    }
+
+    Xorshift rng(0);
+    TrainingBatch b;
+    uint32_t n_sampled = 0;
+    bool running = true;
+    while (running) {
+        running = false;
+        for (pid_t pid : writers) {
+            running |= waitpid(pid, nullptr, WNOHANG) == 0;
+        }
+        if (rb.size() > 0) {
+            rb.sample(32, rng, b);
+            check_batch(b, n_tiles);
+            n_sampled += b.n;
+        }
+    }
+    for (pid_t pid : writers) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        GO_ASSERT(!WIFEXITED(status) || WEXITSTATUS(status) == 0, "writer "
+                "failed");
+    }
+
+    // every position the writers made was appended
+    uint64_t expected = 0;
+    for (uint32_t p = 0; p < n_writers; p++) {
+        Xorshift wrng(p + 1);
+        for (uint32_t i = 0; i < games_per_writer; i++) {
+            expected += random_record(size, 60, wrng).moves.size();
+        }
+    }
+    GO_ASSERT(rb.n_positions() == expected && rb.size() == capacity, "%llu "
+            "positions appended, expected %llu",
+            (unsigned long long) rb.n_positions(),
+            (unsigned long long) expected);
+
+    // the latest capacity positions are all held, and the positions of each
+    // game sit together in order
+    std::vector<uint8_t> rec(TrainingCodec::record_size(size, size));
+    std::vector<uint8_t> prev(rec.size());
+    for (uint64_t i = expected - capacity; i < expected; i++) {
+        GO_ASSERT(rb.read(i, rec.data()), "position %llu not held",
+                (unsigned long long) i);
+        const TrainingRecord & r =
+            *reinterpret_cast<const TrainingRecord *>(rec.data());
+        const TrainingRecord & p =
+            *reinterpret_cast<const TrainingRecord *>(prev.data());
+        GO_ASSERT(r.game < n_writers * games_per_writer, "game %u", r.game);
+        GO_ASSERT(i == expected - capacity || r.game != p.game ||
+                r.move_number == p.move_number + 1, "position %llu is move "
+                "%u of game %u, after move %u", (unsigned long long) i,
+                r.move_number, r.game, p.move_number);
+        prev.swap(rec);
+    }
+    GO_ASSERT(!rb.read(expected - capacity - 1, rec.data()) &&
+            !rb.read(expected, rec.data()), "read a position not held");
+
+    // uniform draws average half the buffer's age, and recency weighted
+    // draws about half_life / ln 2
+    const uint32_t n = 20000;
+    const double half_life = 20;
+    double uniform_age = 0, recent_age = 0;
+    rb.sample(n, rng, b);
+    check_batch(b, n_tiles);
+    for (uint32_t k = 0; k < n; k++) {
+        uniform_age += expected - 1 - b.positions[k];
+    }
+    rb.sample(n, rng, b, half_life);
+    for (uint32_t k = 0; k < n; k++) {
+        recent_age += expected - 1 - b.positions[k];
+    }
+    uniform_age /= n;
+    recent_age /= n;
+    GO_ASSERT(std::fabs(uniform_age - (capacity - 1) / 2.) < 10, "uniform "
+            "draws have mean age %.1f", uniform_age);
+    GO_ASSERT(std::fabs(recent_age - half_life / std::log(2.)) < 3,
+            "recency weighted draws have mean age %.1f", recent_age);
+
+    // append speed from this process
+    Xorshift brng(100);
+    std::vector<GameRecord> games;
+    uint64_t bench_positions = 0;
+    for (uint32_t i = 0; i < 100; i++) {
+        games.push_back(random_record(size, 60, brng));
+        bench_positions += games.back().moves.size();
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t rep = 0; rep < 10; rep++) {
+        for (const GameRecord & g : games) {
+            rb.add_game(g);
+        }
+    }
+    double s = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+    ReplayBuffer::remove(name);
+    printf("replay_buffer ok (%u positions sampled while appending, %.0f "
+            "5x5 positions/s appended, mean age %.1f uniform, %.1f with "
+            "half-life %.0f)\n", n_sampled, 10 * bench_positions / s,
+            uniform_age, recent_age, half_life);
+    return 0;
+}
+
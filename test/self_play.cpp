@@ -0,0 +1,165 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+
+#include <unistd.h>
+
+#include <game_record.h>
+#include <go.h>
+#include <self_play.h>
+
+
+/*
+ * replays r, checking that every move is legal, that each move after the
+ * sampled opening is the search's most visited, and that the score is the
+ * score of the final position
+ */
+static void check_record(const GameRecord & r, coord_t size,
+        uint32_t playouts) {
+    GO_ASSERT(r.w == size && r.h == size, "record of a %ux%u game", r.w,
+            r.h);
+    GO_ASSERT(!r.moves.empty(), "empty game recorded");
+
+    Go g(size, size);
+    board_idx_t legal[Go::max_legal_moves];
+    for (size_t i = 0; i < r.moves.size(); i++) {
+        uint16_t move = r.moves[i];
+        board_idx_t idx = Go::no_position;
+        if (move != GameRecord::pass) {
+            idx = g.to_idx(move % size, move / size);
+            uint32_t n = g.legal_moves(legal);
+            bool found = false;
+            for (uint32_t j = 0; j < n; j++) {
+                found |= legal[j] == idx;
+            }
+            GO_ASSERT(found, "move %zu (%u) is illegal", i, move);
+        }
+
+        uint32_t total = 0, best = 0;
+        uint16_t best_move = 0;
+        bool played_visited = false;
+        for (uint32_t j = r.visit_start[i]; j < r.visit_start[i + 1]; j++) {
+            GO_ASSERT(r.visit_counts[j] > 0, "unvisited move recorded");
+            total += r.visit_counts[j];
+            played_visited |= r.visit_moves[j] == move;
+            if (r.visit_counts[j] > best) {
+                best = r.visit_counts[j];
+                best_move = r.visit_moves[j];
+            }
+        }
+        // every playout but the first, which expands the root, visits a
+        // child
+        GO_ASSERT(total > 0 && total < playouts, "%u visits before move %zu",
+                total, i);
+        GO_ASSERT(played_visited, "move %zu was never visited", i);
+        GO_ASSERT(i < SelfPlay::default_sample_moves || move == best_move,
+                "move %zu isn't the most visited", i);
+
+        g.play_idx(idx);
+    }
+    GO_ASSERT(g.game_over() || r.moves.size() ==
+            SelfPlay::max_moves_per_tile * size * size, "game stopped early");
+    GO_ASSERT(r.score == g.get_score(), "score %d recorded, final position "
+            "scores %d", r.score, g.get_score());
+}
+
+
+/*
+ * evaluates every position as even with uniform priors, and fails once it
+ * has evaluated fail_after positions
+ */
+class FailingEvaluator : public MctsEvaluator {
+private:
+    std::atomic<uint64_t> n;
+    uint64_t fail_after;
+
+public:
+    FailingEvaluator(uint64_t fail_after) : n(0), fail_after(fail_after) {}
+
+    virtual float evaluate(const Game &, const board_idx_t *, uint32_t,
+            float *) {
+        GO_ASSERT(n.fetch_add(1) < fail_after, "evaluator failed");
+        return 0.f;
+    }
+};
+
+
+/*
+ * checks that an error in one of the threads playing is rethrown by play,
+ * and that the games finished before it are written out whole
+ */
+static void check_error(const std::string & path) {
+    const coord_t size = 5;
+    const uint32_t playouts = 50;
+
+    SelfPlay sp(size, size, playouts, 4);
+    sp.set_seed(2);
+    FailingEvaluator e(20000);
+    sp.set_evaluator(&e);
+    bool threw = false;
+    GameRecordWriter out(path);
+    try {
+        sp.play(1000, out);
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    GO_ASSERT(threw, "play didn't rethrow the evaluator's error");
+
+    SelfPlay::Stats s = sp.get_stats();
+    GO_ASSERT(s.games > 0 && s.games < 1000, "%llu games played before "
+            "the error", (unsigned long long) s.games);
+    GameRecordReader in(path);
+    GameRecord r;
+    uint64_t n_read = 0;
+    while (in.next(r)) {
+        GO_ASSERT(r.w == size && !r.moves.empty(), "bad record read");
+        n_read++;
+    }
+    remove(path.c_str());
+    GO_ASSERT(n_read == s.games, "read %llu of the %llu games finished",
+            (unsigned long long) n_read, (unsigned long long) s.games);
+}
+
+
+int main() {
+    const coord_t size = 5;
+    const uint32_t playouts = 200;
+    const uint32_t n_games = 16;
+    std::string path = "/tmp/self_play_test_" + std::to_string(getpid()) +
+        ".rec";
+
+    SelfPlay sp(size, size, playouts, 4);
+    sp.set_seed(1);
+    {
+        GameRecordWriter out(path);
+        sp.play(n_games, out);
+    }
+    SelfPlay::Stats s = sp.get_stats();
+    GO_ASSERT(s.games == n_games, "%llu games played",
+            (unsigned long long) s.games);
+
+    GameRecordReader in(path);
+    GameRecord r;
+    uint64_t n_read = 0, positions = 0;
+    while (in.next(r)) {
+        check_record(r, size, playouts);
+        n_read++;
+        positions += r.moves.size();
+    }
+    remove(path.c_str());
+    GO_ASSERT(n_read == n_games && positions == s.positions, "read %llu "
+            "games of %llu positions, played %llu of %llu",
+            (unsigned long long) n_read, (unsigned long long) positions,
+            (unsigned long long) n_games, (unsigned long long) s.positions);
+
+    check_error(path);
+
+    printf("self_play ok (%ux%u, %u playouts: %.0f games/hour, %.0f "
+            "positions/s)\n", size, size, playouts, s.games_per_hour,
+            s.positions_per_second);
+    return 0;
+}
+
@@ -0,0 +1,142 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <sgf.h>
+#include <xorshift.h>
+
+
+/*
+ * checks that the stones from begin to end are as listed in s, a
+ * space-separated list of color and coordinate letters ("Bdd", "W" to pass)
+ */
+static void check_stones(const SgfMove * begin, const SgfMove * end,
+        const char * s) {
+    const SgfMove * m = begin;
+    while (*s != '\0') {
+        GO_ASSERT(m != end, "fewer stones than %s", s);
+        GO_ASSERT(m->color == (*s == 'B' ? Color::black : Color::white),
+                "stone %zu has the wrong color", (size_t) (m - begin));
+        s++;
+        if (*s == ' ' || *s == '\0') {
+            GO_ASSERT(m->x == SgfMove::pass && m->y == SgfMove::pass,
+                    "stone %zu isn't a pass", (size_t) (m - begin));
+        }
+        else {
+            GO_ASSERT(m->x == s[0] - 'a' && m->y == s[1] - 'a', "stone %zu "
+                    "is at (%u, %u), not %c%c", (size_t) (m - begin), m->x,
+                    m->y, s[0], s[1]);
+            s += 2;
+        }
+        for (; *s == ' '; s++);
+        m++;
+    }
+    GO_ASSERT(m == end, "more stones than expected");
+}
+
+static bool throws(const char * sgf) {
+    try {
+        SgfCollection c(sgf, strlen(sgf));
+    } catch (const std::runtime_error &) {
+        return true;
+    }
+    return false;
+}
+
+
+int main() {
+    // three games with variations, setup stones and escapes, and text
+    // around them
+    const char * sgf =
+        "header text (;GM[1]FF[4]SZ[9]KM[6.5]\n"
+        "PB[Black \\] Player]PW[White\\\\]RE[W+R]\n"
+        "C[a comment \\] with (;B[aa\\])]\n"
+        "AB[cc][dd]AW[ee:ff]\n"
+        ";B[ab];W[ba]\n"
+        "(;B[cd]C[main];W[]\n"
+        "  (;B[ii])\n"
+        "  (;B[hh]))\n"
+        "(;B[gg];W[gh]))\n"
+        "(;SZ[19:13];B[tt]W[sm]) between\n"
+        "(;GaMe[1]SiZe[5]B[ee]TR[aa][bb];W[tt])\n";
+    SgfCollection c(sgf, strlen(sgf));
+    GO_ASSERT(c.n_games() == 3, "read %zu games", c.n_games());
+
+    const SgfGame & g0 = c.game(0);
+    GO_ASSERT(g0.w == 9 && g0.h == 9 && g0.komi == 6.5f, "game 0 is %ux%u "
+            "with komi %f", g0.w, g0.h, g0.komi);
+    GO_ASSERT(SgfCollection::text(g0.black) == "Black ] Player" &&
+            SgfCollection::text(g0.white) == "White\\" && g0.result == "W+R",
+            "game 0 players %s and %s, result %s",
+            SgfCollection::text(g0.black).c_str(),
+            SgfCollection::text(g0.white).c_str(),
+            std::string(g0.result).c_str());
+    check_stones(c.setup_begin(g0), c.setup_end(g0),
+            "Bcc Bdd Wee Wfe Wef Wff");
+    check_stones(c.moves_begin(g0), c.moves_end(g0), "Bab Wba Bcd W Bii");
+
+    const SgfGame & g1 = c.game(1);
+    GO_ASSERT(g1.w == 19 && g1.h == 13 && g1.black.empty(), "game 1 is "
+            "%ux%u", g1.w, g1.h);
+    check_stones(c.setup_begin(g1), c.setup_end(g1), "");
+    check_stones(c.moves_begin(g1), c.moves_end(g1), "B Wsm");
+
+    // old style property names
+    const SgfGame & g2 = c.game(2);
+    GO_ASSERT(g2.w == 5 && g2.h == 5, "game 2 is %ux%u", g2.w, g2.h);
+    check_stones(c.moves_begin(g2), c.moves_end(g2), "Bee W");
+
+    GO_ASSERT(SgfCollection::text("soft\\\nbreak\\\r\nhere") ==
+            "softbreakhere", "soft line breaks kept");
+
+    GO_ASSERT(throws("(;B[aa]") && throws("(;B[aa) ") && throws("(;B[z])") &&
+            throws("(;SZ[5];B[ff])") && throws("(;SZ[x])") &&
+            throws("(;B[aa]W)") && throws("(;B[aa]{)"), "parsed a bad file");
+
+    // reading speed, over a file of random 19x19 games
+    Xorshift rng(25);
+    std::string big;
+    uint64_t n_moves = 0;
+    const uint32_t n_games = 20000;
+    for (uint32_t i = 0; i < n_games; i++) {
+        big += "(;GM[1]FF[4]SZ[19]KM[7.5]PB[player " + std::to_string(i) +
+            "]PW[someone]RE[B+" + std::to_string(i % 20) + ".5]\n";
+        for (uint32_t m = 0; m < 200; m++) {
+            char move[16];
+            snprintf(move, sizeof(move), ";%c[%c%c]", m & 1 ? 'W' : 'B',
+                    'a' + (char) rng.below(19), 'a' + (char) rng.below(19));
+            big += move;
+            if (m % 10 == 9) {
+                big += '\n';
+            }
+        }
+        n_moves += 200;
+        big += ")\n";
+    }
+    std::string path = "/tmp/sgf_test_" + std::to_string(getpid()) + ".sgf";
+    FILE * f = fopen(path.c_str(), "w");
+    GO_ASSERT(f != nullptr, "could not open %s", path.c_str());
+    fwrite(big.data(), 1, big.size(), f);
+    fclose(f);
+
+    auto start = std::chrono::steady_clock::now();
+    SgfCollection file(path);
+    double s = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    remove(path.c_str());
+    GO_ASSERT(file.n_games() == n_games && file.n_stones() == n_moves,
+            "read %zu games and %zu stones from %s", file.n_games(),
+            file.n_stones(), path.c_str());
+
+    printf("sgf ok (%zu games, %.1f MB in %.3f s: %.0f MB/s)\n",
+            file.n_games(), big.size() / 1e6, s, big.size() / 1e6 / s);
+    return 0;
+}
+
@@ -0,0 +1,138 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <go.h>
+#include <zobrist.h>
+
+
+/*
+ * the arrangement of stones on the board, which positional superko forbids
+ * repeating
+ */
+static std::string board_str(const Go & g) {
+    std::string s;
+    for (coord_t y = 0; y < g.height(); y++) {
+        for (coord_t x = 0; x < g.width(); x++) {
+            Color c = g.tile_at(x, y);
+            // the ko tile is empty
+            s += (char) ('0' + (c == Color::ko ? Color::empty : c));
+        }
+    }
+    return s;
+}
+
+
+/*
+ * plays random games with superko on, checking against a list of every board
+ * seen on the current line that the legal moves are exactly the moves legal
+ * under simple ko which don't repeat a board, and that playing a repeating
+ * move is refused. Every few moves, some are undone, to check the positions
+ * of undone moves are forgotten. Returns the number of moves which were
+ * legal under simple ko but not superko
+ */
+static uint32_t check_superko(coord_t w, coord_t h, int n_games) {
+    ZobristHash zh(w, h);
+    uint32_t n_repeats = 0;
+
+    for (int game = 0; game < n_games; game++) {
+        Go g(w, h);
+        g.set_zobrist(&zh);
+        g.set_superko(true);
+
+        // the boards reached by each move on the current line, with the
+        // starting board first
+        std::vector<std::string> boards;
+        boards.push_back(board_str(g));
+
+        while (!g.game_over() && g.get_turn() < 8 * w * h) {
+            std::vector<board_idx_t> legal;
+            g.for_each_legal_move([&](Game &, GameMove & m) -> bool {
+                    GoMove & gm = dynamic_cast<GoMove &>(m);
+                    if (gm.color != Color::pass) {
+                        legal.push_back(g.to_idx(gm.x, gm.y));
+                    }
+                    return true;
+                });
+
+            board_idx_t moves[Go::max_legal_moves];
+            uint32_t n_moves = g.legal_moves(moves);
+            for (uint32_t i = 0; i < n_moves; i++) {
+                board_idx_t idx = moves[i];
+                Go c(g);
+                c.set_superko(false);
+                c.play_idx(idx);
+                bool repeats = std::find(boards.begin(), boards.end(),
+                        board_str(c)) != boards.end();
+                bool allowed = std::find(legal.begin(), legal.end(), idx) !=
+                    legal.end();
+                GO_ASSERT(repeats != allowed, "move at (%u, %u) %s a board "
+                        "but is %s on turn %u", g.idx_x(idx), g.idx_y(idx),
+                        repeats ? "repeats" : "doesn't repeat",
+                        allowed ? "legal" : "illegal", g.get_turn());
+
+                if (repeats) {
+                    n_repeats++;
+                    GoMove m;
+                    m.color = g.get_player();
+                    m.x = g.idx_x(idx);
+                    m.y = g.idx_y(idx);
+                    std::string before = board_str(g);
+                    bool refused = false;
+                    try {
+                        g.play(m);
+                    }
+                    catch (const std::runtime_error &) {
+                        refused = true;
+                    }
+                    GO_ASSERT(refused, "play accepted a repeating move");
+                    GO_ASSERT(board_str(g) == before, "refused move changed "
+                            "the board");
+                    g.consistency_check();
+                }
+            }
+
+            // only pass once no other moves can be made, so games reach
+            // captures and kos before they end
+            if (legal.empty()) {
+                g.play_idx(Go::no_position);
+            }
+            else {
+                g.play_idx(legal[rand() % legal.size()]);
+                boards.push_back(board_str(g));
+            }
+            g.consistency_check();
+
+            if (rand() % 8 == 0) {
+                int n_undo = rand() % 4;
+                for (int i = 0; i < n_undo && g.get_turn() > 0; i++) {
+                    // passes didn't add a board
+                    if (!g.has_passed()) {
+                        boards.pop_back();
+                    }
+                    g.undo_idx();
+                    g.consistency_check();
+                }
+            }
+        }
+    }
+
+    return n_repeats;
+}
+
+
+int main() {
+    srand(0);
+
+    uint32_t n_repeats = check_superko(3, 3, 200) +
+        check_superko(4, 4, 100) + check_superko(5, 5, 20);
+    GO_ASSERT(n_repeats > 0, "no game reached a superko");
+
+    printf("superko ok (%u repeating moves refused)\n", n_repeats);
+    return 0;
+}
+
@@ -0,0 +1,207 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <game_record.h>
+#include <go.h>
+#include <training_data.h>
+#include <xorshift.h>
+
+
+/*
+ * a random game of n moves on a w x h board, where the search gave the move
+ * played 8 visits and a few random tiles 1 to 4
+ */
+static GameRecord random_record(coord_t w, coord_t h, uint32_t n,
+        Xorshift & rng) {
+    GameRecord r;
+    r.clear(w, h);
+    Go g(w, h);
+    board_idx_t legal[Go::max_legal_moves];
+    for (uint32_t i = 0; i < n && !g.game_over(); i++) {
+        uint32_t n_legal = g.legal_moves(legal);
+        board_idx_t idx = n_legal == 0 ? Go::no_position :
+            legal[rng.below(n_legal)];
+        uint16_t move = idx == Go::no_position ? GameRecord::pass :
+            g.idx_y(idx) * w + g.idx_x(idx);
+
+        std::vector<uint16_t> visited = { move };
+        std::vector<uint32_t> counts = { 8 };
+        for (uint32_t j = 0; j < 3; j++) {
+            uint16_t m = rng.below(w * h + 1);
+            m = m == w * h ? GameRecord::pass : m;
+            if (std::find(visited.begin(), visited.end(), m) ==
+                    visited.end()) {
+                visited.push_back(m);
+                counts.push_back(1 + rng.below(4));
+            }
+        }
+        r.add_move(move, visited.data(), counts.data(), visited.size());
+        g.play_idx(idx);
+    }
+    r.score = g.get_score();
+    return r;
+}
+
+
+/*
+ * checks that every position of the file reads back as its game was played,
+ * that every symmetry moves the board and policy to the expected tiles, and
+ * that minibatches are encoded as BatchEvaluator::encode_stones would
+ */
+static void check_file(coord_t w, coord_t h) {
+    std::string path = "/tmp/training_data_test_" + std::to_string(getpid()) +
+        ".td";
+    Xorshift rng(w * 100 + h);
+    uint32_t n_tiles = w * h;
+
+    std::vector<GameRecord> games;
+    {
+        // small chunks, so positions are spread over many
+        TrainingWriter out(path, w, h, 7);
+        for (uint32_t i = 0; i < 6; i++) {
+            games.push_back(random_record(w, h, 10 + rng.below(2 * n_tiles),
+                        rng));
+            out.add_game(games.back());
+        }
+    }
+
+    TrainingReader in(path);
+    GO_ASSERT(in.width() == w && in.height() == h, "read a %ux%u file",
+            in.width(), in.height());
+
+    std::vector<uint8_t> board(n_tiles), sym_board(n_tiles);
+    std::vector<float> policy(n_tiles + 1), sym_policy(n_tiles + 1);
+    uint64_t i = 0;
+    for (uint32_t game = 0; game < games.size(); game++) {
+        const GameRecord & r = games[game];
+        Go g(w, h);
+        for (uint32_t m = 0; m < r.moves.size(); m++, i++) {
+            const TrainingRecord & tr = in.record(i);
+            GO_ASSERT(tr.game == game && tr.move_number == m &&
+                    tr.move == r.moves[m] && tr.score == r.score &&
+                    tr.value == (r.score > 0 ? 1.f : r.score < 0 ? -1.f : 0.f),
+                    "metadata of position %llu", (unsigned long long) i);
+            GO_ASSERT((tr.turn & 1) == (g.get_player() == Color::white),
+                    "side to move of position %llu", (unsigned long long) i);
+
+            in.read(i, 0, board.data(), policy.data());
+            for (coord_t y = 0; y < h; y++) {
+                for (coord_t x = 0; x < w; x++) {
+                    Color c = g.tile_at(x, y);
+                    uint8_t e = c == Color::black ? 1 : c == Color::white ? 2 :
+                        c == Color::ko ? 3 : 0;
+                    GO_ASSERT(board[y * w + x] == e, "tile (%u, %u) of "
+                            "position %llu", x, y, (unsigned long long) i);
+                }
+            }
+            uint32_t total = 0;
+            for (uint32_t j = r.visit_start[m]; j < r.visit_start[m + 1];
+                    j++) {
+                total += r.visit_counts[j];
+            }
+            for (uint32_t j = r.visit_start[m]; j < r.visit_start[m + 1];
+                    j++) {
+                uint16_t v = r.visit_moves[j];
+                float p = policy[v == GameRecord::pass ? n_tiles : v];
+                GO_ASSERT(std::fabs(p - (float) r.visit_counts[j] / total) <
+                        1e-4f, "policy of move %u of position %llu is %f", v,
+                        (unsigned long long) i, p);
+            }
+
+            for (uint32_t s = 1; s < 8; s++) {
+                if (w != h && (s & 1) != 0) {
+                    continue;
+                }
+                in.read(i, s, sym_board.data(), sym_policy.data());
+                for (coord_t y = 0; y < h; y++) {
+                    for (coord_t x = 0; x < w; x++) {
+                        // mirror, then rotate, keeping track of the shape
+                        coord_t tx = (s & 4) ? w - x - 1 : x, ty = y;
+                        coord_t cw = w, ch = h;
+                        for (uint32_t rot = 0; rot < (s & 3); rot++) {
+                            coord_t _x = tx;
+                            tx = ch - ty - 1;
+                            ty = _x;
+                            std::swap(cw, ch);
+                        }
+                        GO_ASSERT(sym_board[ty * cw + tx] == board[y * w + x]
+                                && sym_policy[ty * cw + tx] ==
+                                policy[y * w + x], "symmetry %u moved (%u, "
+                                "%u) wrongly", s, x, y);
+                    }
+                }
+                GO_ASSERT(sym_policy[n_tiles] == policy[n_tiles],
+                        "symmetry %u changed the pass", s);
+            }
+
+            uint16_t mv = r.moves[m];
+            g.play_idx(mv == GameRecord::pass ? Go::no_position :
+                    g.to_idx(mv % w, mv / w));
+        }
+    }
+    GO_ASSERT(i == in.n_positions(), "%llu positions in the file, %llu "
+            "played", (unsigned long long) in.n_positions(),
+            (unsigned long long) i);
+
+    TrainingBatch b;
+    in.sample(64, rng, b);
+    for (uint32_t k = 0; k < b.n; k++) {
+        float sum = 0;
+        for (uint32_t t = 0; t <= n_tiles; t++) {
+            sum += b.policies[k * (n_tiles + 1) + t];
+        }
+        GO_ASSERT(std::fabs(sum - 1.f) < 1e-4f, "policy sums to %f", sum);
+        GO_ASSERT(w == h || (b.symmetries[k] & 1) == 0, "turned a %ux%u "
+                "board on its side", w, h);
+        float black_to_move = b.inputs[k * n_tiles * 4 + 3];
+        for (uint32_t t = 0; t < n_tiles; t++) {
+            const float * in = &b.inputs[(k * n_tiles + t) * 4];
+            GO_ASSERT(in[0] + in[1] + in[2] == 1.f && in[3] ==
+                    black_to_move, "planes of tile %u", t);
+        }
+    }
+
+    remove(path.c_str());
+}
+
+
+int main() {
+    check_file(5, 5);
+    check_file(6, 4);
+    check_file(9, 9);
+
+    // sampling speed from a file of 19x19 games
+    std::string path = "/tmp/training_data_bench_" + std::to_string(getpid()) +
+        ".td";
+    Xorshift rng(19);
+    {
+        TrainingWriter out(path, 19, 19);
+        for (uint32_t i = 0; i < 40; i++) {
+            out.add_game(random_record(19, 19, 250, rng));
+        }
+    }
+    TrainingReader in(path);
+    TrainingBatch b;
+    uint32_t n_batches = 200;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < n_batches; i++) {
+        in.sample(256, rng, b);
+    }
+    double s = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    remove(path.c_str());
+
+    printf("training_data ok (%llu positions of %u bytes, %.0f 19x19 "
+            "positions/s sampled)\n", (unsigned long long) in.n_positions(),
+            TrainingCodec::record_size(19, 19), n_batches * 256 / s);
+    return 0;
+}
+
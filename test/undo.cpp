@@ -0,0 +1,104 @@
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <go.h>
+#include <zobrist.h>
+
+
+/*
+ * string representation of the full state of the game, including the string
+ * indices and liberty counts of every tile, so that two games which compare
+ * equal are in exactly the same internal state
+ */
+static std::string state_str(const Go & g) {
+    std::ostringstream os;
+    g.print(os);
+    g.print_libs(os);
+    g.print_str_idx(os);
+    os << "turn: " << g.get_turn() << " score: " << g.get_score() <<
+        " over: " << g.game_over() << " hash: " << g.get_raw_hash() << "\n";
+    return os.str();
+}
+
+
+static bool random_move(Go & g, GoMove & move) {
+    std::vector<GoMove> moves;
+    g.for_each_legal_move([&](Game &, GameMove & m) -> bool {
+            moves.push_back(dynamic_cast<GoMove &>(m));
+            return true;
+        });
+    if (moves.size() == 0) {
+        return false;
+    }
+    // only pass once no other moves can be made, so games reach captures
+    // and kos before they end
+    size_t n = moves.size() > 1 ? moves.size() - 1 : 1;
+    move = moves[rand() % n];
+    return true;
+}
+
+
+/*
+ * plays random games, checking that undoing each move restores the exact
+ * state of the game before it was played (including its incremental hash),
+ * and that redoing it restores the state after
+ */
+static void check_undo(coord_t w, coord_t h, int n_games) {
+    ZobristHash zh(w, h);
+
+    for (int game = 0; game < n_games; game++) {
+        Go g(w, h);
+        // consistency_check verifies the incremental hash against the board
+        g.set_zobrist(&zh);
+        std::vector<std::string> states;
+        states.push_back(state_str(g));
+
+        GoMove m;
+        while (random_move(g, m) && g.get_turn() < 4 * w * h) {
+            g.play(m);
+            g.consistency_check();
+            std::string after = state_str(g);
+
+            g.undo();
+            g.consistency_check();
+            GO_ASSERT(state_str(g) == states.back(), "undo did not restore "
+                    "the state before turn %u", g.get_turn());
+            GO_ASSERT(!g.is_current(), "game is current after undo");
+
+            g.redo();
+            GO_ASSERT(state_str(g) == after, "redo did not restore the "
+                    "state after turn %u", g.get_turn() - 1);
+            GO_ASSERT(g.is_current(), "game is not current after redo");
+
+            states.push_back(after);
+        }
+
+        // unwind the whole game
+        while (g.get_turn() > 0) {
+            states.pop_back();
+            g.undo();
+            g.consistency_check();
+            GO_ASSERT(state_str(g) == states.back(), "undo did not restore "
+                    "the state before turn %u", g.get_turn());
+        }
+    }
+}
+
+
+int main() {
+    srand(0);
+
+    check_undo(5, 5, 100);
+    check_undo(9, 9, 20);
+    check_undo(19, 19, 2);
+
+    printf("undo ok\n");
+    return 0;
+}
+
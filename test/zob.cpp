@@ -1,10 +1,14 @@
 
 #include <cstdio>
 
+#include <algorithm>
 #include <iostream>
+#include <string>
+#include <unordered_map>
 
 #include <zobrist.h>
 #include <go.h>
+#include <xorshift.h>
 
 class SymmCheck {
     constexpr static uint32_t n_symmetries = 16;
@@ -66,6 +70,9 @@ public:
             gos[i].play(mov);
 
             zob_hash_t has = zh.hash(gos[i]);
+            GO_ASSERT(zh.symm_key(gos[i], zh.raw_hash(gos[i])) ==
+                    zh.symm_key(gos[0], zh.raw_hash(gos[0])),
+                    "symmetric keys of symmetries do not match");
             /*std::cout << gos[i];
             printf("hash: %llx\n", has);*/
             if (!has_b4) {
@@ -86,6 +93,75 @@ public:
     }
 };
 
+
+/*
+ * the least of the 16 symmetries of g written out tile by tile with the
+ * player to move, which two positions share only if they are symmetric
+ */
+static std::string canonical_board(const Go & g) {
+    coord_t w = g.width();
+    std::string best;
+    for (uint32_t s = 0; s < 16; s++) {
+        std::string b(w * w + 2, ' ');
+        for (coord_t y = 0; y < w; y++) {
+            for (coord_t x = 0; x < w; x++) {
+                coord_t tx = (s & 4) ? w - x - 1 : x, ty = y;
+                for (uint32_t r = 0; r < (s & 3); r++) {
+                    coord_t _x = tx;
+                    tx = w - ty - 1;
+                    ty = _x;
+                }
+                Color c = g.tile_at(x, y);
+                if ((s & 8) && (c == Color::black || c == Color::white)) {
+                    c = other_color(c);
+                }
+                b[ty * w + tx] = '0' + c;
+            }
+        }
+        Color p = g.get_player();
+        b[w * w] = '0' + ((s & 8) ? other_color(p) : p);
+        b[w * w + 1] = '0' + g.has_passed();
+        if (s == 0 || b < best) {
+            best = b;
+        }
+    }
+    return best;
+}
+
+/*
+ * plays random games on a w x w board, checking that no two positions which
+ * aren't symmetric share a symm_key, and returning the number of
+ * positions which share a make_symm hash with one that isn't symmetric to
+ * them
+ */
+static uint64_t check_symm_key(coord_t w, uint32_t n_games,
+        uint64_t & n_positions) {
+    ZobristHash zh(w, w);
+    Xorshift rng(w);
+    std::unordered_map<zob_hash_t, std::string> canon, symm;
+    uint64_t symm_collisions = 0;
+    board_idx_t legal[Go::max_legal_moves];
+    for (uint32_t i = 0; i < n_games; i++) {
+        Go g(w, w);
+        for (uint32_t m = 0; m < 4 * w * w && !g.game_over(); m++) {
+            uint32_t n_legal = g.legal_moves(legal);
+            g.play_idx(n_legal == 0 || rng.below(20) == 0 ? Go::no_position :
+                    legal[rng.below(n_legal)]);
+
+            std::string b = canonical_board(g);
+            zob_hash_t raw = zh.raw_hash(g);
+            auto [c, is_new] = canon.emplace(zh.symm_key(g, raw), b);
+            GO_ASSERT(c->second == b, "positions which aren't symmetric "
+                    "share the symmetric key %016llx",
+                    (unsigned long long) c->first);
+            auto e = symm.emplace(ZobristHash::make_symm(raw), b).first;
+            symm_collisions += is_new && e->second != b;
+        }
+    }
+    n_positions = canon.size();
+    return symm_collisions;
+}
+
 int main() {
 
     constexpr coord_t w = 5, h = 5;
@@ -105,6 +181,11 @@ int main() {
         sc.play(m);
     }
 
+    uint64_t n_positions;
+    uint64_t symm_collisions = check_symm_key(w, 2000, n_positions);
+    printf("zob ok (%llu 5x5 positions: no symm_key collisions, %llu "
+            "make_symm collisions)\n", (unsigned long long) n_positions,
+            (unsigned long long) symm_collisions);
 
     return 0;
 }